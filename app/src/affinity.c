@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(CONFIG_APP_AFFINITY)
+#include "affinity.h"
+
+/* Ticks a thread is waited for to stop running */
+#define AFFINITY_RETRIES 10
+
+#define RADIO CONFIG_APP_AFFINITY_RADIO_CPU
+#define APP CONFIG_APP_AFFINITY_APP_CPU
+
+/*
+ * The Bluetooth host runs its callbacks, such as the GATT reads, on its
+ * threads and on the system workqueue. The Wi-Fi driver and the network
+ * management threads run the station events, and the uplink the bursts.
+ */
+static const struct {
+	const char *name;
+	int cpu;
+} pins[] = {
+	{ "BT RX", RADIO },
+	{ "BT RX WQ", RADIO },
+	{ "BT TX", RADIO },
+	{ "BT LW WQ", RADIO },
+	{ "sysworkq", RADIO },
+	{ "wifi", RADIO },
+	{ "esp_wifi_event", RADIO },
+	{ "net_mgmt", RADIO },
+	{ "uplink", RADIO },
+	{ "i2c_queue", APP },
+};
+
+struct affinity_walk {
+	const char *name;
+	k_tid_t threads[ARRAY_SIZE(pins)];
+	int cpus[ARRAY_SIZE(pins)];
+	size_t count;
+};
+
+static void affinity_thread_match(const struct k_thread *thread,
+				  void *user_data)
+{
+	struct affinity_walk *walk = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	size_t i;
+
+	if ((name == NULL) || (walk->count == ARRAY_SIZE(walk->threads))) {
+		return;
+	}
+
+	/* A thread looked up by name, or the threads of the table */
+	if (walk->name) {
+		if (strcmp(name, walk->name) == 0) {
+			walk->threads[walk->count++] = (k_tid_t)thread;
+		}
+
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pins); i++) {
+		if (strcmp(name, pins[i].name) != 0) {
+			continue;
+		}
+
+		walk->threads[walk->count] = (k_tid_t)thread;
+		walk->cpus[walk->count] = pins[i].cpu;
+		walk->count++;
+		return;
+	}
+}
+
+int affinity_pin(k_tid_t thread, int cpu)
+{
+	int retries = AFFINITY_RETRIES, err;
+
+	if ((cpu < 0) || (cpu >= arch_num_cpus())) {
+		return -EINVAL;
+	}
+
+	/* The CPU mask of a running thread cannot change */
+	for (;;) {
+		err = k_thread_cpu_pin(thread, cpu);
+		if ((err != -EINVAL) || (retries-- == 0)) {
+			return err;
+		}
+
+		k_sleep(K_TICKS(1));
+	}
+}
+
+struct affinity_self {
+	struct k_work_delayable work;
+	struct k_sem done;
+	k_tid_t thread;
+	int cpu;
+	int retries;
+	int err;
+};
+
+/* The calling thread is pinned while it pends on the semaphore */
+static void affinity_self_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct affinity_self *self = CONTAINER_OF(dwork, struct affinity_self,
+						  work);
+
+	self->err = k_thread_cpu_pin(self->thread, self->cpu);
+	if ((self->err == -EINVAL) && (self->retries-- > 0)) {
+		k_work_schedule(dwork, K_TICKS(1));
+		return;
+	}
+
+	k_sem_give(&self->done);
+}
+
+static int affinity_pin_self(int cpu)
+{
+	struct affinity_self self = {
+		.thread = k_current_get(),
+		.cpu = cpu,
+		.retries = AFFINITY_RETRIES,
+	};
+
+	if ((cpu < 0) || (cpu >= arch_num_cpus())) {
+		return -EINVAL;
+	}
+
+	k_sem_init(&self.done, 0, 1);
+	k_work_init_delayable(&self.work, affinity_self_handler);
+	k_work_schedule(&self.work, K_NO_WAIT);
+	k_sem_take(&self.done, K_FOREVER);
+
+	return self.err;
+}
+
+int affinity_setup(void)
+{
+	struct affinity_walk walk = { 0 };
+	int err, unpinned = 0;
+	size_t i;
+
+	k_thread_foreach(affinity_thread_match, &walk);
+
+	for (i = 0; i < walk.count; i++) {
+		err = affinity_pin(walk.threads[i], walk.cpus[i]);
+		if (err) {
+			printk("Warning: %s: Failed to pin to CPU%d: %i\n",
+			       k_thread_name_get(walk.threads[i]),
+			       walk.cpus[i], err);
+			unpinned++;
+		}
+	}
+
+	err = affinity_pin_self(APP);
+	if (err) {
+		printk("Warning: %s: Failed to pin to CPU%d: %i\n",
+		       k_thread_name_get(k_current_get()), APP, err);
+		unpinned++;
+	}
+
+	return unpinned;
+}
+
+#if defined(CONFIG_SHELL)
+static void affinity_thread_print(const struct k_thread *thread,
+				  void *user_data)
+{
+	const struct shell *shell = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	shell_print(shell, "%-16s 0x%02x", (name && *name) ? name : "unnamed",
+		    thread->base.cpu_mask);
+}
+
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	shell_print(shell, "%-16s %4s", "Thread", "CPUs");
+	k_thread_foreach_unlocked(affinity_thread_print, (void *)shell);
+
+	return 0;
+}
+
+static int cmd_pin(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct affinity_walk walk = { .name = argv[1] };
+	char *end;
+	long cpu;
+	int err;
+
+	cpu = strtol(argv[2], &end, 0);
+	if ((*end != '\0') || (cpu < 0) || (cpu >= arch_num_cpus())) {
+		shell_error(shell, "Invalid CPU: %s", argv[2]);
+		return -EINVAL;
+	}
+
+	k_thread_foreach(affinity_thread_match, &walk);
+	if (walk.count == 0) {
+		shell_error(shell, "No such thread: %s", argv[1]);
+		return -ENOENT;
+	}
+
+	err = affinity_pin(walk.threads[0], cpu);
+	if (err) {
+		shell_error(shell, "%s: Failed to pin to CPU%ld: %i", argv[1],
+			    cpu, err);
+		return err;
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(affinity_cmds,
+	SHELL_CMD_ARG(show, NULL, NULL, cmd_show, 1, 0),
+	SHELL_CMD_ARG(pin,  NULL, "<thread> <cpu>", cmd_pin, 3, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_affinity(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(affinity, &affinity_cmds, "CPU affinity commands",
+		       cmd_affinity, 2, 0);
+#endif
+#endif
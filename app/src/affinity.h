@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_AFFINITY_H_
+#define APP_AFFINITY_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Pin the threads of the radio stacks, and the uplink one, to
+ * CONFIG_APP_AFFINITY_RADIO_CPU, and the calling thread, which runs the
+ * acquisition and the UI, with the sensor bus one, to
+ * CONFIG_APP_AFFINITY_APP_CPU; returns the number of threads left unpinned.
+ *
+ * The threads are to exist already, e.g. the Bluetooth ones are created by
+ * bt_enable(), and the uplink one by uplink_setup().
+ */
+int affinity_setup(void);
+
+/*
+ * Pin the thread to the CPU, once it stops running; returns -EINVAL if it
+ * keeps running.
+ */
+int affinity_pin(k_tid_t thread, int cpu);
+
+#endif /* APP_AFFINITY_H_ */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+
+#include "events.h"
+
+static struct events *registered;
+
+static const char * const kind_str[] = {
+	[EVENT_ABOVE] = "above",
+	[EVENT_BELOW] = "below",
+	[EVENT_DELTA] = "delta",
+	[EVENT_CHANGE] = "change",
+	[EVENT_RATE] = "rate",
+};
+
+int events_add(struct events *events, struct event_cond *cond)
+{
+	if ((cond->cb == NULL) || (cond->kind >= ARRAY_SIZE(kind_str))) {
+		return -EINVAL;
+	}
+
+	if ((cond->kind == EVENT_RATE) && (cond->period_ms == 0)) {
+		return -EINVAL;
+	}
+
+	cond->primed = false;
+	sys_slist_append(&events->conds, &cond->node);
+
+	return 0;
+}
+
+/* Crossings fire once, and re-arm past the hysteresis */
+static bool cond_threshold(struct event_cond *cond, int32_t value)
+{
+	bool beyond, back;
+
+	if (cond->kind == EVENT_ABOVE) {
+		beyond = value > cond->threshold;
+		back = value <= cond->threshold - cond->hysteresis;
+	} else {
+		beyond = value < cond->threshold;
+		back = value >= cond->threshold + cond->hysteresis;
+	}
+
+	if (cond->armed && beyond) {
+		cond->armed = false;
+		return true;
+	}
+
+	if (back) {
+		cond->armed = true;
+	}
+
+	return false;
+}
+
+/* The reference is the value at the last event */
+static bool cond_delta(struct event_cond *cond, int32_t value)
+{
+	int64_t delta = llabs((int64_t)value - cond->ref);
+	bool match;
+
+	if (cond->kind == EVENT_DELTA) {
+		match = delta >= cond->threshold;
+	} else {
+		match = (delta * 100000) >= ((int64_t)cond->threshold *
+					     llabs(cond->ref));
+		match = match && delta;
+	}
+
+	if (match) {
+		cond->ref = value;
+	}
+
+	return match;
+}
+
+/*
+ * The rate is measured over back-to-back spans of at least period_ms, i.e. a
+ * tumbling window: the reference is the first value of the span, and the
+ * value which ends a span is the reference of the next one.
+ */
+static bool cond_rate(struct event_cond *cond, int32_t value, int64_t now)
+{
+	int64_t elapsed = now - cond->ref_ms, rate;
+	bool match;
+
+	if (elapsed < cond->period_ms) {
+		return false;
+	}
+
+	rate = (((int64_t)value - cond->ref) * 3600000) / elapsed;
+	if (cond->threshold < 0) {
+		match = rate <= cond->threshold;
+	} else {
+		match = rate >= cond->threshold;
+	}
+
+	cond->ref = value;
+	cond->ref_ms = now;
+
+	return match;
+}
+
+static bool cond_eval(struct event_cond *cond, int32_t value, int64_t now)
+{
+	cond->evaluations++;
+
+	/* The first sample sets the reference, or the side of the threshold */
+	if (!cond->primed) {
+		cond->primed = true;
+		cond->armed = true;
+		cond->ref = value;
+		cond->ref_ms = now;
+
+		if ((cond->kind == EVENT_DELTA) ||
+		    (cond->kind == EVENT_CHANGE)) {
+			return true;
+		} else if (cond->kind == EVENT_RATE) {
+			return false;
+		}
+	}
+
+	switch (cond->kind) {
+	case EVENT_ABOVE:
+	case EVENT_BELOW:
+		return cond_threshold(cond, value);
+	case EVENT_DELTA:
+	case EVENT_CHANGE:
+		return cond_delta(cond, value);
+	case EVENT_RATE:
+		return cond_rate(cond, value, now);
+	}
+
+	return false;
+}
+
+int events_sample(struct events *events, int channel, int32_t value,
+		  int64_t now)
+{
+	struct event_cond *cond;
+	int n = 0;
+
+	events->samples++;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&events->conds, cond, node) {
+		if (cond->channel != channel) {
+			continue;
+		}
+
+		if (!cond_eval(cond, value, now)) {
+			continue;
+		}
+
+		cond->dispatches++;
+		cond->cb(cond, value);
+		n++;
+	}
+
+	events->dispatches += n;
+
+	return n;
+}
+
+void events_register(struct events *events)
+{
+	registered = events;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_events(const struct shell *shell, size_t argc, char **argv)
+{
+	struct event_cond *cond;
+
+	if (registered == NULL) {
+		shell_error(shell, "No events");
+		return -ENODEV;
+	}
+
+	shell_print(shell, "%-12s %7s %-6s %9s %8s %10s", "Event", "Channel",
+		    "Kind", "Threshold", "Evals", "Dispatches");
+	SYS_SLIST_FOR_EACH_CONTAINER(&registered->conds, cond, node) {
+		shell_print(shell, "%-12s %7d %-6s %9d %8u %10u", cond->name,
+			    cond->channel, kind_str[cond->kind],
+			    cond->threshold, cond->evaluations,
+			    cond->dispatches);
+	}
+
+	shell_print(shell, "Samples:           %u", registered->samples);
+	shell_print(shell, "Dispatches:        %u", registered->dispatches);
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(events, NULL, "Show the event conditions", cmd_events);
+#endif
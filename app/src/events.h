@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_EVENTS_H_
+#define APP_EVENTS_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+enum event_kind {
+	/* The value rises above the threshold */
+	EVENT_ABOVE,
+	/* The value falls below the threshold */
+	EVENT_BELOW,
+	/* The value moves by the threshold since the last event */
+	EVENT_DELTA,
+	/* The value moves by the threshold, in m%, since the last event */
+	EVENT_CHANGE,
+	/* The value moves at the threshold per hour, or faster; a negative
+	 * threshold is a drop.
+	 */
+	EVENT_RATE,
+};
+
+struct event_cond;
+
+/*
+ * Called with the value, in thousandths of the channel unit, which matched
+ * the condition.
+ */
+typedef void (*event_cb_t)(struct event_cond *cond, int32_t value);
+
+struct event_cond {
+	sys_snode_t node;
+
+	/* Configuration */
+	const char *name;
+	int channel;
+	enum event_kind kind;
+	int32_t threshold;
+	/* Margin to re-arm the ABOVE and BELOW conditions */
+	int32_t hysteresis;
+	/* Span the RATE is measured over, span after span */
+	uint32_t period_ms;
+	event_cb_t cb;
+	void *user_data;
+
+	/* State */
+	bool primed;
+	bool armed;
+	int32_t ref;
+	int64_t ref_ms;
+
+	/* Statistics */
+	uint32_t evaluations;
+	uint32_t dispatches;
+};
+
+struct events {
+	sys_slist_t conds;
+	uint32_t samples;
+	uint32_t dispatches;
+};
+
+/*
+ * Add a condition; it is first evaluated on the next sample of its channel.
+ */
+int events_add(struct events *events, struct event_cond *cond);
+
+/*
+ * Evaluate the conditions of the channel on a new sample, and call those
+ * which match; returns the number of events dispatched.
+ */
+int events_sample(struct events *events, int channel, int32_t value,
+		  int64_t now);
+
+/*
+ * Register the events shown by the events shell command.
+ */
+void events_register(struct events *events);
+
+#endif /* APP_EVENTS_H_ */
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "filter.h"
+
+static struct filter *registered;
+static size_t registered_count;
+
+static const char * const type_str[] = {
+	[FILTER_NONE] = "none",
+	[FILTER_AVERAGE] = "average",
+	[FILTER_MEDIAN] = "median",
+	[FILTER_EMA] = "ema",
+	[FILTER_KALMAN] = "kalman",
+};
+
+const char *filter_type_str(enum filter_type type)
+{
+	if (type >= ARRAY_SIZE(type_str)) {
+		return "unknown";
+	}
+
+	return type_str[type];
+}
+
+/*
+ * The sliding median keeps the lower half of the window in a max-heap, and
+ * the upper half in a min-heap, of ring slots; the slot leaving the window
+ * is found through where[], so that it is removed in O(log n).
+ */
+static bool heap_before(const struct filter *filter,
+			const struct filter_heap *heap, size_t i, size_t j)
+{
+	int32_t a = filter->ring[heap->slots[i]];
+	int32_t b = filter->ring[heap->slots[j]];
+
+	return heap->max ? a > b : a < b;
+}
+
+static void heap_set(struct filter *filter, struct filter_heap *heap,
+		     size_t i, uint8_t slot)
+{
+	heap->slots[i] = slot;
+	filter->where[slot] = heap->max ? (int)i : -1 - (int)i;
+}
+
+static void heap_swap(struct filter *filter, struct filter_heap *heap,
+		      size_t i, size_t j)
+{
+	uint8_t slot = heap->slots[i];
+
+	heap_set(filter, heap, i, heap->slots[j]);
+	heap_set(filter, heap, j, slot);
+}
+
+static void heap_up(struct filter *filter, struct filter_heap *heap, size_t i)
+{
+	size_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!heap_before(filter, heap, i, parent)) {
+			break;
+		}
+
+		heap_swap(filter, heap, i, parent);
+		i = parent;
+	}
+}
+
+static void heap_down(struct filter *filter, struct filter_heap *heap,
+		      size_t i)
+{
+	size_t child;
+
+	while ((child = 2 * i + 1) < heap->count) {
+		if ((child + 1 < heap->count) &&
+		    heap_before(filter, heap, child + 1, child)) {
+			child++;
+		}
+
+		if (!heap_before(filter, heap, child, i)) {
+			break;
+		}
+
+		heap_swap(filter, heap, i, child);
+		i = child;
+	}
+}
+
+static void heap_push(struct filter *filter, struct filter_heap *heap,
+		      uint8_t slot)
+{
+	size_t i = heap->count++;
+
+	heap_set(filter, heap, i, slot);
+	heap_up(filter, heap, i);
+}
+
+static uint8_t heap_remove(struct filter *filter, struct filter_heap *heap,
+			   size_t i)
+{
+	uint8_t slot = heap->slots[i];
+
+	heap->count--;
+	if (i < heap->count) {
+		heap_set(filter, heap, i, heap->slots[heap->count]);
+		heap_up(filter, heap, i);
+		heap_down(filter, heap, i);
+	}
+
+	return slot;
+}
+
+/* Keep the lower half the same size as the upper half, or one more */
+static void median_balance(struct filter *filter)
+{
+	if (filter->lower.count > filter->upper.count + 1) {
+		heap_push(filter, &filter->upper,
+			  heap_remove(filter, &filter->lower, 0));
+	} else if (filter->upper.count > filter->lower.count) {
+		heap_push(filter, &filter->lower,
+			  heap_remove(filter, &filter->upper, 0));
+	}
+}
+
+static void median_insert(struct filter *filter, uint8_t slot)
+{
+	if ((filter->lower.count == 0) ||
+	    (filter->ring[slot] <= filter->ring[filter->lower.slots[0]])) {
+		heap_push(filter, &filter->lower, slot);
+	} else {
+		heap_push(filter, &filter->upper, slot);
+	}
+
+	median_balance(filter);
+}
+
+static void median_remove(struct filter *filter, uint8_t slot)
+{
+	int where = filter->where[slot];
+
+	if (where >= 0) {
+		heap_remove(filter, &filter->lower, where);
+	} else {
+		heap_remove(filter, &filter->upper, -1 - where);
+	}
+
+	median_balance(filter);
+}
+
+static int32_t median_get(const struct filter *filter)
+{
+	int32_t lower = filter->ring[filter->lower.slots[0]];
+
+	if (filter->lower.count > filter->upper.count) {
+		return lower;
+	}
+
+	return ((int64_t)lower + filter->ring[filter->upper.slots[0]]) / 2;
+}
+
+void filter_init(struct filter *filter)
+{
+	filter->window = CLAMP(filter->window, 1, CONFIG_APP_FILTER_WINDOW_MAX);
+	filter->head = 0;
+	filter->count = 0;
+	filter->sum = 0;
+	filter->lower.count = 0;
+	filter->lower.max = true;
+	filter->upper.count = 0;
+	filter->upper.max = false;
+	filter->estimate = 0;
+	filter->variance = 0;
+	filter->raw = 0;
+	filter->value = 0;
+	filter->updates = 0;
+}
+
+/* The ring holds the last window values, for the average and the median */
+static int32_t ring_update(struct filter *filter, int32_t value)
+{
+	uint8_t slot = filter->head;
+
+	if (filter->count == filter->window) {
+		if (filter->type == FILTER_MEDIAN) {
+			median_remove(filter, slot);
+		}
+		filter->sum -= filter->ring[slot];
+	} else {
+		filter->count++;
+	}
+
+	filter->ring[slot] = value;
+	filter->sum += value;
+	filter->head = (slot + 1) % filter->window;
+
+	if (filter->type == FILTER_MEDIAN) {
+		median_insert(filter, slot);
+		return median_get(filter);
+	}
+
+	return filter->sum / filter->count;
+}
+
+/* Weight of 2 / (window + 1), on an estimate in Q8 */
+static int32_t ema_update(struct filter *filter, int32_t value)
+{
+	int64_t sample = (int64_t)value << 8;
+
+	if (filter->count == 0) {
+		filter->estimate = sample;
+		filter->count = 1;
+	} else {
+		filter->estimate += ((sample - filter->estimate) * 2) /
+				    (filter->window + 1);
+	}
+
+	return (filter->estimate + 128) >> 8;
+}
+
+/*
+ * Scalar Kalman filter of a constant with a random walk, in Q8; the
+ * process noise is the measurement noise divided by the window.
+ */
+static int32_t kalman_update(struct filter *filter, int32_t value)
+{
+	int64_t sample = (int64_t)value << 8;
+	int64_t r = (int64_t)filter->noise * filter->noise;
+	int64_t q = r / ((int64_t)filter->window * filter->window);
+	int64_t gain = 1 << 16;
+
+	if (filter->count == 0) {
+		filter->estimate = sample;
+		filter->variance = r;
+		filter->count = 1;
+		return value;
+	}
+
+	filter->variance += q;
+	if (filter->variance + r) {
+		gain = (filter->variance << 16) / (filter->variance + r);
+	}
+
+	filter->estimate += (gain * (sample - filter->estimate)) / (1 << 16);
+	filter->variance = ((65536 - gain) * filter->variance) >> 16;
+
+	return (filter->estimate + 128) >> 8;
+}
+
+int32_t filter_update(struct filter *filter, int32_t value)
+{
+	filter->raw = value;
+	filter->updates++;
+
+	switch (filter->type) {
+	case FILTER_AVERAGE:
+	case FILTER_MEDIAN:
+		value = ring_update(filter, value);
+		break;
+	case FILTER_EMA:
+		value = ema_update(filter, value);
+		break;
+	case FILTER_KALMAN:
+		value = kalman_update(filter, value);
+		break;
+	default:
+		break;
+	}
+
+	filter->value = value;
+
+	return value;
+}
+
+void filter_register(struct filter *filters, size_t count)
+{
+	registered = filters;
+	registered_count = count;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	size_t i;
+
+	if (registered == NULL) {
+		shell_error(shell, "No filters");
+		return -ENODEV;
+	}
+
+	shell_print(shell, "%-12s %-8s %6s %6s %10s %10s %8s", "Channel",
+		    "Filter", "Window", "Noise", "Raw", "Filtered", "Updates");
+	for (i = 0; i < registered_count; i++) {
+		const struct filter *filter = &registered[i];
+
+		shell_print(shell, "%-12s %-8s %6u %6d %10d %10d %8u",
+			    filter->name, filter_type_str(filter->type),
+			    filter->window, filter->noise, filter->raw,
+			    filter->value, filter->updates);
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(filter_cmds,
+	SHELL_CMD_ARG(show,  NULL, NULL, cmd_show,  1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_filter(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(filter, &filter_cmds, "Sensor filter commands",
+		       cmd_filter, 2, 0);
+#endif
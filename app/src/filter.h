@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_FILTER_H_
+#define APP_FILTER_H_
+
+#include <zephyr/kernel.h>
+
+enum filter_type {
+	FILTER_NONE,
+	FILTER_AVERAGE,
+	FILTER_MEDIAN,
+	FILTER_EMA,
+	FILTER_KALMAN,
+};
+
+/* Binary heap of ring slots, for the sliding median */
+struct filter_heap {
+	uint8_t slots[CONFIG_APP_FILTER_WINDOW_MAX];
+	uint8_t count;
+	bool max;
+};
+
+/*
+ * Streaming filter of a channel, in integer arithmetic; the values are in
+ * thousandths of the channel unit, and every update is O(1) but the median
+ * one, which is O(log window).
+ */
+struct filter {
+	/* Configuration */
+	const char *name;
+	enum filter_type type;
+	/* Samples averaged, span of the EMA, or process noise divisor */
+	uint8_t window;
+	/* Measurement noise standard deviation, for the Kalman filter */
+	int32_t noise;
+
+	/* State */
+	int32_t ring[CONFIG_APP_FILTER_WINDOW_MAX];
+	uint8_t head;
+	uint8_t count;
+	int64_t sum;
+	/* Where every slot lies in the heaps, for the median */
+	int8_t where[CONFIG_APP_FILTER_WINDOW_MAX];
+	struct filter_heap lower;
+	struct filter_heap upper;
+	/* The EMA in Q8, or the Kalman estimate and variance */
+	int64_t estimate;
+	int64_t variance;
+
+	/* Last values */
+	int32_t raw;
+	int32_t value;
+	uint32_t updates;
+};
+
+#define FILTER_KCONFIG_IS(channel, type)				\
+	IS_ENABLED(CONFIG_APP_FILTER_##channel##_##type)
+
+/*
+ * Configure a filter from the APP_FILTER_<channel> Kconfig options.
+ */
+#define FILTER_KCONFIG(_name, channel)					\
+	{								\
+		.name = _name,						\
+		.type = FILTER_KCONFIG_IS(channel, AVERAGE) ?		\
+				FILTER_AVERAGE :			\
+			FILTER_KCONFIG_IS(channel, MEDIAN) ?		\
+				FILTER_MEDIAN :				\
+			FILTER_KCONFIG_IS(channel, EMA) ?		\
+				FILTER_EMA :				\
+			FILTER_KCONFIG_IS(channel, KALMAN) ?		\
+				FILTER_KALMAN : FILTER_NONE,		\
+		.window = CONFIG_APP_FILTER_##channel##_WINDOW,		\
+		.noise = CONFIG_APP_FILTER_##channel##_NOISE,		\
+	}
+
+/*
+ * Reset the filter state; the window is clamped to
+ * CONFIG_APP_FILTER_WINDOW_MAX.
+ */
+void filter_init(struct filter *filter);
+
+/*
+ * Filter a new value; returns the filtered value.
+ */
+int32_t filter_update(struct filter *filter, int32_t value);
+
+/*
+ * Returns the name of the filter type.
+ */
+const char *filter_type_str(enum filter_type type);
+
+/*
+ * Register the filters shown by the filter shell command.
+ */
+void filter_register(struct filter *filters, size_t count);
+
+#endif /* APP_FILTER_H_ */
@@ -19,7 +19,14 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/services/bas.h>
 #endif
+#if defined(CONFIG_APP_RECORD_LOG)
+#include <zephyr/fs/fcb_staging.h>
+#endif
+#include <zephyr/logging/log.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/hotpath.h>
+#include <stdlib.h>
+#include <string.h>
 #if defined(CONFIG_NEWLIB_LIBC)
 #include <time.h>
 #endif
@@ -27,14 +34,97 @@
 #include <lvgl.h>
 #endif
 
+#if defined(CONFIG_APP_AFFINITY)
+#include "affinity.h"
+#endif
+#include "events.h"
+#include "filter.h"
+#include "metrics.h"
+#include "monitor.h"
+#include "perf.h"
+#include "record.h"
+#include "sched.h"
+#include "seqlock.h"
+#include "stages.h"
+#include "tasks.h"
+#if defined(CONFIG_APP_UPLINK)
+#include "uplink.h"
+#endif
+
+LOG_MODULE_REGISTER(app, LOG_LEVEL_INF);
+
+/* Log the uptime at a boot milestone */
+static void boot_mark(const char *milestone)
+{
+	LOG_INF("Boot: %s at %ums", milestone, k_uptime_get_32());
+}
+
 static struct sensor_value bme280_temp;
 static struct sensor_value bme280_press;
 static struct sensor_value bh1750_light;
 static struct sensor_value htu21d_humidity;
 static struct sensor_value htu21d_temp;
+static struct metrics metrics;
+
+/*
+ * The values above are written by the acquisition, and read by the GATT
+ * callbacks which may run on the other CPU.
+ */
+static struct seqlock samples_seq;
+
+enum {
+	CHANNEL_TEMPERATURE = RECORD_TEMPERATURE,
+	CHANNEL_PRESSURE = RECORD_PRESSURE,
+	CHANNEL_LIGHT = RECORD_LIGHT,
+	CHANNEL_HUMIDITY = RECORD_HUMIDITY,
+};
+
+static struct filter filters[] = {
+	[CHANNEL_TEMPERATURE] = FILTER_KCONFIG("temperature", TEMPERATURE),
+	[CHANNEL_PRESSURE] = FILTER_KCONFIG("pressure", PRESSURE),
+	[CHANNEL_LIGHT] = FILTER_KCONFIG("light", LIGHT),
+	[CHANNEL_HUMIDITY] = FILTER_KCONFIG("humidity", HUMIDITY),
+};
+
+static struct events events;
+
+enum {
+	STAGE_FETCH,
+	STAGE_FILTER,
+	STAGE_METRICS,
+	STAGE_EVENTS,
+	STAGE_RECORD,
+	STAGE_UI,
+	STAGE_LATENCY,
+};
+
+/* Time spent per sample, and from the data ready trigger to the consumers */
+static struct stage stages[] = {
+	[STAGE_FETCH] = { .name = "fetch" },
+	[STAGE_FILTER] = { .name = "filter" },
+	[STAGE_METRICS] = { .name = "metrics" },
+	[STAGE_EVENTS] = { .name = "events" },
+	[STAGE_RECORD] = { .name = "record" },
+	[STAGE_UI] = { .name = "ui" },
+	[STAGE_LATENCY] = { .name = "latency" },
+};
+
+#if defined(CONFIG_NEWLIB_LIBC)
+#define TIME_LABEL_RESOLUTION 60
+#else
+#define TIME_LABEL_RESOLUTION 1
+#endif
 
 #if defined(CONFIG_LVGL)
 static lv_obj_t *time_label;
+static lv_obj_t *temp_label;
+static lv_obj_t *press_label;
+static lv_obj_t *humidity_label;
+static lv_obj_t *dew_point_label;
+static lv_obj_t *heat_index_label;
+static lv_obj_t *altitude_label;
+/* Set by the tasks only, which all run in the main thread */
+static bool ui_dirty;
 
 static void time_update_label(uint32_t timestamp)
 {
@@ -60,11 +150,58 @@ static void time_update_label(uint32_t timestamp)
 #else
 	lv_label_set_text_fmt(time_label, "%u", timestamp);
 #endif
+	ui_dirty = true;
+}
+
+static void humidity_metrics_update_label(void)
+{
+	if (!(metrics.sources & METRICS_HTU21D))
+		return;
+
+	lv_label_set_text_fmt(dew_point_label, "Td %s%d.%d°C",
+			      metrics.dew_point < 0 ? "-" : "",
+			      abs(metrics.dew_point / 1000),
+			      abs(metrics.dew_point % 1000) / 100);
+	lv_label_set_text_fmt(heat_index_label, "HI %s%d.%d°C",
+			      metrics.heat_index < 0 ? "-" : "",
+			      abs(metrics.heat_index / 1000),
+			      abs(metrics.heat_index % 1000) / 100);
+}
+
+static void channel_update_label(int channel)
+{
+	switch (channel) {
+	case CHANNEL_TEMPERATURE:
+		lv_label_set_text_fmt(temp_label, "%d.%d°C", bme280_temp.val1,
+				      bme280_temp.val2 / 100000);
+		humidity_metrics_update_label();
+		break;
+	case CHANNEL_PRESSURE:
+		lv_label_set_text_fmt(press_label, "%d.%dPa",
+				      bme280_press.val1,
+				      bme280_press.val2 / 100000);
+		lv_label_set_text_fmt(altitude_label, "%dm",
+				      metrics.altitude / 1000);
+		break;
+	case CHANNEL_HUMIDITY:
+		lv_label_set_text_fmt(humidity_label, "%d%%",
+				      htu21d_humidity.val1);
+		humidity_metrics_update_label();
+		break;
+	default:
+		return;
+	}
+
+	ui_dirty = true;
 }
 #else
 static inline void time_update_label(uint32_t timestamp)
 {
 }
+
+static inline void channel_update_label(int channel)
+{
+}
 #endif
 
 #if defined(CONFIG_BT)
@@ -73,15 +210,53 @@ static uint8_t ble_connections;
 #if defined(CONFIG_LVGL)
 static lv_obj_t *ble_label;
 
+struct ble_state {
+	uint8_t connections;
+	bool passkey_shown;
+	unsigned int passkey;
+};
+
+/*
+ * The Bluetooth callbacks may run on the other CPU: they only publish the
+ * state, and the UI task sets the label text.
+ */
+static struct ble_state ble_state;
+static struct seqlock ble_seq;
+static atomic_t ble_changed;
+
 static void bt_update_label(unsigned int *passkey)
 {
-	if (passkey)
+	seqlock_write_begin(&ble_seq);
+	ble_state.connections = ble_connections;
+	ble_state.passkey_shown = passkey != NULL;
+	ble_state.passkey = passkey ? *passkey : 0;
+	seqlock_write_end(&ble_seq);
+
+	atomic_set(&ble_changed, 1);
+}
+
+static void bt_apply_label(void)
+{
+	struct ble_state state;
+	atomic_val_t seq;
+
+	if (!atomic_cas(&ble_changed, 1, 0))
+		return;
+
+	do {
+		seq = seqlock_read_begin(&ble_seq);
+		state = ble_state;
+	} while (seqlock_read_retry(&ble_seq, seq));
+
+	if (state.passkey_shown)
 		lv_label_set_text_fmt(ble_label, LV_SYMBOL_BLUETOOTH "%06u",
-				      *passkey);
-	else if (ble_connections)
+				      state.passkey);
+	else if (state.connections)
 		lv_label_set_text(ble_label, LV_SYMBOL_BLUETOOTH);
 	else
 		lv_label_set_text(ble_label, "");
+
+	ui_dirty = true;
 }
 #else
 static inline void bt_update_label(unsigned int * const)
@@ -89,67 +264,259 @@ static inline void bt_update_label(unsigned int * const)
 }
 #endif
 
-static ssize_t read_temperature(struct bt_conn *conn,
-			   const struct bt_gatt_attr *attr,
-			   void *buf,
-			   uint16_t len,
-			   uint16_t offset)
+/* Copy a value as a whole, not in the middle of a sample */
+static __hotpath void samples_read(void *dst, const void *src, size_t size)
+{
+	atomic_val_t seq;
+
+	do {
+		seq = seqlock_read_begin(&samples_seq);
+		memcpy(dst, src, size);
+	} while (seqlock_read_retry(&samples_seq, seq));
+}
+
+PERF_POINT_DEFINE(gatt_temperature);
+PERF_POINT_DEFINE(gatt_pressure);
+PERF_POINT_DEFINE(gatt_humidity);
+PERF_POINT_DEFINE(gatt_illuminance);
+PERF_POINT_DEFINE(gatt_metric_celsius);
+PERF_POINT_DEFINE(gatt_elevation);
+PERF_POINT_DEFINE(gatt_metric_pressure);
+PERF_POINT_DEFINE(gatt_absolute_humidity);
+PERF_POINT_DEFINE(gatt_record);
+
+static __hotpath ssize_t read_temperature(struct bt_conn *conn,
+				     const struct bt_gatt_attr *attr,
+				     void *buf,
+				     uint16_t len,
+				     uint16_t offset)
+{
+	struct sensor_value val;
+	int16_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_temperature);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le16(val.val1) * 100 +
+		sys_cpu_to_le16(val.val2) / 10000;
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_temperature);
+
+	return ret;
+}
+
+static __hotpath ssize_t read_pressure(struct bt_conn *conn,
+				       const struct bt_gatt_attr *attr,
+				       void *buf,
+				       uint16_t len,
+				       uint16_t offset)
+{
+	struct sensor_value val;
+	uint32_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_pressure);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le16(val.val1) * 10 +
+		sys_cpu_to_le16(val.val2) / 100000;
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_pressure);
+
+	return ret;
+}
+
+static __hotpath ssize_t read_humidity(struct bt_conn *conn,
+				       const struct bt_gatt_attr *attr,
+				       void *buf,
+				       uint16_t len,
+				       uint16_t offset)
 {
-	const struct sensor_value *val = attr->user_data;
-	int16_t value = sys_cpu_to_le16(val->val1) * 100 + \
-			sys_cpu_to_le16(val->val2) / 10000;
+	struct sensor_value val;
+	uint16_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_humidity);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le16(val.val1) * 100 +
+		sys_cpu_to_le16(val.val2) / 10000;
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-				 sizeof(value));
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_humidity);
+
+	return ret;
 }
 
-static ssize_t read_pressure(struct bt_conn *conn,
-			     const struct bt_gatt_attr *attr,
-			     void *buf,
-			     uint16_t len,
-			     uint16_t offset)
+static __hotpath ssize_t read_illuminance(struct bt_conn *conn,
+				     const struct bt_gatt_attr *attr,
+				     void *buf,
+				     uint16_t len,
+				     uint16_t offset)
 {
-	const struct sensor_value *val = attr->user_data;
-	uint32_t value = sys_cpu_to_le16(val->val1) * 10 + \
-			 sys_cpu_to_le16(val->val2) / 100000;
+	struct sensor_value val;
+	uint32_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_illuminance);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le16(val.val1);
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value)-1); /* 24 bits */
+	PERF_END(gatt_illuminance);
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-				 sizeof(value));
+	return ret;
 }
 
-static ssize_t read_humidity(struct bt_conn *conn,
-			     const struct bt_gatt_attr *attr,
-			     void *buf,
-			     uint16_t len,
-			     uint16_t offset)
+/* sint8, in °C */
+static __hotpath ssize_t read_metric_celsius(struct bt_conn *conn,
+					     const struct bt_gatt_attr *attr,
+					     void *buf,
+					     uint16_t len,
+					     uint16_t offset)
 {
-	const struct sensor_value *val = attr->user_data;
-	uint16_t value = sys_cpu_to_le16(val->val1) * 100 + \
-			 sys_cpu_to_le16(val->val2) / 10000;
+	int32_t val;
+	int8_t value;
+	ssize_t ret;
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-				 sizeof(value));
+	PERF_BEGIN(gatt_metric_celsius);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = val / 1000;
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_metric_celsius);
+
+	return ret;
 }
 
-static ssize_t read_illuminance(struct bt_conn *conn,
-			   const struct bt_gatt_attr *attr,
-			   void *buf,
-			   uint16_t len,
-			   uint16_t offset)
+/* sint24, in cm */
+static __hotpath ssize_t read_elevation(struct bt_conn *conn,
+					const struct bt_gatt_attr *attr,
+					void *buf,
+					uint16_t len,
+					uint16_t offset)
 {
-	const struct sensor_value *val = attr->user_data;
-	uint32_t value = sys_cpu_to_le16(val->val1);
+	int32_t val, value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_elevation);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le32(val / 10);
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
-				 sizeof(value)-1); /* 24 bits */
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value)-1); /* 24 bits */
+	PERF_END(gatt_elevation);
+
+	return ret;
+}
+
+/* uint32, in 0.1 Pa */
+static __hotpath ssize_t read_metric_pressure(struct bt_conn *conn,
+					      const struct bt_gatt_attr *attr,
+					      void *buf,
+					      uint16_t len,
+					      uint16_t offset)
+{
+	int32_t val;
+	uint32_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_metric_pressure);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le32(val * 10);
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_metric_pressure);
+
+	return ret;
+}
+
+/* uint16, in 0.01 g/m³ */
+static __hotpath ssize_t read_absolute_humidity(struct bt_conn *conn,
+						const struct bt_gatt_attr *attr,
+						void *buf,
+						uint16_t len,
+						uint16_t offset)
+{
+	int32_t val;
+	uint16_t value;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_absolute_humidity);
+	samples_read(&val, attr->user_data, sizeof(val));
+	value = sys_cpu_to_le16(val / 10);
+
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset, &value,
+				sizeof(value));
+	PERF_END(gatt_absolute_humidity);
+
+	return ret;
+}
+
+/* The latest sample record, as encoded once for all its consumers */
+static __hotpath ssize_t read_record(struct bt_conn *conn,
+				     const struct bt_gatt_attr *attr,
+				     void *buf,
+				     uint16_t len,
+				     uint16_t offset)
+{
+	struct record *rec;
+	ssize_t ret;
+
+	PERF_BEGIN(gatt_record);
+	rec = record_latest();
+	ret = bt_gatt_attr_read(conn, attr, buf, len, offset,
+				rec ? rec->data : NULL, rec ? rec->len : 0);
+	if (rec)
+		record_unref(rec);
+	PERF_END(gatt_record);
+
+	return ret;
 }
 
 #define CUSTOM_UUID_ILLUMINANCE &ess_illuminance_uuid.uuid
+#define CUSTOM_UUID_ABSOLUTE_HUMIDITY &ess_absolute_humidity_uuid.uuid
+#define CUSTOM_UUID_RECORD &ess_record_uuid.uuid
+#define CUSTOM_UUID_SEA_LEVEL_PRESSURE &ess_sea_level_pressure_uuid.uuid
 
 /* Characteristic UUID 4f371c81-f2e5-414b-9feb-fcda9c55fee1 */
 static struct bt_uuid_128 ess_illuminance_uuid = BT_UUID_INIT_128(
                 BT_UUID_128_ENCODE(0x4f371c81, 0xf2e5, 0x414b, 0x9feb, 0xfcda9c55fee1));
 
+/* Characteristic UUID 4f371c82-f2e5-414b-9feb-fcda9c55fee1 */
+static struct bt_uuid_128 ess_absolute_humidity_uuid = BT_UUID_INIT_128(
+                BT_UUID_128_ENCODE(0x4f371c82, 0xf2e5, 0x414b, 0x9feb, 0xfcda9c55fee1));
+
+/* Characteristic UUID 4f371c83-f2e5-414b-9feb-fcda9c55fee1 */
+static struct bt_uuid_128 ess_record_uuid = BT_UUID_INIT_128(
+                BT_UUID_128_ENCODE(0x4f371c83, 0xf2e5, 0x414b, 0x9feb, 0xfcda9c55fee1));
+
+/* Characteristic UUID 4f371c84-f2e5-414b-9feb-fcda9c55fee1 */
+static struct bt_uuid_128 ess_sea_level_pressure_uuid = BT_UUID_INIT_128(
+                BT_UUID_128_ENCODE(0x4f371c84, 0xf2e5, 0x414b, 0x9feb, 0xfcda9c55fee1));
+
+struct bt_gatt_cpf absolute_humidity_cpf = {
+	.format = 0x06, /* uint16 */
+	.exponent = -5,
+	.unit = 0x2715, /* density (kilogram per cubic metre) */
+	.name_space = 0,
+	.description = 0,
+};
+
+struct bt_gatt_cpf sea_level_pressure_cpf = {
+	.format = 0x08, /* uint32 */
+	.exponent = -1,
+	.unit = 0x2724, /* pressure (pascal) */
+	.name_space = 0,
+	.description = 0,
+};
+
 struct bt_gatt_cpf illuminance_cpf = {
 	.format = 0,
 	.exponent = 1,
@@ -161,33 +528,122 @@ struct bt_gatt_cpf illuminance_cpf = {
 BT_GATT_SERVICE_DEFINE(ess_svc,
 	BT_GATT_PRIMARY_SERVICE(BT_UUID_ESS),
 	BT_GATT_CHARACTERISTIC(BT_UUID_TEMPERATURE,
-			       BT_GATT_CHRC_READ,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
 			       BT_GATT_PERM_READ,
 			       read_temperature,
 			       NULL,
 			       &bme280_temp),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 	BT_GATT_CHARACTERISTIC(BT_UUID_PRESSURE,
-			       BT_GATT_CHRC_READ,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
 			       BT_GATT_PERM_READ,
 			       read_pressure,
 			       NULL,
 			       &bme280_press),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 	BT_GATT_CHARACTERISTIC(BT_UUID_HUMIDITY,
-			       BT_GATT_CHRC_READ,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
 			       BT_GATT_PERM_READ,
 			       read_humidity,
 			       NULL,
 			       &htu21d_humidity),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 	BT_GATT_CHARACTERISTIC(CUSTOM_UUID_ILLUMINANCE,
-			       BT_GATT_CHRC_READ,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
 			       BT_GATT_PERM_READ,
 			       read_illuminance,
 			       NULL,
 			       &bh1750_light),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 	BT_GATT_CUD("Illuminance", BT_GATT_PERM_READ),
 	BT_GATT_CPF(&illuminance_cpf),
+	BT_GATT_CHARACTERISTIC(BT_UUID_DEW_POINT,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_metric_celsius,
+			       NULL,
+			       &metrics.dew_point),
+	BT_GATT_CHARACTERISTIC(BT_UUID_HEAT_INDEX,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_metric_celsius,
+			       NULL,
+			       &metrics.heat_index),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ELEVATION,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_elevation,
+			       NULL,
+			       &metrics.altitude),
+	BT_GATT_CHARACTERISTIC(CUSTOM_UUID_SEA_LEVEL_PRESSURE,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_metric_pressure,
+			       NULL,
+			       &metrics.sea_level_pressure),
+	BT_GATT_CUD("Sea-level pressure", BT_GATT_PERM_READ),
+	BT_GATT_CPF(&sea_level_pressure_cpf),
+	BT_GATT_CHARACTERISTIC(CUSTOM_UUID_ABSOLUTE_HUMIDITY,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+			       read_absolute_humidity,
+			       NULL,
+			       &metrics.absolute_humidity),
+	BT_GATT_CUD("Absolute humidity", BT_GATT_PERM_READ),
+	BT_GATT_CPF(&absolute_humidity_cpf),
+	BT_GATT_CHARACTERISTIC(CUSTOM_UUID_RECORD,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_READ,
+			       read_record,
+			       NULL,
+			       NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CUD("Sample record", BT_GATT_PERM_READ),
 );
 
+/* Notify the channel characteristic, with the value it reads */
+static void channel_notify(int channel)
+{
+	static const struct bt_uuid *uuids[] = {
+		[CHANNEL_TEMPERATURE] = BT_UUID_TEMPERATURE,
+		[CHANNEL_PRESSURE] = BT_UUID_PRESSURE,
+		[CHANNEL_LIGHT] = CUSTOM_UUID_ILLUMINANCE,
+		[CHANNEL_HUMIDITY] = BT_UUID_HUMIDITY,
+	};
+	struct bt_gatt_attr *attr;
+	uint8_t buf[sizeof(uint32_t)];
+	ssize_t len;
+
+	if (!ble_connections)
+		return;
+
+	attr = bt_gatt_find_by_uuid(ess_svc.attrs, ess_svc.attr_count,
+				    uuids[channel]);
+	if (attr == NULL)
+		return;
+
+	len = attr->read(NULL, attr, buf, sizeof(buf), 0);
+	if (len < 0)
+		return;
+
+	bt_gatt_notify(NULL, attr, buf, len);
+}
+
+static void record_notify(const struct record *rec)
+{
+	struct bt_gatt_attr *attr;
+
+	if (!ble_connections)
+		return;
+
+	attr = bt_gatt_find_by_uuid(ess_svc.attrs, ess_svc.attr_count,
+				    CUSTOM_UUID_RECORD);
+	if (attr == NULL)
+		return;
+
+	bt_gatt_notify(NULL, attr, rec->data, rec->len);
+}
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA_BYTES(BT_DATA_GAP_APPEARANCE, 0x00, 0x03),
@@ -243,10 +699,35 @@ static void bt_ready(int err)
 	if (err)
 		return;
 
+	boot_mark("advertising");
+
 	err = bt_conn_auth_cb_register(&auth_cb_display);
 	if (err)
 		return;
 }
+#else
+static inline void channel_notify(int channel)
+{
+}
+
+static inline void record_notify(const struct record *rec)
+{
+}
+#endif
+
+#if defined(CONFIG_APP_RECORD_LOG)
+static void record_log(const struct record *rec)
+{
+	int err;
+
+	err = fcb_staging_append(rec->data, rec->len);
+	if (err && err != -ENOMEM)
+		printk("Warning: record: Failed to log: %i\n", err);
+}
+#else
+static inline void record_log(const struct record *rec)
+{
+}
 #endif
 
 static const struct device *get_bme280_device(void)
@@ -255,6 +736,10 @@ static const struct device *get_bme280_device(void)
 
 #if defined(CONFIG_BME280)
 	dev = DEVICE_DT_GET_ANY(bosch_bme280);
+#endif
+#if defined(CONFIG_REPLAY_SENSOR)
+	if (dev == NULL)
+		dev = DEVICE_DT_GET_ANY(replay_bme280);
 #endif
 	if (dev == NULL)
 		return NULL;
@@ -269,8 +754,12 @@ static const struct device *get_bh1750_device(void)
 {
 	const struct device *dev = NULL;
 
-#if defined(CONFIG_BH1750)
+#if defined(CONFIG_BH1750) || defined(CONFIG_ROHM_BH1750)
 	dev = DEVICE_DT_GET_ANY(rohm_bh1750);
+#endif
+#if defined(CONFIG_REPLAY_SENSOR)
+	if (dev == NULL)
+		dev = DEVICE_DT_GET_ANY(replay_bh1750);
 #endif
 	if (dev == NULL)
 		return NULL;
@@ -287,6 +776,10 @@ static const struct device *get_htu21d_device(void)
 
 #if defined(CONFIG_HTU21D)
 	dev = DEVICE_DT_GET_ANY(meas_htu21d);
+#endif
+#if defined(CONFIG_REPLAY_SENSOR)
+	if (dev == NULL)
+		dev = DEVICE_DT_GET_ANY(replay_htu21d);
 #endif
 	if (dev == NULL)
 		return NULL;
@@ -329,19 +822,590 @@ static const struct device *get_display_device(void)
 	return dev;
 }
 
+#if defined(CONFIG_PWM)
 static const struct pwm_dt_spec pwm_led = PWM_DT_SPEC_GET(DT_ALIAS(pwm_led0));
+#endif
+
+static int32_t sensor_value_milli(const struct sensor_value *val)
+{
+	return val->val1 * 1000 + val->val2 / 1000;
+}
+
+/* Replace the reading with its filtered value */
+static void sensor_value_filter(struct sensor_value *val, int channel)
+{
+	int32_t value = filter_update(&filters[channel],
+				      sensor_value_milli(val));
+
+	val->val1 = value / 1000;
+	val->val2 = (value % 1000) * 1000;
+}
+
+/*
+ * Encode the acquisition once; the record is notified and logged if the
+ * values changed significantly. The temperature statistics take every sample.
+ */
+static void sample_record(const struct record_sample *sample, int changes)
+{
+	uint32_t start = k_cycle_get_32();
+	struct record *rec;
+
+	record_stats_add(sample);
+	rec = record_publish(sample);
+	if (rec == NULL)
+		return;
+
+	if (changes) {
+		record_notify(rec);
+		record_log(rec);
+	}
+
+	record_unref(rec);
+	stage_end(&stages[STAGE_RECORD], start);
+}
+
+PERF_POINT_DEFINE(fetch_bme280);
+
+static int bme280_sample(struct sched_sensor *sensor, int32_t *value)
+{
+	const struct device *dev = sensor->user_data;
+	uint32_t start = k_cycle_get_32();
+	struct record_sample sample = {
+		.timestamp = record_time(),
+		.channels = BIT(CHANNEL_TEMPERATURE) | BIT(CHANNEL_PRESSURE),
+	};
+	struct sensor_value temp, press;
+	int err, changes;
+
+	PERF_BEGIN(fetch_bme280);
+	err = sensor_sample_fetch(dev);
+	PERF_END(fetch_bme280);
+	if (err)
+		return err;
+	start = stage_end(&stages[STAGE_FETCH], start);
+
+	sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &temp);
+	sensor_channel_get(dev, SENSOR_CHAN_PRESS, &press);
+	sensor_value_filter(&temp, CHANNEL_TEMPERATURE);
+	sensor_value_filter(&press, CHANNEL_PRESSURE);
+	*value = sensor_value_milli(&temp);
+	start = stage_end(&stages[STAGE_FILTER], start);
+
+	/* Thousandths of kPa are Pa */
+	seqlock_write_begin(&samples_seq);
+	bme280_temp = temp;
+	bme280_press = press;
+	metrics_bme280_update(&metrics, *value, sensor_value_milli(&press));
+	seqlock_write_end(&samples_seq);
+	start = stage_end(&stages[STAGE_METRICS], start);
+
+	sample.values[CHANNEL_TEMPERATURE] = *value;
+	sample.values[CHANNEL_PRESSURE] = sensor_value_milli(&press);
+	changes = events_sample(&events, CHANNEL_TEMPERATURE, *value,
+				k_uptime_get());
+	changes += events_sample(&events, CHANNEL_PRESSURE,
+				 sample.values[CHANNEL_PRESSURE],
+				 k_uptime_get());
+	stage_end(&stages[STAGE_EVENTS], start);
+
+	sample_record(&sample, changes);
+
+	return 0;
+}
+
+PERF_POINT_DEFINE(fetch_bh1750);
+
+static int bh1750_sample(struct sched_sensor *sensor, int32_t *value)
+{
+	const struct device *dev = sensor->user_data;
+	uint32_t start = k_cycle_get_32();
+	struct record_sample sample = {
+		.timestamp = record_time(),
+		.channels = BIT(CHANNEL_LIGHT),
+	};
+	struct sensor_value light;
+	int err, changes;
+
+	PERF_BEGIN(fetch_bh1750);
+	err = sensor_sample_fetch(dev);
+	PERF_END(fetch_bh1750);
+	if (err)
+		return err;
+	start = stage_end(&stages[STAGE_FETCH], start);
+
+	sensor_channel_get(dev, SENSOR_CHAN_LIGHT, &light);
+	sensor_value_filter(&light, CHANNEL_LIGHT);
+	*value = sensor_value_milli(&light);
+
+	seqlock_write_begin(&samples_seq);
+	bh1750_light = light;
+	seqlock_write_end(&samples_seq);
+	start = stage_end(&stages[STAGE_FILTER], start);
+
+	sample.values[CHANNEL_LIGHT] = *value;
+	changes = events_sample(&events, CHANNEL_LIGHT, *value, k_uptime_get());
+	stage_end(&stages[STAGE_EVENTS], start);
+
+	sample_record(&sample, changes);
+
+	return 0;
+}
+
+PERF_POINT_DEFINE(fetch_htu21d);
+
+static int htu21d_sample(struct sched_sensor *sensor, int32_t *value)
+{
+	const struct device *dev = sensor->user_data;
+	uint32_t start = k_cycle_get_32();
+	struct record_sample sample = {
+		.timestamp = record_time(),
+		.channels = BIT(CHANNEL_HUMIDITY),
+	};
+	struct sensor_value humidity, temp;
+	int err, changes;
+
+	PERF_BEGIN(fetch_htu21d);
+	err = sensor_sample_fetch(dev);
+	PERF_END(fetch_htu21d);
+	if (err)
+		return err;
+	start = stage_end(&stages[STAGE_FETCH], start);
+
+	sensor_channel_get(dev, SENSOR_CHAN_HUMIDITY, &humidity);
+	sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &temp);
+	sensor_value_filter(&humidity, CHANNEL_HUMIDITY);
+	*value = sensor_value_milli(&humidity);
+	start = stage_end(&stages[STAGE_FILTER], start);
+
+	seqlock_write_begin(&samples_seq);
+	htu21d_humidity = humidity;
+	htu21d_temp = temp;
+	metrics_htu21d_update(&metrics, *value, sensor_value_milli(&temp));
+	seqlock_write_end(&samples_seq);
+	start = stage_end(&stages[STAGE_METRICS], start);
+
+	sample.values[CHANNEL_HUMIDITY] = *value;
+	changes = events_sample(&events, CHANNEL_HUMIDITY, *value,
+				k_uptime_get());
+	stage_end(&stages[STAGE_EVENTS], start);
+
+	sample_record(&sample, changes);
+
+	return 0;
+}
+
+/*
+ * Tolerances: 0.1°C, 10lx and 1%RH. The light drives the backlight, so it is
+ * sampled up to 10Hz; the pressure hardly needs more than 0.1Hz.
+ */
+static struct sched_sensor sensors[] = {
+	{
+		.name = "bme280",
+		.sample = bme280_sample,
+		.tolerance = 100,
+		.min_period_ms = 10000,
+		.max_period_ms = 60000,
+	},
+	{
+		.name = "bh1750",
+		.sample = bh1750_sample,
+		.tolerance = 10000,
+		.min_period_ms = 100,
+		.max_period_ms = 1000,
+	},
+	{
+		.name = "htu21d",
+		.sample = htu21d_sample,
+		.tolerance = 1000,
+		.min_period_ms = 1000,
+		.max_period_ms = 60000,
+	},
+};
+
+/*
+ * Worst-case costs, in us: a forced measurement, a one-time high resolution
+ * measurement (or the read of the continuous one), and the humidity and
+ * temperature measurements.
+ */
+static const uint32_t sensor_wcet_us[] = {
+	15000,
+#if defined(CONFIG_ROHM_BH1750)
+	1000,
+#else
+	180000,
+#endif
+	70000,
+};
+
+static struct task sensor_tasks[ARRAY_SIZE(sensors)];
+static struct tasks tasks;
+
+/* Report the time from boot to the first sample, once */
+static void boot_sample_mark(const struct sched_sensor *sensor)
+{
+	static bool sampled;
+
+	if (sampled || (sensor->samples == 0))
+		return;
+
+	sampled = true;
+	boot_mark("first sample");
+}
+
+static uint32_t sensor_task(struct task *task)
+{
+	uint32_t period = sched_sample(task->user_data);
+
+	boot_sample_mark(task->user_data);
+
+	return period;
+}
+
+/*
+ * The sensors with a data ready trigger, such as the replay ones, are sampled
+ * as soon as they are ready, rather than by a periodic task.
+ */
+static K_SEM_DEFINE(sensors_sem, 0, 1);
+static atomic_t sensors_ready;
+static uint32_t sensors_ready_cycles[ARRAY_SIZE(sensors)];
+static size_t sensors_count;
+
+static void sensor_ready(const struct device *dev,
+			 const struct sensor_trigger *trig)
+{
+	size_t i;
+
+	for (i = 0; i < sensors_count; i++) {
+		if (sensors[i].user_data != dev)
+			continue;
+
+		sensors_ready_cycles[i] = k_cycle_get_32();
+		atomic_set_bit(&sensors_ready, i);
+		k_sem_give(&sensors_sem);
+	}
+}
+
+static void sensors_run_ready(void)
+{
+	size_t i;
+
+	for (i = 0; i < sensors_count; i++) {
+		if (!atomic_test_and_clear_bit(&sensors_ready, i))
+			continue;
+
+		sched_sample(&sensors[i]);
+		stage_end(&stages[STAGE_LATENCY], sensors_ready_cycles[i]);
+		boot_sample_mark(&sensors[i]);
+	}
+}
+
+PERF_POINT_DEFINE(counter_get_value);
+
+static uint32_t rtc_task(struct task *task)
+{
+	const struct device *dev = task->user_data;
+	static uint32_t shown = UINT32_MAX;
+	uint32_t now;
+	int err;
+
+	PERF_BEGIN(counter_get_value);
+	err = counter_get_value(dev, &now);
+	PERF_END(counter_get_value);
+	if (err) {
+		printk("Warning: counter: Failed to get value: %i\n", err);
+		return 0;
+	}
+
+	record_time_set(now);
+
+	/* The label shows the minutes, or the raw seconds */
+	if (now / TIME_LABEL_RESOLUTION == shown)
+		return 0;
+
+	shown = now / TIME_LABEL_RESOLUTION;
+	time_update_label(now);
+
+	return 0;
+}
+
+#if defined(CONFIG_PWM)
+PERF_POINT_DEFINE(pwm_set_pulse_dt);
+
+static void backlight_update(int32_t light)
+{
+	uint32_t pulse;
+	int err;
+
+	pulse = (light / 1000) * 5;
+	if (pulse < 333)
+		pulse = 333;
+	else if (pulse > pwm_led.period)
+		pulse = pwm_led.period;
+	PERF_BEGIN(pwm_set_pulse_dt);
+	err = pwm_set_pulse_dt(&pwm_led, pulse);
+	PERF_END(pwm_set_pulse_dt);
+	if (err)
+		printk("Warning: pwm_led: Failed to set pulse width: %i\n",
+		       err);
+}
+#else
+static inline void backlight_update(int32_t light)
+{
+}
+#endif
+
+/* The consumers work on significant changes only */
+static void channel_changed(struct event_cond *cond, int32_t value)
+{
+	if (cond->channel == CHANNEL_LIGHT)
+		backlight_update(value);
+
+	channel_update_label(cond->channel);
+	channel_notify(cond->channel);
+}
+
+static void humidity_high(struct event_cond *cond, int32_t value)
+{
+	printk("Warning: Humidity above %d%%\n", cond->threshold / 1000);
+}
+
+static void pressure_drop(struct event_cond *cond, int32_t value)
+{
+	printk("Warning: Pressure dropping faster than %dhPa/h\n",
+	       -cond->threshold / 100);
+}
+
+/*
+ * Changes shown: 0.1°C, 0.1hPa, 10% of light and 1%RH; and warnings for a
+ * damp room and for a pressure drop heralding a storm.
+ */
+static struct event_cond conds[] = {
+	{
+		.name = "temperature",
+		.channel = CHANNEL_TEMPERATURE,
+		.kind = EVENT_DELTA,
+		.threshold = 100,
+		.cb = channel_changed,
+	},
+	{
+		.name = "pressure",
+		.channel = CHANNEL_PRESSURE,
+		.kind = EVENT_DELTA,
+		.threshold = 10,
+		.cb = channel_changed,
+	},
+	{
+		.name = "light",
+		.channel = CHANNEL_LIGHT,
+		.kind = EVENT_CHANGE,
+		.threshold = 10000,
+		.cb = channel_changed,
+	},
+	{
+		.name = "humidity",
+		.channel = CHANNEL_HUMIDITY,
+		.kind = EVENT_DELTA,
+		.threshold = 1000,
+		.cb = channel_changed,
+	},
+	{
+		.name = "damp",
+		.channel = CHANNEL_HUMIDITY,
+		.kind = EVENT_ABOVE,
+		.threshold = 70000,
+		.hysteresis = 2000,
+		.cb = humidity_high,
+	},
+	{
+		.name = "storm",
+		.channel = CHANNEL_PRESSURE,
+		.kind = EVENT_RATE,
+		.threshold = -200,
+		.period_ms = 15 * 60 * 1000,
+		.cb = pressure_drop,
+	},
+};
+
+#if defined(CONFIG_LVGL)
+PERF_POINT_DEFINE(lv_task_handler);
+
+static uint32_t ui_task(struct task *task)
+{
+	const struct device *display_dev = task->user_data;
+	uint32_t start;
+
+#if defined(CONFIG_BT)
+	bt_apply_label();
+#endif
+
+	/* Render the labels changed since the last run, if any */
+	if (!ui_dirty)
+		return 0;
+
+	ui_dirty = false;
+	start = k_cycle_get_32();
+	PERF_BEGIN(lv_task_handler);
+	lv_task_handler();
+	PERF_END(lv_task_handler);
+	stage_end(&stages[STAGE_UI], start);
+
+	/* The display is unblanked once the first frame is rendered */
+	if (display_dev) {
+		display_blanking_off(display_dev);
+		task->user_data = NULL;
+		boot_mark("first frame");
+	}
+
+	return 0;
+}
+#endif
+
+static struct task rtc_task_data = {
+	.name = "rtc",
+	.fn = rtc_task,
+	.period_ms = 1000,
+	.wcet_us = 2000,
+};
+
+#if defined(CONFIG_APP_MONITOR)
+static struct monitor monitor;
+
+static uint32_t monitor_task(struct task *task)
+{
+	monitor_sample(&monitor);
+	monitor_log(&monitor);
+
+	return 0;
+}
+
+static struct task monitor_task_data = {
+	.name = "monitor",
+	.fn = monitor_task,
+	.period_ms = CONFIG_APP_MONITOR_PERIOD_S * MSEC_PER_SEC,
+	.wcet_us = 10000,
+};
+#endif
+
+#if defined(CONFIG_LVGL)
+static struct task ui_task_data = {
+	.name = "ui",
+	.fn = ui_task,
+	.period_ms = 1000,
+	.wcet_us = 50000,
+};
+#endif
+
+static void add_task(struct task *task, int64_t now)
+{
+	int err;
+
+	err = tasks_add(&tasks, task, now);
+	if (err)
+		printk("Warning: %s: Failed to add task: %i\n", task->name,
+		       err);
+}
+
+/* Keep the sensors found, and add a task for each and for the others */
+static void tasks_setup(const struct device *bme280_dev,
+			const struct device *bh1750_dev,
+			const struct device *htu21d_dev,
+			const struct device *counter_dev,
+			const struct device *display_dev)
+{
+	const struct device *devs[] = { bme280_dev, bh1750_dev, htu21d_dev };
+	static const struct sensor_trigger trig = {
+		.type = SENSOR_TRIG_DATA_READY,
+		.chan = SENSOR_CHAN_ALL,
+	};
+	int64_t now = k_uptime_get();
+	size_t i, count = 0;
+
+	for (i = 0; i < ARRAY_SIZE(sensors); i++) {
+		if (devs[i] == NULL)
+			continue;
+
+		sensors[count] = sensors[i];
+		sensors[count].user_data = (void *)devs[i];
+		sensor_tasks[count].name = sensors[i].name;
+		sensor_tasks[count].fn = sensor_task;
+		sensor_tasks[count].user_data = &sensors[count];
+		sensor_tasks[count].period_ms = sensors[i].min_period_ms;
+		sensor_tasks[count].wcet_us = sensor_wcet_us[i];
+		count++;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(filters); i++)
+		filter_init(&filters[i]);
+	filter_register(filters, ARRAY_SIZE(filters));
+
+	for (i = 0; i < ARRAY_SIZE(conds); i++) {
+		int err = events_add(&events, &conds[i]);
+
+		if (err)
+			printk("Warning: %s: Failed to add event: %i\n",
+			       conds[i].name, err);
+	}
+	events_register(&events);
+
+	stages_register(stages, ARRAY_SIZE(stages));
+
+	sched_init(sensors, count, now);
+	sched_register(sensors, count);
+	sensors_count = count;
+
+	tasks.since_ms = now;
+	for (i = 0; i < count; i++) {
+		if (sensor_trigger_set(sensors[i].user_data, &trig,
+				       sensor_ready) == 0)
+			continue;
+
+		add_task(&sensor_tasks[i], now);
+	}
+
+	if (counter_dev) {
+		uint32_t time;
+
+		/* Timestamp the first records in the RTC time already */
+		if (counter_get_value(counter_dev, &time) == 0)
+			record_time_set(time);
+
+		rtc_task_data.user_data = (void *)counter_dev;
+		add_task(&rtc_task_data, now);
+	}
+
+#if defined(CONFIG_LVGL)
+	/* The first frame shows the first samples, rather than placeholders */
+	ui_task_data.user_data = (void *)display_dev;
+	add_task(&ui_task_data, now + ui_task_data.period_ms);
+#endif
+
+#if defined(CONFIG_APP_MONITOR)
+	monitor_init(&monitor);
+	monitor_register(&monitor);
+	if (CONFIG_APP_MONITOR_PERIOD_S)
+		add_task(&monitor_task_data, now + monitor_task_data.period_ms);
+#endif
+
+	tasks_register(&tasks);
+}
 
 void main(void)
 {
 	const struct device *bme280_dev, *bh1750_dev, *htu21d_dev;
 	const struct device *counter_dev;
 	const struct device *display_dev;
-#if defined(CONFIG_LVGL)
-	lv_obj_t *temp_label, *press_label, *humidity_label;
-#endif
-	uint32_t now = 0;
-#if defined(CONFIG_BT) || defined(CONFIG_PWM)
+#if defined(CONFIG_BT)
 	int err;
+
+	/*
+	 * Bring the Bluetooth up first, as it completes on the system
+	 * workqueue while the sensors finish their resets and the display
+	 * starts; the sensor drivers do not wait for their resets at init.
+	 */
+	err = bt_enable(bt_ready);
+	if (err)
+		printk("Warning: Bluetooth disabled\n");
+	boot_mark("Bluetooth enabled");
 #endif
 
 	bme280_dev = get_bme280_device();
@@ -387,78 +1451,51 @@ void main(void)
 	lv_label_set_text(humidity_label, "0%");
 	lv_obj_align(humidity_label, LV_ALIGN_BOTTOM_RIGHT, 0, 0);
 
-	lv_task_handler();
-	display_blanking_off(display_dev);
-#endif
+	dew_point_label = lv_label_create(lv_scr_act());
+	lv_label_set_text(dew_point_label, "");
+	lv_obj_align(dew_point_label, LV_ALIGN_LEFT_MID, 0, 0);
 
-#if defined(CONFIG_BT)
-	err = bt_enable(bt_ready);
-	if (err)
-		printk("Warning: Bluetooth disabled\n");
-#endif
+	heat_index_label = lv_label_create(lv_scr_act());
+	lv_label_set_text(heat_index_label, "");
+	lv_obj_align(heat_index_label, LV_ALIGN_RIGHT_MID, 0, 0);
 
-	while (1) {
-		uint32_t pulse;
-
-		if (bme280_dev) {
-			sensor_sample_fetch(bme280_dev);
-			sensor_channel_get(bme280_dev,
-					   SENSOR_CHAN_AMBIENT_TEMP,
-					   &bme280_temp);
-			sensor_channel_get(bme280_dev, SENSOR_CHAN_PRESS,
-					   &bme280_press);
-		}
-
-		if (bh1750_dev) {
-			sensor_sample_fetch(bh1750_dev);
-			sensor_channel_get(bh1750_dev, SENSOR_CHAN_LIGHT,
-					   &bh1750_light);
-		}
-
-		if (htu21d_dev) {
-			sensor_sample_fetch(htu21d_dev);
-			sensor_channel_get(htu21d_dev, SENSOR_CHAN_HUMIDITY,
-					   &htu21d_humidity);
-			sensor_channel_get(htu21d_dev,
-					   SENSOR_CHAN_AMBIENT_TEMP,
-					   &htu21d_temp);
-		}
-
-		if (counter_dev) {
-			err = counter_get_value(counter_dev, &now);
-			if (err)
-				printk("Warning: counter: Failed to get value: %i\n",
-				       err);
-		}
+	altitude_label = lv_label_create(lv_scr_act());
+	lv_label_set_text(altitude_label, "");
+	lv_obj_align(altitude_label, LV_ALIGN_TOP_MID, 0, 0);
 
-#if defined(CONFIG_PWM)
-		pulse = bh1750_light.val1 * 5;
-		if (pulse < 333)
-			pulse = 333;
-		else if (pulse > pwm_led.period)
-			pulse = pwm_led.period;
-		err = pwm_set_pulse_dt(&pwm_led, pulse);
-		if (err)
-			printk("Warning: pwm_led: Failed to set pulse width: %i\n",
-			       err);
+	/* The UI task renders the labels at its first run */
+	ui_dirty = true;
 #endif
 
-#if defined(CONFIG_LVGL)
-		lv_label_set_text_fmt(temp_label, "%d.%d°C", bme280_temp.val1,
-				      bme280_temp.val2 / 100000);
-
-		lv_label_set_text_fmt(press_label, "%d.%dPa",
-				      bme280_press.val1,
-				      bme280_press.val2 / 100000);
+	metrics_register(&metrics);
+	tasks_setup(bme280_dev, bh1750_dev, htu21d_dev, counter_dev,
+		    display_dev);
+	boot_mark("tasks set up");
 
-		lv_label_set_text_fmt(humidity_label, "%d%%",
-				      htu21d_humidity.val1);
+	/* The uplink is not needed before the first samples are recorded */
+#if defined(CONFIG_APP_UPLINK)
+	if (uplink_setup())
+		printk("Warning: Uplink disabled\n");
+#endif
 
-		lv_task_handler();
+#if defined(CONFIG_APP_AFFINITY)
+	/* The Bluetooth and the uplink threads are created by now */
+	affinity_setup();
 #endif
 
-		time_update_label(now);
+	/*
+	 * Run the tasks due and the sensors ready, and sleep until the next
+	 * deadline or sensor ready; the kernel is tickless, and may enter a
+	 * low power state meanwhile.
+	 */
+	while (1) {
+		int64_t deadline;
+
+		tasks_run(&tasks, k_uptime_get());
+		sensors_run_ready();
 
-		k_sleep(K_MSEC(1000));
+		deadline = tasks_deadline(&tasks);
+		k_sem_take(&sensors_sem, deadline == INT64_MAX ? K_FOREVER :
+			   K_TIMEOUT_ABS_MS(deadline));
 	}
 }
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+
+#include "metrics.h"
+
+/* The logarithms and the powers of 2 are in Q8.24 */
+#define Q24_ONE (1 << 24)
+
+#define LN2_Q30 744261118LL
+#define LOG2E_Q30 1549082005LL
+#define LN_100000_Q24 193154837
+
+/* Magnus coefficients over water, valid from -45°C to 60°C */
+#define MAGNUS_B 17620		/* thousandths */
+#define MAGNUS_C 243120		/* m°C */
+#define MAGNUS_B_Q24 295614546
+#define MAGNUS_E0 611200	/* mPa */
+
+/* Ratio of the gas constant of water vapour, in hundred thousandths */
+#define WATER_VAPOUR_RATIO 216680
+#define ZERO_CELSIUS 273150	/* mK */
+
+/* International barometric formula */
+#define BARO_HEIGHT 44330000	/* mm */
+#define BARO_EXP_Q24 88164270	/* 5.255 */
+#define BARO_INV_EXP_Q24 3192620 /* 1/5.255 */
+
+static const struct metrics *registered;
+
+/* 2^(2^-k) for k = 1 to 24, in Q2.30 */
+static const uint32_t exp2_frac[24] = {
+	1518500250, 1276901417, 1170923762, 1121280436, 1097253708,
+	1085434106, 1079572136, 1076653033, 1075196443, 1074468888,
+	1074105294, 1073923544, 1073832680, 1073787251, 1073764537,
+	1073753181, 1073747502, 1073744663, 1073743244, 1073742534,
+	1073742179, 1073742001, 1073741913, 1073741868,
+};
+
+/* log2(x), for x > 0 */
+static int32_t log2_q24(uint32_t x)
+{
+	int msb = 31 - __builtin_clz(x);
+	int32_t result = msb * Q24_ONE;
+	uint64_t m;
+	int i;
+
+	/* Normalize to [1, 2) in Q2.30, and square to get the bits */
+	if (msb > 30) {
+		m = x >> (msb - 30);
+	} else {
+		m = (uint64_t)x << (30 - msb);
+	}
+
+	for (i = 23; i >= 0; i--) {
+		m = (m * m) >> 30;
+		if (m >= (2ULL << 30)) {
+			m >>= 1;
+			result += 1 << i;
+		}
+	}
+
+	return result;
+}
+
+/* 2^y in Q30, for y < 32 */
+static uint64_t exp2_q30(int32_t y)
+{
+	int32_t i = y >> 24;
+	uint32_t f = y & (Q24_ONE - 1);
+	uint64_t result = 1ULL << 30;
+	int k;
+
+	for (k = 0; k < 24; k++) {
+		if (f & (BIT(23) >> k)) {
+			result = (result * exp2_frac[k]) >> 30;
+		}
+	}
+
+	if (i < -30) {
+		return 0;
+	} else if (i < 0) {
+		return result >> -i;
+	}
+
+	return result << i;
+}
+
+static int32_t ln_q24(uint32_t x)
+{
+	return ((int64_t)log2_q24(x) * LN2_Q30) >> 30;
+}
+
+static uint64_t exp_q30(int32_t y)
+{
+	return exp2_q30(((int64_t)y * LOG2E_Q30) >> 30);
+}
+
+static uint32_t isqrt64(uint64_t x)
+{
+	uint64_t result = 0, bit = 1ULL << 62;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+
+	while (bit) {
+		if (x >= result + bit) {
+			x -= result + bit;
+			result = (result >> 1) + bit;
+		} else {
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return result;
+}
+
+/* b.T / (c + T), the exponent of the saturation vapour pressure */
+static int32_t magnus_q24(int32_t temperature)
+{
+	return ((int64_t)MAGNUS_B * temperature * Q24_ONE) /
+	       ((int64_t)(MAGNUS_C + temperature) * 1000);
+}
+
+int32_t metrics_dew_point(int32_t temperature, int32_t humidity)
+{
+	int32_t gamma;
+
+	humidity = CLAMP(humidity, 1, 100000);
+	gamma = ln_q24(humidity) - LN_100000_Q24 + magnus_q24(temperature);
+
+	return ((int64_t)MAGNUS_C * gamma) / (MAGNUS_B_Q24 - gamma);
+}
+
+int32_t metrics_absolute_humidity(int32_t temperature, int32_t humidity)
+{
+	uint64_t pressure;
+
+	/* The vapour pressure, in mPa */
+	humidity = CLAMP(humidity, 0, 100000);
+	pressure = (MAGNUS_E0 * exp_q30(magnus_q24(temperature))) >> 30;
+	pressure = (pressure * humidity) / 100000;
+
+	return (pressure * WATER_VAPOUR_RATIO) /
+	       ((uint64_t)(temperature + ZERO_CELSIUS) * 100);
+}
+
+/* Coefficients of the Rothfusz regression, in hundred millionths */
+static const int32_t rothfusz[] = {
+	204901523,	/* T */
+	1014333127,	/* RH */
+	-22475541,	/* T.RH */
+	-683783,	/* T² */
+	-5481717,	/* RH² */
+	122874,		/* T².RH */
+	85282,		/* T.RH² */
+	-199,		/* T².RH² */
+};
+
+int32_t metrics_heat_index(int32_t temperature, int32_t humidity)
+{
+	int64_t t, r, terms[ARRAY_SIZE(rothfusz)], sum = 0;
+	int32_t f, hi;
+	size_t i;
+
+	humidity = CLAMP(humidity, 0, 100000);
+
+	/* In m°F, the simple formula is enough under 80°F */
+	f = (temperature * 9) / 5 + 32000;
+	hi = (f + 61000 + ((f - 68000) * 12) / 10 + (humidity * 94) / 1000) / 2;
+	if ((hi + f) / 2 < 80000) {
+		return ((hi - 32000) * 5) / 9;
+	}
+
+	/* In hundredths, so that T².RH² fits */
+	t = f / 10;
+	r = humidity / 10;
+	terms[0] = t;
+	terms[1] = r;
+	terms[2] = (t * r) / 100;
+	terms[3] = (t * t) / 100;
+	terms[4] = (r * r) / 100;
+	terms[5] = (terms[3] * r) / 100;
+	terms[6] = (t * terms[4]) / 100;
+	terms[7] = (terms[3] * terms[4]) / 100;
+	for (i = 0; i < ARRAY_SIZE(rothfusz); i++) {
+		sum += rothfusz[i] * terms[i];
+	}
+	hi = -42379 + sum / 10000000;
+
+	if ((humidity < 13000) && (f >= 80000) && (f <= 112000)) {
+		uint64_t ratio = ((uint64_t)(17000 - abs(f - 95000)) << 32) /
+				 17000;
+
+		hi -= (((13000 - humidity) / 4) * (int64_t)isqrt64(ratio)) >>
+		      16;
+	} else if ((humidity > 85000) && (f >= 80000) && (f <= 87000)) {
+		hi += ((int64_t)(humidity - 85000) * (87000 - f)) / 50000;
+	}
+
+	return ((hi - 32000) * 5) / 9;
+}
+
+int32_t metrics_altitude(int32_t pressure, int32_t sea_level_pressure)
+{
+	int32_t y;
+	int64_t q;
+
+	if ((pressure <= 0) || (sea_level_pressure <= 0)) {
+		return 0;
+	}
+
+	y = log2_q24(pressure) - log2_q24(sea_level_pressure);
+	q = exp2_q30(((int64_t)y * BARO_INV_EXP_Q24) >> 24);
+
+	return (BARO_HEIGHT * ((1LL << 30) - q)) / (1LL << 30);
+}
+
+int32_t metrics_sea_level_pressure(int32_t pressure, int32_t altitude)
+{
+	int32_t y;
+
+	if ((pressure <= 0) || (altitude * 1000LL >= BARO_HEIGHT)) {
+		return pressure;
+	}
+
+	y = log2_q24(BARO_HEIGHT) - log2_q24(BARO_HEIGHT - altitude * 1000);
+
+	return ((uint64_t)pressure *
+		exp2_q30(((int64_t)y * BARO_EXP_Q24) >> 24)) >> 30;
+}
+
+static void humidity_update(struct metrics *metrics)
+{
+	int32_t temperature = metrics->humidity_temperature;
+	int32_t humidity;
+
+	if (metrics->sources & METRICS_BME280) {
+		temperature = metrics->temperature;
+	}
+
+	/* Temperature coefficient of -0.15%RH/°C from 25°C */
+	humidity = metrics->humidity - ((25000 - temperature) * 15) / 100;
+	humidity = CLAMP(humidity, 0, 100000);
+
+	metrics->compensated_humidity = humidity;
+	metrics->dew_point = metrics_dew_point(temperature, humidity);
+	metrics->absolute_humidity = metrics_absolute_humidity(temperature,
+							       humidity);
+	metrics->heat_index = metrics_heat_index(temperature, humidity);
+}
+
+void metrics_bme280_update(struct metrics *metrics, int32_t temperature,
+			   int32_t pressure)
+{
+	metrics->sources |= METRICS_BME280;
+	metrics->temperature = temperature;
+	metrics->pressure = pressure;
+	metrics->updates++;
+
+	metrics->altitude = metrics_altitude(pressure,
+					     CONFIG_APP_METRICS_SEA_LEVEL_PA);
+	metrics->sea_level_pressure = metrics_sea_level_pressure(pressure,
+						CONFIG_APP_METRICS_ALTITUDE_M);
+
+	/* The humidity is compensated with that temperature */
+	if (metrics->sources & METRICS_HTU21D) {
+		humidity_update(metrics);
+	}
+}
+
+void metrics_htu21d_update(struct metrics *metrics, int32_t humidity,
+			   int32_t temperature)
+{
+	metrics->sources |= METRICS_HTU21D;
+	metrics->humidity = humidity;
+	metrics->humidity_temperature = temperature;
+	metrics->updates++;
+
+	humidity_update(metrics);
+}
+
+void metrics_register(const struct metrics *metrics)
+{
+	registered = metrics;
+}
+
+#if defined(CONFIG_SHELL)
+static void print_milli(const struct shell *shell, const char *name,
+			int32_t value, const char *unit)
+{
+	shell_print(shell, "%-22s %s%d.%03d%s", name, value < 0 ? "-" : "",
+		    abs(value / 1000), abs(value % 1000), unit);
+}
+
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	const struct metrics *m = registered;
+
+	if (m == NULL) {
+		shell_error(shell, "No metrics");
+		return -ENODEV;
+	}
+
+	shell_print(shell, "Updates:               %u", m->updates);
+	if (m->sources & METRICS_BME280) {
+		print_milli(shell, "Temperature:", m->temperature, "°C");
+		shell_print(shell, "Pressure:              %dPa", m->pressure);
+		print_milli(shell, "Altitude:", m->altitude, "m");
+		shell_print(shell, "Sea-level pressure:    %dPa",
+			    m->sea_level_pressure);
+	}
+
+	if (m->sources & METRICS_HTU21D) {
+		print_milli(shell, "Humidity:", m->humidity, "%RH");
+		print_milli(shell, "Compensated humidity:",
+			    m->compensated_humidity, "%RH");
+		print_milli(shell, "Dew point:", m->dew_point, "°C");
+		print_milli(shell, "Absolute humidity:", m->absolute_humidity,
+			    "g/m³");
+		print_milli(shell, "Heat index:", m->heat_index, "°C");
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(metrics_cmds,
+	SHELL_CMD_ARG(show,  NULL, NULL, cmd_show,  1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_metrics(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(metrics, &metrics_cmds, "Derived metrics commands",
+		       cmd_metrics, 2, 0);
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_METRICS_H_
+#define APP_METRICS_H_
+
+#include <zephyr/kernel.h>
+
+#define METRICS_BME280 BIT(0)
+#define METRICS_HTU21D BIT(1)
+
+/*
+ * Environmental metrics derived from the sensor readings, in integer
+ * arithmetic; they are updated once per sample, so that the consumers only
+ * read them.
+ */
+struct metrics {
+	/* Inputs, set by the updates below */
+	uint8_t sources;
+	int32_t temperature;		/* BME280, in m°C */
+	int32_t pressure;		/* BME280, in Pa */
+	int32_t humidity;		/* HTU21D, in m%RH */
+	int32_t humidity_temperature;	/* HTU21D, in m°C */
+
+	/* Outputs, valid once the sources are set */
+	int32_t compensated_humidity;	/* m%RH, needs HTU21D */
+	int32_t dew_point;		/* m°C, needs HTU21D */
+	int32_t absolute_humidity;	/* mg/m³, needs HTU21D */
+	int32_t heat_index;		/* m°C, needs HTU21D */
+	int32_t altitude;		/* mm, needs BME280 */
+	int32_t sea_level_pressure;	/* Pa, needs BME280 */
+
+	/* Statistics */
+	uint32_t updates;
+};
+
+/*
+ * Update the metrics depending on the BME280 temperature, in m°C, and
+ * pressure, in Pa.
+ */
+void metrics_bme280_update(struct metrics *metrics, int32_t temperature,
+			   int32_t pressure);
+
+/*
+ * Update the metrics depending on the HTU21D humidity, in m%RH, and
+ * temperature, in m°C. The humidity is compensated with the BME280
+ * temperature if any, as the HTU21D datasheet suggests.
+ */
+void metrics_htu21d_update(struct metrics *metrics, int32_t humidity,
+			   int32_t temperature);
+
+/*
+ * Dew point, in m°C, of the air at temperature, in m°C, and humidity, in
+ * m%RH; Magnus formula.
+ */
+int32_t metrics_dew_point(int32_t temperature, int32_t humidity);
+
+/*
+ * Absolute humidity, in mg/m³, of the air at temperature, in m°C, and
+ * humidity, in m%RH.
+ */
+int32_t metrics_absolute_humidity(int32_t temperature, int32_t humidity);
+
+/*
+ * Heat index, in m°C, of the air at temperature, in m°C, and humidity, in
+ * m%RH; NWS Rothfusz regression.
+ */
+int32_t metrics_heat_index(int32_t temperature, int32_t humidity);
+
+/*
+ * Altitude, in mm, at pressure, in Pa, given the sea-level pressure, in Pa;
+ * international barometric formula.
+ */
+int32_t metrics_altitude(int32_t pressure, int32_t sea_level_pressure);
+
+/*
+ * Sea-level pressure, in Pa, given the pressure, in Pa, at altitude, in m.
+ */
+int32_t metrics_sea_level_pressure(int32_t pressure, int32_t altitude);
+
+/*
+ * Register the metrics shown by the metrics shell command.
+ */
+void metrics_register(const struct metrics *metrics);
+
+#endif /* APP_METRICS_H_ */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "monitor.h"
+
+#if defined(CONFIG_APP_MONITOR)
+static struct monitor *registered;
+
+struct monitor_walk {
+	struct monitor *monitor;
+	uint64_t window_cycles;
+};
+
+static struct monitor_thread *monitor_thread_get(struct monitor *monitor,
+						 const struct k_thread *thread)
+{
+	struct monitor_thread *mt;
+	size_t i;
+
+	for (i = 0; i < monitor->count; i++) {
+		if (monitor->threads[i].thread == thread) {
+			return &monitor->threads[i];
+		}
+	}
+
+	if (monitor->count == ARRAY_SIZE(monitor->threads)) {
+		return NULL;
+	}
+
+	/* A new thread is accounted from its first sample on */
+	mt = &monitor->threads[monitor->count++];
+	mt->thread = thread;
+	mt->cycles = 0;
+	mt->seeded = false;
+
+	return mt;
+}
+
+static void monitor_thread_sample(const struct k_thread *thread,
+				  void *user_data)
+{
+	struct monitor_walk *walk = user_data;
+	k_thread_runtime_stats_t stats;
+	struct monitor_thread *mt;
+	size_t unused;
+
+	mt = monitor_thread_get(walk->monitor, thread);
+	if (mt == NULL) {
+		return;
+	}
+
+	mt->seen = true;
+	mt->name = k_thread_name_get((k_tid_t)thread);
+	if ((mt->name == NULL) || (*mt->name == '\0')) {
+		mt->name = "unnamed";
+	}
+
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &stats) == 0) {
+		mt->load = 0;
+		if (mt->seeded && walk->window_cycles) {
+			mt->load = MIN(((stats.execution_cycles - mt->cycles) *
+					1000) / walk->window_cycles, 1000);
+		}
+		mt->cycles = stats.execution_cycles;
+		mt->seeded = true;
+	}
+
+	mt->stack_size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &unused) == 0) {
+		mt->stack_used = mt->stack_size - unused;
+	}
+}
+
+void monitor_init(struct monitor *monitor)
+{
+	k_mutex_init(&monitor->lock);
+	monitor->count = 0;
+	monitor->windows = 0;
+	monitor->window_ms = 0;
+	monitor->since_ticks = k_uptime_ticks();
+}
+
+void monitor_sample(struct monitor *monitor)
+{
+	int64_t now = k_uptime_ticks();
+	struct monitor_walk walk = {
+		.monitor = monitor,
+		.window_cycles = k_ticks_to_cyc_floor64(now -
+							monitor->since_ticks),
+	};
+	size_t i, count = 0;
+
+	k_mutex_lock(&monitor->lock, K_FOREVER);
+	for (i = 0; i < monitor->count; i++) {
+		monitor->threads[i].seen = false;
+	}
+
+	/* The walk queries the threads; not under the scheduler lock */
+	k_thread_foreach_unlocked(monitor_thread_sample, &walk);
+
+	/* Forget the threads gone since the last window */
+	for (i = 0; i < monitor->count; i++) {
+		if (monitor->threads[i].seen) {
+			monitor->threads[count++] = monitor->threads[i];
+		}
+	}
+	monitor->count = count;
+
+	monitor->window_ms = k_ticks_to_ms_floor64(now - monitor->since_ticks);
+	monitor->since_ticks = now;
+	monitor->windows++;
+	k_mutex_unlock(&monitor->lock);
+}
+
+/*
+ * The stacks short of headroom, or mostly unused, are flagged; their sizes
+ * are worth revisiting.
+ */
+static const char *monitor_stack_flag(const struct monitor_thread *mt)
+{
+	if (mt->stack_size == 0) {
+		return "";
+	}
+
+	if ((mt->stack_size - mt->stack_used) * 100 <
+	    mt->stack_size * CONFIG_APP_MONITOR_STACK_HEADROOM_PERCENT) {
+		return "undersized";
+	}
+
+	if (mt->stack_used * 100 <
+	    mt->stack_size * CONFIG_APP_MONITOR_STACK_USAGE_PERCENT) {
+		return "oversized";
+	}
+
+	return "";
+}
+
+void monitor_log(struct monitor *monitor)
+{
+	size_t i;
+
+	k_mutex_lock(&monitor->lock, K_FOREVER);
+	printk("Monitor: %zu threads over %ums\n", monitor->count,
+	       monitor->window_ms);
+	for (i = 0; i < monitor->count; i++) {
+		const struct monitor_thread *mt = &monitor->threads[i];
+
+		printk("Monitor: %-16s %3u.%u%% cpu %5zu/%5zu stack %s\n",
+		       mt->name, mt->load / 10, mt->load % 10, mt->stack_used,
+		       mt->stack_size, monitor_stack_flag(mt));
+	}
+	k_mutex_unlock(&monitor->lock);
+}
+
+void monitor_register(struct monitor *monitor)
+{
+	registered = monitor;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	size_t i;
+
+	if (registered == NULL) {
+		shell_error(shell, "No monitor");
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&registered->lock, K_FOREVER);
+	shell_print(shell, "%-16s %6s %6s %6s %4s", "Thread", "CPU", "Used",
+		    "Size", "Max");
+	for (i = 0; i < registered->count; i++) {
+		const struct monitor_thread *mt = &registered->threads[i];
+
+		shell_print(shell, "%-16s %3u.%u%% %6zu %6zu %3zu%% %s",
+			    mt->name, mt->load / 10, mt->load % 10,
+			    mt->stack_used, mt->stack_size,
+			    mt->stack_size ?
+			    (mt->stack_used * 100) / mt->stack_size : 0,
+			    monitor_stack_flag(mt));
+	}
+
+	shell_print(shell, "Window:            %ums", registered->window_ms);
+	shell_print(shell, "Windows:           %u", registered->windows);
+	k_mutex_unlock(&registered->lock);
+
+	return 0;
+}
+
+static int cmd_sample(const struct shell *shell, size_t argc, char *argv[])
+{
+	if (registered == NULL) {
+		shell_error(shell, "No monitor");
+		return -ENODEV;
+	}
+
+	monitor_sample(registered);
+
+	return cmd_show(shell, argc, argv);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(monitor_cmds,
+	SHELL_CMD_ARG(show,   NULL, NULL, cmd_show,   1, 0),
+	SHELL_CMD_ARG(sample, NULL, NULL, cmd_sample, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_monitor(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(monitor, &monitor_cmds, "Thread monitor commands",
+		       cmd_monitor, 2, 0);
+#endif
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_MONITOR_H_
+#define APP_MONITOR_H_
+
+#include <zephyr/kernel.h>
+
+/* The monitor options only exist if it is enabled */
+#if defined(CONFIG_APP_MONITOR)
+#define MONITOR_THREADS_MAX CONFIG_APP_MONITOR_THREADS_MAX
+#else
+#define MONITOR_THREADS_MAX 1
+#endif
+
+struct monitor_thread {
+	const struct k_thread *thread;
+	const char *name;
+
+	/* State */
+	uint64_t cycles;
+	bool seeded;
+	bool seen;
+
+	/* Statistics over the last window */
+	uint32_t load;
+	size_t stack_size;
+	size_t stack_used;
+};
+
+/*
+ * CPU utilisation and stack high-water marks of every thread, sampled over
+ * windows; the load is in thousandths of the window.
+ */
+struct monitor {
+	struct k_mutex lock;
+	struct monitor_thread threads[MONITOR_THREADS_MAX];
+	size_t count;
+	int64_t since_ticks;
+	uint32_t window_ms;
+	uint32_t windows;
+};
+
+/*
+ * Reset the monitor, and open the first window.
+ */
+void monitor_init(struct monitor *monitor);
+
+/*
+ * Close the window, and open the next one.
+ */
+void monitor_sample(struct monitor *monitor);
+
+/*
+ * Log a summary of the last window.
+ */
+void monitor_log(struct monitor *monitor);
+
+/*
+ * Register the monitor reported by the monitor shell command.
+ */
+void monitor_register(struct monitor *monitor);
+
+#endif /* APP_MONITOR_H_ */
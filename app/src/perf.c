@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#if defined(CONFIG_APP_PERF_TRACING)
+#include <zephyr/tracing/tracing.h>
+#endif
+
+#include <string.h>
+
+#include "perf.h"
+
+#if defined(CONFIG_APP_PERF)
+static sys_slist_t points = SYS_SLIST_STATIC_INIT(&points);
+static struct k_spinlock lock;
+
+static size_t perf_bucket(uint32_t cycles)
+{
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+
+	if (us == 0) {
+		return 0;
+	}
+
+	return MIN(32 - __builtin_clz(us), PERF_BUCKETS - 1);
+}
+
+void perf_point_record(struct perf_point *point, uint32_t start)
+{
+	uint32_t cycles = k_cycle_get_32() - start;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	if (!point->listed) {
+		point->listed = true;
+		sys_slist_append(&points, &point->node);
+	}
+
+	point->count++;
+	point->cycles += cycles;
+	point->min_cycles = MIN(point->min_cycles, cycles);
+	point->max_cycles = MAX(point->max_cycles, cycles);
+	point->buckets[perf_bucket(cycles)]++;
+	k_spin_unlock(&lock, key);
+
+#if defined(CONFIG_APP_PERF_TRACING)
+	/* The host analysis gets every pass, and not the histograms only */
+	sys_trace_named_event(point->name, start, cycles);
+#endif
+}
+
+#if defined(CONFIG_SHELL)
+static struct perf_point *perf_point_find(const char *name)
+{
+	struct perf_point *point;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&points, point, node) {
+		if (strcmp(point->name, name) == 0) {
+			return point;
+		}
+	}
+
+	return NULL;
+}
+
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct perf_point *point;
+
+	shell_print(shell, "%-20s %8s %8s %8s %8s", "Point", "Count", "Min",
+		    "Avg", "Max");
+	SYS_SLIST_FOR_EACH_CONTAINER(&points, point, node) {
+		if (point->count == 0) {
+			shell_print(shell, "%-20s %8u", point->name, 0);
+			continue;
+		}
+
+		shell_print(shell, "%-20s %8u %6uus %6lluus %6uus",
+			    point->name, point->count,
+			    k_cyc_to_us_floor32(point->min_cycles),
+			    k_cyc_to_us_floor64(point->cycles) / point->count,
+			    k_cyc_to_us_ceil32(point->max_cycles));
+	}
+
+	return 0;
+}
+
+static int cmd_hist(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct perf_point *point = perf_point_find(argv[1]);
+	uint32_t max = 0;
+	size_t i, j;
+
+	if (point == NULL) {
+		shell_error(shell, "%s: No such point", argv[1]);
+		return -ENOENT;
+	}
+
+	for (i = 0; i < PERF_BUCKETS; i++) {
+		max = MAX(max, point->buckets[i]);
+	}
+
+	for (i = 0; i < PERF_BUCKETS; i++) {
+		char bar[41];
+		size_t len = max ? (point->buckets[i] * 40ULL) / max : 0;
+
+		for (j = 0; j < len; j++) {
+			bar[j] = '#';
+		}
+		bar[len] = '\0';
+
+		if (i == PERF_BUCKETS - 1) {
+			shell_print(shell, "   >= %6uus %8u %s", 1U << (i - 1),
+				    point->buckets[i], bar);
+		} else {
+			shell_print(shell, "    < %6uus %8u %s", 1U << i,
+				    point->buckets[i], bar);
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_reset(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct perf_point *point;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	SYS_SLIST_FOR_EACH_CONTAINER(&points, point, node) {
+		point->count = 0;
+		point->cycles = 0;
+		point->min_cycles = UINT32_MAX;
+		point->max_cycles = 0;
+		memset(point->buckets, 0, sizeof(point->buckets));
+	}
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(perf_cmds,
+	SHELL_CMD_ARG(show,  NULL, NULL,      cmd_show,  1, 0),
+	SHELL_CMD_ARG(hist,  NULL, "<point>", cmd_hist,  2, 0),
+	SHELL_CMD_ARG(reset, NULL, NULL,      cmd_reset, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_perf(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(perf, &perf_cmds, "Instrumentation point commands",
+		       cmd_perf, 2, 0);
+#endif
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_PERF_H_
+#define APP_PERF_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+/*
+ * Bucket i counts the durations below 2^i us, and above the previous bucket;
+ * the last one counts all the longer durations.
+ */
+#define PERF_BUCKETS 16
+
+/*
+ * Instrumentation point, timed in cycles on every pass; it is listed by the
+ * perf shell command once hit.
+ */
+struct perf_point {
+	sys_snode_t node;
+
+	/* Configuration */
+	const char *name;
+
+	/* Statistics */
+	bool listed;
+	uint32_t count;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint64_t cycles;
+	uint32_t buckets[PERF_BUCKETS];
+};
+
+#if defined(CONFIG_APP_PERF)
+/*
+ * Define the instrumentation point name, in the file scope.
+ */
+#define PERF_POINT_DEFINE(_name)					\
+	static struct perf_point perf_point_##_name = {			\
+		.name = #_name,						\
+		.min_cycles = UINT32_MAX,				\
+	}
+
+/*
+ * Start timing the point name, in the current block.
+ */
+#define PERF_BEGIN(_name)						\
+	uint32_t perf_begin_##_name = k_cycle_get_32()
+
+/*
+ * Stop timing the point name, and account the pass.
+ */
+#define PERF_END(_name)							\
+	perf_point_record(&perf_point_##_name, perf_begin_##_name)
+#else
+#define PERF_POINT_DEFINE(_name)					\
+	extern struct perf_point perf_point_##_name
+#define PERF_BEGIN(_name) (void)0
+#define PERF_END(_name) (void)0
+#endif
+
+/*
+ * Account a pass through the point since start, in cycles.
+ */
+void perf_point_record(struct perf_point *point, uint32_t start);
+
+#endif /* APP_PERF_H_ */
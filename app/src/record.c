@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#if defined(CONFIG_APP_RECORD_STATS)
+#include <zephyr/fs/fcb_staging.h>
+#include <zephyr/fs/fcb_stats.h>
+#endif
+
+#include <stdlib.h>
+
+#include "record.h"
+
+static struct record records[CONFIG_APP_RECORD_BUFS];
+static struct record *latest;
+static struct k_spinlock lock;
+static uint32_t published;
+static uint32_t exhausted;
+/* RTC time at boot, in seconds since the epoch */
+static atomic_t boot_time;
+
+#if defined(CONFIG_APP_RECORD_STATS)
+#define STATS_RUN_LEN CONFIG_FCB_STATS_RUN_MAX
+#define STATS_HOURS_MAX 48
+#define STATS_HOUR_S (SEC_PER_MIN * MIN_PER_HOUR)
+
+/*
+ * The temperatures fill a run while the other one is logged, from the system
+ * work queue rather than from the sampling; the runs are swapped by the work,
+ * once the one logged is empty.
+ */
+struct stats_run {
+	uint32_t timestamps[STATS_RUN_LEN];
+	int32_t values[STATS_RUN_LEN];
+	size_t count;
+};
+
+static struct stats_run stats_runs[2];
+static struct stats_run *stats_filling = &stats_runs[0];
+static struct fcb_stats stats;
+static bool stats_ready;
+static uint32_t stats_logged;
+static uint32_t stats_dropped;
+
+static void stats_log(struct k_work *work)
+{
+	struct stats_run *run;
+	k_spinlock_key_t key;
+	struct fcb *fcb;
+	int err;
+
+	key = k_spin_lock(&lock);
+	run = stats_filling;
+	stats_filling = (run == &stats_runs[0]) ? &stats_runs[1] :
+						  &stats_runs[0];
+	k_spin_unlock(&lock, key);
+
+	if (!stats_ready) {
+		fcb = fcb_staging_fcb();
+		err = fcb ? fcb_stats_init(&stats, fcb) : -ENODEV;
+		if (err) {
+			printk("Warning: record: Failed to init stats: %i\n",
+			       err);
+			goto out;
+		}
+
+		stats_ready = true;
+	}
+
+	err = fcb_stats_append_run(&stats, run->timestamps, run->values,
+				   run->count);
+	if (err) {
+		printk("Warning: record: Failed to log stats: %i\n", err);
+		goto out;
+	}
+
+	stats_logged += run->count;
+
+out:
+	if (err) {
+		stats_dropped += run->count;
+	}
+
+	run->count = 0;
+}
+
+static K_WORK_DEFINE(stats_work, stats_log);
+
+void record_stats_add(const struct record_sample *sample)
+{
+	struct stats_run *run;
+	k_spinlock_key_t key;
+	bool full;
+
+	if (!(sample->channels & BIT(RECORD_TEMPERATURE))) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	run = stats_filling;
+	if (run->count == STATS_RUN_LEN) {
+		/* Both runs are full, the log is lagging */
+		stats_dropped++;
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	run->timestamps[run->count] = sample->timestamp;
+	run->values[run->count] = sample->values[RECORD_TEMPERATURE];
+	run->count++;
+	full = run->count == STATS_RUN_LEN;
+	k_spin_unlock(&lock, key);
+
+	if (full) {
+		k_work_submit(&stats_work);
+	}
+}
+#endif
+
+int record_encode(const struct record_sample *sample, uint8_t *buf,
+		  size_t size)
+{
+	size_t len = RECORD_LEN(__builtin_popcount(sample->channels)), off;
+	int i;
+
+	if (sample->channels & ~RECORD_CHANNELS_MASK) {
+		return -EINVAL;
+	}
+
+	if (size < len) {
+		return -ENOSPC;
+	}
+
+	buf[0] = RECORD_VERSION;
+	buf[1] = sample->channels;
+	sys_put_le32(sample->timestamp, &buf[2]);
+
+	off = RECORD_HEADER_LEN;
+	for (i = 0; i < RECORD_CHANNELS; i++) {
+		if (!(sample->channels & BIT(i))) {
+			continue;
+		}
+
+		sys_put_le32(sample->values[i], &buf[off]);
+		off += sizeof(int32_t);
+	}
+
+	return len;
+}
+
+int record_decode(const uint8_t *buf, size_t len,
+		  struct record_sample *sample)
+{
+	size_t off;
+	int i;
+
+	if (len < RECORD_HEADER_LEN) {
+		return -EBADMSG;
+	}
+
+	if (buf[0] != RECORD_VERSION) {
+		return -ENOTSUP;
+	}
+
+	if ((buf[1] & ~RECORD_CHANNELS_MASK) ||
+	    (len != RECORD_LEN(__builtin_popcount(buf[1])))) {
+		return -EBADMSG;
+	}
+
+	sample->channels = buf[1];
+	sample->timestamp = sys_get_le32(&buf[2]);
+
+	off = RECORD_HEADER_LEN;
+	for (i = 0; i < RECORD_CHANNELS; i++) {
+		sample->values[i] = 0;
+		if (!(sample->channels & BIT(i))) {
+			continue;
+		}
+
+		sample->values[i] = sys_get_le32(&buf[off]);
+		off += sizeof(int32_t);
+	}
+
+	return 0;
+}
+
+struct record *record_publish(const struct record_sample *sample)
+{
+	struct record *rec = NULL, *prev;
+	k_spinlock_key_t key;
+	size_t i;
+	int len;
+
+	key = k_spin_lock(&lock);
+	for (i = 0; i < ARRAY_SIZE(records); i++) {
+		if (atomic_get(&records[i].refs) == 0) {
+			rec = &records[i];
+			atomic_set(&rec->refs, 1);
+			break;
+		}
+	}
+
+	if (rec == NULL) {
+		exhausted++;
+		k_spin_unlock(&lock, key);
+		return NULL;
+	}
+	k_spin_unlock(&lock, key);
+
+	len = record_encode(sample, rec->data, sizeof(rec->data));
+	if (len < 0) {
+		record_unref(rec);
+		return NULL;
+	}
+	rec->len = len;
+
+	/* The latest record holds a reference, and the caller another */
+	atomic_inc(&rec->refs);
+	key = k_spin_lock(&lock);
+	prev = latest;
+	latest = rec;
+	rec->seq = ++published;
+	k_spin_unlock(&lock, key);
+
+	if (prev) {
+		record_unref(prev);
+	}
+
+	return rec;
+}
+
+struct record *record_latest(void)
+{
+	struct record *rec;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	rec = latest;
+	if (rec) {
+		atomic_inc(&rec->refs);
+	}
+	k_spin_unlock(&lock, key);
+
+	return rec;
+}
+
+void record_ref(struct record *rec)
+{
+	atomic_inc(&rec->refs);
+}
+
+void record_unref(struct record *rec)
+{
+	atomic_dec(&rec->refs);
+}
+
+void record_time_set(uint32_t now)
+{
+	uint32_t boot = now - (uint32_t)(k_uptime_get() / MSEC_PER_SEC);
+	int32_t drift = boot - (uint32_t)atomic_get(&boot_time);
+
+	/* The RTC and the uptime tick apart, do not step back and forth */
+	if (abs(drift) > 1) {
+		atomic_set(&boot_time, boot);
+	}
+}
+
+uint32_t record_time(void)
+{
+	return (uint32_t)atomic_get(&boot_time) +
+	       (uint32_t)(k_uptime_get() / MSEC_PER_SEC);
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	static const char * const channel_str[] = {
+		[RECORD_TEMPERATURE] = "temperature",
+		[RECORD_PRESSURE] = "pressure",
+		[RECORD_LIGHT] = "light",
+		[RECORD_HUMIDITY] = "humidity",
+	};
+	struct record_sample sample;
+	struct record *rec;
+	size_t i, used = 0;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(records); i++) {
+		if (atomic_get(&records[i].refs)) {
+			used++;
+		}
+	}
+
+	shell_print(shell, "Published:         %u", published);
+	shell_print(shell, "Exhausted:         %u", exhausted);
+	shell_print(shell, "Buffers:           %zu/%zu", used,
+		    ARRAY_SIZE(records));
+
+	rec = record_latest();
+	if (rec == NULL) {
+		return 0;
+	}
+
+	err = record_decode(rec->data, rec->len, &sample);
+	if (err) {
+		shell_error(shell, "Failed to decode record: %i", err);
+		record_unref(rec);
+		return err;
+	}
+
+	shell_print(shell, "Record:            #%u, %u bytes at %us", rec->seq,
+		    rec->len, sample.timestamp);
+	for (i = 0; i < RECORD_CHANNELS; i++) {
+		if (sample.channels & BIT(i)) {
+			shell_print(shell, "%-18s %d", channel_str[i],
+				    sample.values[i]);
+		}
+	}
+	shell_hexdump(shell, rec->data, rec->len);
+	record_unref(rec);
+
+	return 0;
+}
+
+#if defined(CONFIG_APP_RECORD_STATS)
+/* The temperatures by hour, up to the current one, from the flash log */
+static int cmd_stats(const struct shell *shell, size_t argc, char *argv[])
+{
+	static struct fcb_stats_bucket buckets[STATS_HOURS_MAX];
+	uint32_t hours = 24, from, to;
+	struct fcb *fcb;
+	int i, ret;
+
+	if (argc > 1) {
+		hours = strtoul(argv[1], NULL, 0);
+		if ((hours == 0) || (hours > ARRAY_SIZE(buckets))) {
+			shell_error(shell, "Invalid hours: %s", argv[1]);
+			return -EINVAL;
+		}
+	}
+
+	fcb = fcb_staging_fcb();
+	if (fcb == NULL) {
+		shell_error(shell, "No log");
+		return -ENODEV;
+	}
+
+	to = ROUND_UP(record_time() + 1, STATS_HOUR_S);
+	hours = MIN(hours, to / STATS_HOUR_S);
+	from = to - hours * STATS_HOUR_S;
+	ret = fcb_stats_query(fcb, from, to, STATS_HOUR_S, buckets, hours);
+	if (ret < 0) {
+		shell_error(shell, "Failed to query stats: %i", ret);
+		return ret;
+	}
+
+	shell_print(shell, "Logged:            %u", stats_logged);
+	shell_print(shell, "Dropped:           %u", stats_dropped);
+	shell_print(shell, "Sectors indexed:   %d", ret);
+	/* The hours of the day, UTC, or since boot without the RTC */
+	shell_print(shell, "%6s %8s %9s %9s %9s", "Hour", "Count", "Min",
+		    "Max", "Mean");
+	for (i = 0; i < hours; i++) {
+		uint32_t hour = ((from / STATS_HOUR_S) + i) % HOUR_PER_DAY;
+
+		if (buckets[i].count == 0) {
+			shell_print(shell, "%6u %8u", hour, 0);
+			continue;
+		}
+
+		shell_print(shell, "%6u %8u %9d %9d %9lld", hour,
+			    buckets[i].count, buckets[i].min, buckets[i].max,
+			    buckets[i].sum / buckets[i].count);
+	}
+
+	return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(record_cmds,
+	SHELL_CMD_ARG(show, NULL, NULL, cmd_show, 1, 0),
+#if defined(CONFIG_APP_RECORD_STATS)
+	SHELL_CMD_ARG(stats, NULL, "[hours]", cmd_stats, 1, 1),
+#endif
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_record(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(record, &record_cmds, "Sample record commands",
+		       cmd_record, 2, 0);
+#endif
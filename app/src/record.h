@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_RECORD_H_
+#define APP_RECORD_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Sample record, version 2, little-endian:
+ *
+ *	version		u8
+ *	channels	u8, bitmap of the values that follow
+ *	timestamp	u32, in seconds since the epoch
+ *	values		s32 per channel set, in ascending channel order
+ *
+ * The values are fixed-point, in thousandths of their unit: m°C, Pa, mlx and
+ * m%RH.
+ *
+ * The timestamp is in the RTC time, so that the records of every boot sort
+ * together; until the RTC is read, or without one, it is in seconds since
+ * boot, far before any RTC time. Version 1 timestamps were in milliseconds
+ * since boot.
+ */
+#define RECORD_VERSION 2
+
+enum {
+	RECORD_TEMPERATURE,
+	RECORD_PRESSURE,
+	RECORD_LIGHT,
+	RECORD_HUMIDITY,
+	RECORD_CHANNELS,
+};
+
+#define RECORD_CHANNELS_MASK (BIT(RECORD_CHANNELS) - 1)
+#define RECORD_HEADER_LEN 6
+#define RECORD_LEN(count) (RECORD_HEADER_LEN + (count) * sizeof(int32_t))
+#define RECORD_MAX_LEN RECORD_LEN(RECORD_CHANNELS)
+
+struct record_sample {
+	uint32_t timestamp;
+	uint8_t channels;
+	/* Indexed by channel, valid for the channels set */
+	int32_t values[RECORD_CHANNELS];
+};
+
+/*
+ * Encoded record, shared by its consumers: it is immutable once published,
+ * and reused once the last reference is dropped.
+ */
+struct record {
+	atomic_t refs;
+	uint32_t seq;
+	uint8_t len;
+	uint8_t data[RECORD_MAX_LEN];
+};
+
+/*
+ * Encode the sample; returns the record length, -EINVAL if a channel is
+ * unknown, or -ENOSPC if it does not fit.
+ */
+int record_encode(const struct record_sample *sample, uint8_t *buf,
+		  size_t size);
+
+/*
+ * Decode the record; returns 0, -ENOTSUP if the version is unknown, or
+ * -EBADMSG if the record is malformed.
+ */
+int record_decode(const uint8_t *buf, size_t len,
+		  struct record_sample *sample);
+
+/*
+ * Encode the sample into a free record, which replaces the latest one;
+ * returns the record with a reference for the caller, or NULL if every
+ * record is still referenced.
+ */
+struct record *record_publish(const struct record_sample *sample);
+
+/*
+ * Returns the latest record with a reference, or NULL if none.
+ */
+struct record *record_latest(void);
+
+void record_ref(struct record *rec);
+
+void record_unref(struct record *rec);
+
+/*
+ * Set the RTC time, in seconds since the epoch, which the record time follows
+ * from then on.
+ */
+void record_time_set(uint32_t now);
+
+/*
+ * Returns the record time: the RTC time, or the seconds since boot until it
+ * is set.
+ */
+uint32_t record_time(void);
+
+#if defined(CONFIG_APP_RECORD_STATS)
+/*
+ * Queue the temperature of the sample, if any, to the statistics log; the
+ * queue is logged as a run once full.
+ */
+void record_stats_add(const struct record_sample *sample);
+#else
+static inline void record_stats_add(const struct record_sample *sample)
+{
+}
+#endif
+
+#endif /* APP_RECORD_H_ */
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+
+#include "sched.h"
+
+static struct sched_sensor *registered;
+static size_t registered_count;
+
+void sched_init(struct sched_sensor *sensors, size_t count, int64_t now)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		struct sched_sensor *s = &sensors[i];
+
+		if (s->min_period_ms == 0) {
+			s->min_period_ms = CONFIG_APP_SCHED_MIN_PERIOD_MS;
+		}
+		if (s->max_period_ms == 0) {
+			s->max_period_ms = CONFIG_APP_SCHED_MAX_PERIOD_MS;
+		}
+
+		s->period_ms = s->min_period_ms;
+		s->deadline_ms = now;
+		s->last = 0;
+		s->deviation = 0;
+		s->primed = false;
+		s->samples = 0;
+		s->errors = 0;
+		s->within = 0;
+		s->max_step = 0;
+	}
+}
+
+/*
+ * Shrink the period as soon as a step exceeds the tolerance, at least by half
+ * and as much as the step exceeds it, and stretch it by a quarter while the
+ * mean absolute step (a cheap variance estimate) stays well within; the step
+ * between two samples is thus bounded by the tolerance, as long as the signal
+ * does not change faster than the minimum period allows.
+ */
+static void sched_adapt(struct sched_sensor *s, int32_t value)
+{
+	int32_t step;
+
+	if (!s->primed) {
+		s->primed = true;
+		s->last = value;
+		return;
+	}
+
+	step = abs(value - s->last);
+	s->last = value;
+	s->max_step = MAX(s->max_step, step);
+	if (step <= s->tolerance) {
+		s->within++;
+	}
+
+	s->deviation += (step - s->deviation) / 4;
+
+	if (step > s->tolerance) {
+		uint32_t period = ((uint64_t)s->period_ms * s->tolerance) / step;
+
+		s->period_ms = MAX(MIN(period, s->period_ms / 2),
+				   s->min_period_ms);
+	} else if (s->deviation < s->tolerance / 4) {
+		s->period_ms = MIN(s->period_ms + s->period_ms / 4,
+				   s->max_period_ms);
+	}
+}
+
+uint32_t sched_sample(struct sched_sensor *s)
+{
+	int32_t value;
+
+	if (s->sample(s, &value)) {
+		s->errors++;
+	} else {
+		s->samples++;
+		sched_adapt(s, value);
+	}
+
+	return s->period_ms;
+}
+
+int sched_run(struct sched_sensor *sensors, size_t count, int64_t now,
+	      struct sched_stats *stats)
+{
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < count; i++) {
+		struct sched_sensor *s = &sensors[i];
+
+		if (s->deadline_ms > now + CONFIG_APP_TASKS_SLACK_MS) {
+			continue;
+		}
+
+		sched_sample(s);
+
+		/* Do not catch up on missed deadlines */
+		s->deadline_ms = now + s->period_ms;
+		n++;
+	}
+
+	if (stats) {
+		stats->wakeups++;
+	}
+
+	return n;
+}
+
+int64_t sched_deadline(const struct sched_sensor *sensors, size_t count)
+{
+	int64_t deadline = INT64_MAX;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		deadline = MIN(deadline, sensors[i].deadline_ms);
+	}
+
+	return deadline;
+}
+
+void sched_register(struct sched_sensor *sensors, size_t count)
+{
+	registered = sensors;
+	registered_count = count;
+}
+
+#if defined(CONFIG_SHELL)
+static void print_sensors(const struct shell *shell,
+			  const struct sched_sensor *sensors, size_t count)
+{
+	size_t i;
+
+	shell_print(shell, "%-8s %8s %8s %6s %10s %10s %7s", "Sensor",
+		    "Period", "Samples", "Errors", "Tolerance", "Max step",
+		    "Within");
+	for (i = 0; i < count; i++) {
+		const struct sched_sensor *s = &sensors[i];
+		uint32_t steps = s->samples > 1 ? s->samples - 1 : 0;
+
+		shell_print(shell, "%-8s %6ums %8u %6u %10d %10d %6u%%",
+			    s->name, s->period_ms, s->samples, s->errors,
+			    s->tolerance, s->max_step,
+			    steps ? (s->within * 100) / steps : 100);
+	}
+}
+
+static void print_wakeups(const struct shell *shell, uint32_t wakeups,
+			  int64_t elapsed_ms, size_t count)
+{
+	/* A fixed 1s period wakes up once a second whatever the count */
+	shell_print(shell, "Wakeups/hour:      %llu (fixed 1s: 3600)",
+		    elapsed_ms ? (wakeups * 3600000ULL) / elapsed_ms : 0);
+	shell_print(shell, "Sensors:           %zu", count);
+}
+
+static int cmd_stats(const struct shell *shell, size_t argc, char *argv[])
+{
+	if (registered == NULL) {
+		shell_error(shell, "Scheduler not running");
+		return -ENODEV;
+	}
+
+	/* The wakeups are shared with the other tasks; see tasks */
+	print_sensors(shell, registered, registered_count);
+
+	return 0;
+}
+
+#define SIM_DAY_MS (24 * 3600 * 1000LL)
+#define SIM_STEP_MS 1000
+
+struct sim_signal {
+	int32_t (*value)(int64_t t);
+	int32_t max_error;
+};
+
+static int64_t sim_now;
+
+static int32_t sim_triangle(int64_t t, int64_t period, int32_t amplitude)
+{
+	int64_t phase = t % period;
+
+	if (phase < period / 2) {
+		return (phase * 2 * amplitude) / period;
+	}
+
+	return ((period - phase) * 2 * amplitude) / period;
+}
+
+/* m°C: 18 to 24 over the day, and a window opened for 15 min at 10:00 */
+static int32_t sim_temperature(int64_t t)
+{
+	int64_t tod = t % SIM_DAY_MS;
+	int64_t open = 10 * 3600 * 1000LL, shut = open + 5 * 60 * 1000LL;
+	int64_t back = shut + 10 * 60 * 1000LL;
+	int32_t value = 18000 + sim_triangle(t, SIM_DAY_MS, 6000);
+
+	if ((tod >= open) && (tod < shut)) {
+		value -= ((tod - open) * 4000) / (shut - open);
+	} else if ((tod >= shut) && (tod < back)) {
+		value -= ((back - tod) * 4000) / (back - shut);
+	}
+
+	return value;
+}
+
+/* mlx: dark at night, 500 lx by day, 200 lx under clouds for 10 min */
+static int32_t sim_light(int64_t t)
+{
+	int64_t tod = t % SIM_DAY_MS;
+	uint32_t slot = t / (10 * 60 * 1000LL);
+
+	if ((tod < 6 * 3600 * 1000LL) || (tod >= 20 * 3600 * 1000LL)) {
+		return 0;
+	}
+
+	return ((slot * 2654435761U) >> 30) == 0 ? 200000 : 500000;
+}
+
+static int sim_sample(struct sched_sensor *sensor, int32_t *value)
+{
+	struct sim_signal *signal = sensor->user_data;
+
+	*value = signal->value(sim_now);
+
+	return 0;
+}
+
+static int cmd_sim(const struct shell *shell, size_t argc, char *argv[])
+{
+	static struct sim_signal signals[] = {
+		{ .value = sim_temperature },
+		{ .value = sim_light },
+	};
+	static struct sched_sensor sensors[] = {
+		{
+			.name = "temp",
+			.tolerance = 100,
+			.user_data = &signals[0],
+		},
+		{
+			.name = "light",
+			.tolerance = 10000,
+			.user_data = &signals[1],
+		},
+	};
+	struct sched_stats stats = { 0 };
+	int64_t end, next, t;
+	uint32_t hours = 24;
+	size_t i;
+
+	if (argc > 1)
+		hours = strtoul(argv[1], NULL, 0);
+
+	if (hours == 0) {
+		shell_error(shell, "Invalid hours");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sensors); i++) {
+		sensors[i].sample = sim_sample;
+		signals[i].max_error = 0;
+	}
+
+	/*
+	 * Run on a simulated clock, and compare the value held since the last
+	 * sample with the actual signal every second in between.
+	 */
+	end = hours * 3600 * 1000LL;
+	sim_now = 0;
+	sched_init(sensors, ARRAY_SIZE(sensors), sim_now);
+	while (sim_now < end) {
+		sched_run(sensors, ARRAY_SIZE(sensors), sim_now, &stats);
+		next = sched_deadline(sensors, ARRAY_SIZE(sensors));
+
+		for (t = sim_now; t < next; t += SIM_STEP_MS) {
+			for (i = 0; i < ARRAY_SIZE(sensors); i++) {
+				int32_t error = abs(signals[i].value(t) -
+						    sensors[i].last);
+
+				signals[i].max_error = MAX(signals[i].max_error,
+							   error);
+			}
+		}
+
+		sim_now = next;
+	}
+
+	print_sensors(shell, sensors, ARRAY_SIZE(sensors));
+	print_wakeups(shell, stats.wakeups, end, ARRAY_SIZE(sensors));
+	for (i = 0; i < ARRAY_SIZE(sensors); i++) {
+		shell_print(shell, "%-8s error bound: %d (tolerance %d)",
+			    sensors[i].name, signals[i].max_error,
+			    sensors[i].tolerance);
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sched_cmds,
+	SHELL_CMD_ARG(stats, NULL, NULL,      cmd_stats, 1, 0),
+	SHELL_CMD_ARG(sim,   NULL, "[hours]", cmd_sim,   1, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_sched(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(sched, &sched_cmds, "Sampling scheduler commands",
+		       cmd_sched, 2, 0);
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_SCHED_H_
+#define APP_SCHED_H_
+
+#include <zephyr/kernel.h>
+
+struct sched_sensor;
+
+/*
+ * Sample the sensor; the value is in thousandths of the sensor unit, and
+ * drives the adaptation of the sampling period.
+ */
+typedef int (*sched_sample_t)(struct sched_sensor *sensor, int32_t *value);
+
+struct sched_sensor {
+	/* Configuration */
+	const char *name;
+	sched_sample_t sample;
+	void *user_data;
+	uint32_t min_period_ms;
+	uint32_t max_period_ms;
+	/* Change between two samples deemed acceptable, in thousandths */
+	int32_t tolerance;
+
+	/* State */
+	uint32_t period_ms;
+	int64_t deadline_ms;
+	int32_t last;
+	int32_t deviation;
+	bool primed;
+
+	/* Statistics */
+	uint32_t samples;
+	uint32_t errors;
+	uint32_t within;
+	int32_t max_step;
+};
+
+struct sched_stats {
+	uint32_t wakeups;
+};
+
+/*
+ * Reset the sensors state, scheduling them all at now. The periods left to 0
+ * default to CONFIG_APP_SCHED_MIN_PERIOD_MS and CONFIG_APP_SCHED_MAX_PERIOD_MS.
+ */
+void sched_init(struct sched_sensor *sensors, size_t count, int64_t now);
+
+/*
+ * Sample the sensor, and adapt its period; returns the period, in
+ * milliseconds.
+ */
+uint32_t sched_sample(struct sched_sensor *sensor);
+
+/*
+ * Sample the sensors due at now, allowing for CONFIG_APP_TASKS_SLACK_MS so
+ * that close deadlines share a wakeup; returns the number of sensors sampled.
+ */
+int sched_run(struct sched_sensor *sensors, size_t count, int64_t now,
+	      struct sched_stats *stats);
+
+/*
+ * Returns the earliest deadline, in milliseconds.
+ */
+int64_t sched_deadline(const struct sched_sensor *sensors, size_t count);
+
+/*
+ * Register the sensors shown by the sched shell command.
+ */
+void sched_register(struct sched_sensor *sensors, size_t count);
+
+#endif /* APP_SCHED_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_SEQLOCK_H_
+#define APP_SEQLOCK_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/*
+ * Sequence lock, for a single writer to hand data over to readers running on
+ * another CPU without blocking either: the sequence is odd while a write is
+ * in progress, and the readers retry the copies made across a write.
+ *
+ * The writer is not preempted in the middle of a write, as a reader of a
+ * higher priority would spin forever on a single CPU.
+ */
+struct seqlock {
+	atomic_t seq;
+};
+
+static inline void seqlock_write_begin(struct seqlock *lock)
+{
+	k_sched_lock();
+	atomic_inc(&lock->seq);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void seqlock_write_end(struct seqlock *lock)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	atomic_inc(&lock->seq);
+	k_sched_unlock();
+}
+
+static inline atomic_val_t seqlock_read_begin(struct seqlock *lock)
+{
+	atomic_val_t seq;
+
+	/* Wait for the write in progress, if any */
+	do {
+		seq = atomic_get(&lock->seq);
+	} while (seq & 1);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return seq;
+}
+
+/*
+ * Returns true if a write happened since seqlock_read_begin(), and the copy
+ * has to be made again.
+ */
+static inline bool seqlock_read_retry(struct seqlock *lock, atomic_val_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return atomic_get(&lock->seq) != seq;
+}
+
+#endif /* APP_SEQLOCK_H_ */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "stages.h"
+
+static struct stage *registered;
+static size_t registered_count;
+static int64_t since_ms;
+
+uint32_t stage_end(struct stage *stage, uint32_t start)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t cycles = now - start;
+
+	stage->count++;
+	stage->cycles += cycles;
+	stage->max_cycles = MAX(stage->max_cycles, cycles);
+
+	return now;
+}
+
+void stages_reset(struct stage *stages, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		stages[i].count = 0;
+		stages[i].cycles = 0;
+		stages[i].max_cycles = 0;
+	}
+
+	since_ms = k_uptime_get();
+}
+
+void stages_register(struct stage *stages, size_t count)
+{
+	registered = stages;
+	registered_count = count;
+	stages_reset(stages, count);
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	int64_t elapsed_ms;
+	size_t i;
+
+	if (registered == NULL) {
+		shell_error(shell, "No stages");
+		return -ENODEV;
+	}
+
+	elapsed_ms = MAX(k_uptime_get() - since_ms, 1);
+
+	shell_print(shell, "%-10s %8s %8s %10s %10s", "Stage", "Count",
+		    "Rate/s", "Avg", "Max");
+	for (i = 0; i < registered_count; i++) {
+		const struct stage *stage = &registered[i];
+		uint64_t avg_ns = 0;
+
+		if (stage->count) {
+			avg_ns = k_cyc_to_ns_floor64(stage->cycles) /
+				 stage->count;
+		}
+
+		shell_print(shell, "%-10s %8u %8llu %6llu.%03lluus %8lluus",
+			    stage->name, stage->count,
+			    (uint64_t)stage->count * MSEC_PER_SEC / elapsed_ms,
+			    avg_ns / NSEC_PER_USEC, avg_ns % NSEC_PER_USEC,
+			    k_cyc_to_us_ceil64(stage->max_cycles));
+	}
+
+	shell_print(shell, "Elapsed:           %llums", elapsed_ms);
+
+	return 0;
+}
+
+static int cmd_reset(const struct shell *shell, size_t argc, char *argv[])
+{
+	if (registered == NULL) {
+		shell_error(shell, "No stages");
+		return -ENODEV;
+	}
+
+	stages_reset(registered, registered_count);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stages_cmds,
+	SHELL_CMD_ARG(show,  NULL, NULL, cmd_show,  1, 0),
+	SHELL_CMD_ARG(reset, NULL, NULL, cmd_reset, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_stages(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(stages, &stages_cmds, "Pipeline stage commands",
+		       cmd_stages, 2, 0);
+#endif
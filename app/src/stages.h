@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_STAGES_H_
+#define APP_STAGES_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Pipeline stage, timed in cycles on every pass.
+ */
+struct stage {
+	/* Configuration */
+	const char *name;
+
+	/* Statistics */
+	uint32_t count;
+	uint64_t cycles;
+	uint32_t max_cycles;
+};
+
+/*
+ * Account a pass through the stage since start, in cycles; returns the
+ * current cycle count, so that the next stage starts from there.
+ */
+uint32_t stage_end(struct stage *stage, uint32_t start);
+
+/*
+ * Reset the statistics of the stages.
+ */
+void stages_reset(struct stage *stages, size_t count);
+
+/*
+ * Register the stages shown by the stages shell command.
+ */
+void stages_register(struct stage *stages, size_t count);
+
+#endif /* APP_STAGES_H_ */
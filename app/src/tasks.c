@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+
+#include "tasks.h"
+
+static struct tasks *registered;
+
+/* Held while the heap is updated, so that the shell sees it consistent */
+static K_MUTEX_DEFINE(lock);
+
+/* The tasks are kept in a binary min-heap ordered by deadline */
+static void heap_swap(struct tasks *tasks, size_t i, size_t j)
+{
+	struct task *task = tasks->heap[i];
+
+	tasks->heap[i] = tasks->heap[j];
+	tasks->heap[j] = task;
+}
+
+static void heap_push(struct tasks *tasks, struct task *task)
+{
+	size_t i = tasks->count++, parent;
+
+	tasks->heap[i] = task;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (tasks->heap[parent]->deadline_ms <=
+		    tasks->heap[i]->deadline_ms) {
+			break;
+		}
+
+		heap_swap(tasks, i, parent);
+		i = parent;
+	}
+}
+
+static struct task *heap_pop(struct tasks *tasks)
+{
+	struct task *task = tasks->heap[0];
+	size_t i = 0, child;
+
+	tasks->heap[0] = tasks->heap[--tasks->count];
+	while ((child = 2 * i + 1) < tasks->count) {
+		if ((child + 1 < tasks->count) &&
+		    (tasks->heap[child + 1]->deadline_ms <
+		     tasks->heap[child]->deadline_ms)) {
+			child++;
+		}
+
+		if (tasks->heap[i]->deadline_ms <=
+		    tasks->heap[child]->deadline_ms) {
+			break;
+		}
+
+		heap_swap(tasks, i, child);
+		i = child;
+	}
+
+	return task;
+}
+
+int tasks_add(struct tasks *tasks, struct task *task, int64_t now)
+{
+	if ((task->fn == NULL) || (task->period_ms == 0)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&lock, K_FOREVER);
+	/* The running tasks are pushed back once run */
+	if (tasks->count + tasks->running >= ARRAY_SIZE(tasks->heap)) {
+		k_mutex_unlock(&lock);
+		return -ENOMEM;
+	}
+
+	task->deadline_ms = now;
+	heap_push(tasks, task);
+	k_mutex_unlock(&lock);
+
+	return 0;
+}
+
+/* The due tasks are run out of the lock, with their state copied */
+struct task_run {
+	struct task *task;
+	int64_t start;
+	uint32_t period;
+	uint32_t cost;
+};
+
+static void task_run(struct task_run *run)
+{
+	struct task *task = run->task;
+	uint32_t cycles;
+
+	run->start = k_uptime_get();
+	cycles = k_cycle_get_32();
+	run->period = task->fn(task);
+	run->cost = k_cyc_to_us_ceil32(k_cycle_get_32() - cycles);
+}
+
+static void task_account(const struct task_run *run)
+{
+	struct task *task = run->task;
+	uint32_t jitter;
+	int64_t next;
+
+	/* Coalesced tasks run early, late ones run late */
+	jitter = llabs(run->start - task->deadline_ms);
+	task->jitter_max_ms = MAX(task->jitter_max_ms, jitter);
+	task->jitter_sum_ms += jitter;
+
+	task->runs++;
+	task->cost_max_us = MAX(task->cost_max_us, run->cost);
+	if (run->cost > task->wcet_us) {
+		task->overruns++;
+	}
+
+	if (run->period) {
+		task->period_ms = run->period;
+	}
+
+	/* Keep the phase, but do not catch up on a missed period */
+	next = task->deadline_ms + task->period_ms;
+	if (next <= run->start) {
+		task->misses++;
+		next = run->start + task->period_ms;
+	}
+	task->deadline_ms = next;
+}
+
+int tasks_run(struct tasks *tasks, int64_t now)
+{
+	struct task_run due[CONFIG_APP_TASKS_MAX];
+	size_t i, n = 0;
+
+	k_mutex_lock(&lock, K_FOREVER);
+	tasks->wakeups++;
+
+	/* Pop all the due tasks first, so that a short period runs once */
+	while ((tasks->count > 0) &&
+	       (tasks->heap[0]->deadline_ms <=
+		now + CONFIG_APP_TASKS_SLACK_MS)) {
+		due[n++].task = heap_pop(tasks);
+	}
+	tasks->running = n;
+	k_mutex_unlock(&lock);
+
+	/*
+	 * The sensor fetches take tens of milliseconds: the tasks run out of
+	 * the lock, and out of the heap, so the shell does not wait for them.
+	 */
+	for (i = 0; i < n; i++) {
+		task_run(&due[i]);
+	}
+
+	k_mutex_lock(&lock, K_FOREVER);
+	for (i = 0; i < n; i++) {
+		task_account(&due[i]);
+		heap_push(tasks, due[i].task);
+	}
+	tasks->running = 0;
+	k_mutex_unlock(&lock);
+
+	return n;
+}
+
+int64_t tasks_deadline(const struct tasks *tasks)
+{
+	int64_t deadline;
+
+	k_mutex_lock(&lock, K_FOREVER);
+	deadline = tasks->count ? tasks->heap[0]->deadline_ms : INT64_MAX;
+	k_mutex_unlock(&lock);
+
+	return deadline;
+}
+
+void tasks_register(struct tasks *tasks)
+{
+	registered = tasks;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_tasks(const struct shell *shell, size_t argc, char **argv)
+{
+	/* Printed from a copy, not to hold the tasks for the whole output */
+	static struct task snapshot[CONFIG_APP_TASKS_MAX];
+	int64_t now, elapsed, since;
+	uint32_t runs = 0, wakeups;
+	size_t i, count;
+
+	if (registered == NULL) {
+		shell_error(shell, "No tasks");
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&lock, K_FOREVER);
+	now = k_uptime_get();
+	count = registered->count;
+	for (i = 0; i < count; i++) {
+		snapshot[i] = *registered->heap[i];
+	}
+	wakeups = registered->wakeups;
+	since = registered->since_ms;
+	k_mutex_unlock(&lock);
+
+	shell_print(shell, "%-8s %8s %8s %8s %6s %6s %9s %10s", "Task",
+		    "Period", "Due in", "Runs", "Misses", "Overr.",
+		    "Jitter", "Cost/WCET");
+	for (i = 0; i < count; i++) {
+		const struct task *task = &snapshot[i];
+
+		shell_print(shell, "%-8s %6ums %6lldms %8u %6u %6u %3llu/%3ums %4u/%4uus",
+			    task->name, task->period_ms,
+			    task->deadline_ms - now, task->runs, task->misses,
+			    task->overruns,
+			    task->runs ? task->jitter_sum_ms / task->runs : 0,
+			    task->jitter_max_ms, task->cost_max_us,
+			    task->wcet_us);
+		runs += task->runs;
+	}
+
+	/* Every coalesced run is a wakeup saved */
+	elapsed = now - since;
+	shell_print(shell, "Wakeups/hour:      %llu",
+		    elapsed ? (wakeups * 3600000ULL) / elapsed : 0);
+	shell_print(shell, "Runs/wakeup:       %u.%02u",
+		    wakeups ? runs / wakeups : 0,
+		    wakeups ? ((runs * 100) / wakeups) % 100 : 0);
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(tasks, NULL, "Show the periodic tasks", cmd_tasks);
+#endif
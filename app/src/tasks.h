@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_TASKS_H_
+#define APP_TASKS_H_
+
+#include <zephyr/kernel.h>
+
+struct task;
+
+/*
+ * Run the task; returns its next period in milliseconds, or 0 to keep the
+ * current one.
+ */
+typedef uint32_t (*task_fn_t)(struct task *task);
+
+struct task {
+	/* Configuration */
+	const char *name;
+	task_fn_t fn;
+	void *user_data;
+	uint32_t period_ms;
+	/* Declared worst-case cost */
+	uint32_t wcet_us;
+
+	/* State */
+	int64_t deadline_ms;
+
+	/* Statistics */
+	uint32_t runs;
+	uint32_t misses;
+	uint32_t overruns;
+	uint32_t jitter_max_ms;
+	uint64_t jitter_sum_ms;
+	uint32_t cost_max_us;
+};
+
+struct tasks {
+	struct task *heap[CONFIG_APP_TASKS_MAX];
+	size_t count;
+	/* Popped, and not pushed back yet */
+	size_t running;
+	uint32_t wakeups;
+	int64_t since_ms;
+};
+
+/*
+ * Add a task, first due at now.
+ */
+int tasks_add(struct tasks *tasks, struct task *task, int64_t now);
+
+/*
+ * Run the tasks due at now, allowing for CONFIG_APP_TASKS_SLACK_MS so that
+ * close deadlines are coalesced into a single wakeup; returns the number of
+ * tasks run.
+ */
+int tasks_run(struct tasks *tasks, int64_t now);
+
+/*
+ * Returns the earliest deadline, in milliseconds.
+ */
+int64_t tasks_deadline(const struct tasks *tasks);
+
+/*
+ * Register the tasks shown by the tasks shell command.
+ */
+void tasks_register(struct tasks *tasks);
+
+#endif /* APP_TASKS_H_ */
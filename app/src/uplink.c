@@ -0,0 +1,665 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <string.h>
+
+#if defined(CONFIG_APP_UPLINK)
+#include <zephyr/fs/fcb.h>
+#include <zephyr/fs/fcb_staging.h>
+#include <zephyr/net/conn_mgr.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/net/net_event.h>
+#include <zephyr/net/net_mgmt.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/storage/flash_map.h>
+#if defined(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+#if defined(CONFIG_NET_L2_WIFI_MGMT)
+#include <zephyr/net/wifi_mgmt.h>
+#endif
+
+#include "uplink.h"
+
+#define TOPIC CONFIG_APP_UPLINK_TOPIC
+#define TOPIC_LEN (sizeof(TOPIC) - 1)
+
+/*
+ * The PUBLISH packet is the fixed header (type, and remaining length up to
+ * 16383 bytes), the topic prefixed by its length, the message identifier, then
+ * the payload.
+ */
+#define PUBLISH_OVERHEAD (1 + 2 + 2 + TOPIC_LEN + 2)
+#define PAYLOAD_MAX (CONFIG_APP_UPLINK_MSS - PUBLISH_OVERHEAD)
+
+BUILD_ASSERT(PAYLOAD_MAX >= 1 + FCB_STAGING_RECORD_MAX_LEN,
+	     "Topic too long for a record to fit in a segment");
+
+#if defined(CONFIG_SETTINGS)
+BUILD_ASSERT(DT_HAS_CHOSEN(zephyr_fcb_staging_partition),
+	     "The settings must not share the staging partition");
+#endif
+
+/*
+ * Where the next batch starts: the records of the entry after loc to skip, the
+ * id of the sector of loc, and whether records were written over before it.
+ */
+struct uplink_cursor {
+	struct fcb_entry loc;
+	uint16_t skip;
+	uint16_t id;
+	bool overrun;
+};
+
+#if defined(CONFIG_SETTINGS)
+/*
+ * The cursor as saved: the entry, and the id of its sector, so that a sector
+ * rotated out since is told apart; the sector is UINT16_MAX for the oldest
+ * entry on.
+ */
+struct uplink_saved {
+	uint16_t sector;
+	uint16_t id;
+	uint32_t elem_off;
+	uint32_t data_off;
+	uint16_t data_len;
+	uint16_t skip;
+};
+#endif
+
+struct uplink_fill {
+	uint8_t *buf;
+	size_t len;
+	uint16_t skip;
+	uint16_t taken;
+};
+
+static struct uplink {
+	/* State */
+	atomic_t online;
+	struct k_sem kick;
+	struct uplink_cursor cursor;
+	struct mqtt_client client;
+	struct sockaddr_in broker;
+	uint16_t message_id;
+	int evt;
+	int evt_result;
+	uint16_t evt_message_id;
+
+	/* Statistics */
+	uint32_t bursts;
+	uint32_t publishes;
+	uint32_t records;
+	uint32_t bytes;
+	uint32_t retries;
+	uint32_t overruns;
+	int error;
+} uplink;
+
+static uint8_t rx_buf[128];
+static uint8_t tx_buf[128 + TOPIC_LEN];
+static uint8_t payload[PAYLOAD_MAX];
+static uint8_t entry[1 + CONFIG_FCB_STAGING_BUF_SIZE];
+
+static struct net_mgmt_event_callback l4_cb;
+
+#if defined(CONFIG_SETTINGS)
+static struct uplink_saved saved;
+static bool saved_valid;
+#endif
+
+static K_KERNEL_STACK_DEFINE(uplink_stack, CONFIG_APP_UPLINK_THREAD_STACK_SIZE);
+static struct k_thread uplink_thread_data;
+
+/* The sectors ids go up from the oldest sector to the active one */
+static uint16_t uplink_sector_id(const struct fcb *fcb, int sector)
+{
+	int n = fcb->f_sector_cnt;
+	int active = fcb->f_active.fe_sector - fcb->f_sectors;
+
+	return fcb->f_active_id - (active - sector + n) % n;
+}
+
+static void uplink_cursor_set(const struct fcb *fcb,
+			      struct uplink_cursor *cursor,
+			      const struct fcb_entry *loc)
+{
+	cursor->loc = *loc;
+	cursor->skip = 0;
+	cursor->id = uplink_sector_id(fcb, loc->fe_sector - fcb->f_sectors);
+}
+
+/*
+ * Whoever rotates the FCB, the sector of the cursor is rotated out once it is
+ * not between the oldest and the active ones anymore, or it is reused with
+ * another id; the FCB lock must be held.
+ */
+static bool uplink_cursor_valid(const struct fcb *fcb,
+				const struct uplink_cursor *cursor)
+{
+	int n = fcb->f_sector_cnt;
+	int sector = cursor->loc.fe_sector - fcb->f_sectors;
+	int oldest = fcb->f_oldest - fcb->f_sectors;
+	int active = fcb->f_active.fe_sector - fcb->f_sectors;
+
+	return (sector - oldest + n) % n <= (active - oldest + n) % n &&
+	       uplink_sector_id(fcb, sector) == cursor->id;
+}
+
+#if defined(CONFIG_SETTINGS)
+static void uplink_cursor_save(struct fcb *fcb,
+			       const struct uplink_cursor *cursor)
+{
+	struct uplink_saved cur = { .sector = UINT16_MAX };
+	int ret;
+
+	k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (cursor->loc.fe_sector != NULL && uplink_cursor_valid(fcb, cursor)) {
+		cur.sector = cursor->loc.fe_sector - fcb->f_sectors;
+		cur.id = cursor->id;
+		cur.elem_off = cursor->loc.fe_elem_off;
+		cur.data_off = cursor->loc.fe_data_off;
+		cur.data_len = cursor->loc.fe_data_len;
+		cur.skip = cursor->skip;
+	}
+	k_mutex_unlock(&fcb->f_mtx);
+
+	/* Spare the flash if nothing changed */
+	if (saved_valid && memcmp(&cur, &saved, sizeof(cur)) == 0) {
+		return;
+	}
+
+	ret = settings_save_one("uplink/cursor", &cur, sizeof(cur));
+	if (ret) {
+		printk("Warning: uplink: Failed to save the cursor: %i\n", ret);
+		return;
+	}
+
+	saved = cur;
+	saved_valid = true;
+}
+
+/* Resume after the records published before the reboot */
+static void uplink_cursor_restore(void)
+{
+	struct fcb *fcb = fcb_staging_fcb();
+	struct uplink_cursor cursor = { 0 };
+
+	if (fcb == NULL || !saved_valid || saved.sector == UINT16_MAX) {
+		return;
+	}
+
+	k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (saved.sector < fcb->f_sector_cnt) {
+		cursor.loc.fe_sector = &fcb->f_sectors[saved.sector];
+		cursor.loc.fe_elem_off = saved.elem_off;
+		cursor.loc.fe_data_off = saved.data_off;
+		cursor.loc.fe_data_len = saved.data_len;
+		cursor.skip = saved.skip;
+		cursor.id = saved.id;
+	}
+
+	if (cursor.loc.fe_sector != NULL && uplink_cursor_valid(fcb, &cursor)) {
+		uplink.cursor = cursor;
+	} else {
+		/* The records past the cursor were written over since */
+		uplink.overruns++;
+	}
+	k_mutex_unlock(&fcb->f_mtx);
+}
+
+static int uplink_settings_set(const char *name, size_t len,
+			       settings_read_cb read_cb, void *cb_arg)
+{
+	struct uplink_saved cur;
+	ssize_t ret;
+
+	if (strcmp(name, "cursor")) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(cur)) {
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, &cur, sizeof(cur));
+	if (ret < 0) {
+		return ret;
+	}
+
+	saved = cur;
+	saved_valid = true;
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(uplink, "uplink", NULL, uplink_settings_set,
+			       NULL, NULL);
+#endif
+
+/*
+ * The cursor moves past the batch once the broker acknowledged it; the
+ * overruns are counted then, not at every retry of the batch.
+ */
+static void uplink_cursor_commit(struct fcb *fcb, struct uplink_cursor *next)
+{
+	if (next->overrun) {
+		uplink.overruns++;
+		next->overrun = false;
+	}
+
+	uplink.cursor = *next;
+
+#if defined(CONFIG_SETTINGS)
+	uplink_cursor_save(fcb, next);
+#endif
+}
+
+static int uplink_fill_cb(const uint8_t *data, uint8_t len, void *arg)
+{
+	struct uplink_fill *fill = arg;
+
+	if (fill->skip) {
+		fill->skip--;
+		return 0;
+	}
+
+	if (fill->len + 1 + len > sizeof(payload)) {
+		return 1;
+	}
+
+	fill->buf[fill->len++] = len;
+	memcpy(&fill->buf[fill->len], data, len);
+	fill->len += len;
+	fill->taken++;
+
+	return 0;
+}
+
+/*
+ * Fill the payload with the records from the cursor on; returns the payload
+ * length, and the cursor past the batch.
+ */
+static size_t uplink_batch(struct fcb *fcb, struct uplink_cursor *next,
+			   uint32_t *records)
+{
+	struct uplink_fill fill = { .buf = payload };
+	struct fcb_entry loc;
+	int ret;
+
+	/* Do not let the staging rotate the sector being read */
+	k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (next->loc.fe_sector != NULL && !uplink_cursor_valid(fcb, next)) {
+		/* The records past the cursor were written over */
+		memset(next, 0, sizeof(*next));
+		next->overrun = true;
+	}
+
+	*records = 0;
+	loc = next->loc;
+	while (fcb_getnext(fcb, &loc) == 0) {
+		if (loc.fe_data_len > sizeof(entry)) {
+			uplink_cursor_set(fcb, next, &loc);
+			continue;
+		}
+
+		ret = flash_area_read(fcb->fap, FCB_ENTRY_FA_DATA_OFF(loc),
+				      entry, loc.fe_data_len);
+		if (ret) {
+			break;
+		}
+
+		fill.skip = next->skip;
+		fill.taken = 0;
+		ret = fcb_staging_foreach(entry, loc.fe_data_len,
+					  uplink_fill_cb, &fill);
+		*records += fill.taken;
+		if (ret == 1) {
+			next->skip += fill.taken;
+			break;
+		}
+
+		/* Every record is in, or the entry is not a group */
+		uplink_cursor_set(fcb, next, &loc);
+	}
+	k_mutex_unlock(&fcb->f_mtx);
+
+	return fill.len;
+}
+
+static void uplink_mqtt_evt(struct mqtt_client *client,
+			    const struct mqtt_evt *evt)
+{
+	uplink.evt = evt->type;
+	uplink.evt_result = evt->result;
+	if (evt->type == MQTT_EVT_PUBACK) {
+		uplink.evt_message_id = evt->param.puback.message_id;
+	}
+}
+
+/* Process the broker packets until the event, or the disconnection */
+static int uplink_wait(int type)
+{
+	int64_t end = k_uptime_get() + CONFIG_APP_UPLINK_TIMEOUT_MS;
+	struct zsock_pollfd fds = {
+		.fd = uplink.client.transport.tcp.sock,
+		.events = ZSOCK_POLLIN,
+	};
+	int64_t remaining;
+	int ret;
+
+	uplink.evt = -1;
+	while (uplink.evt != type) {
+		if (uplink.evt == MQTT_EVT_DISCONNECT) {
+			return -ECONNRESET;
+		}
+
+		remaining = end - k_uptime_get();
+		if (remaining <= 0) {
+			return -ETIMEDOUT;
+		}
+
+		ret = zsock_poll(&fds, 1, remaining);
+		if (ret < 0) {
+			return -errno;
+		}
+
+		if (ret == 0) {
+			return -ETIMEDOUT;
+		}
+
+		ret = mqtt_input(&uplink.client);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	/* The broker refused the connection with a positive return code */
+	return uplink.evt_result > 0 ? -ECONNREFUSED : uplink.evt_result;
+}
+
+static int uplink_connect(void)
+{
+	struct mqtt_client *client = &uplink.client;
+	int ret;
+
+	mqtt_client_init(client);
+	client->broker = &uplink.broker;
+	client->evt_cb = uplink_mqtt_evt;
+	client->client_id.utf8 = (uint8_t *)CONFIG_APP_UPLINK_CLIENT_ID;
+	client->client_id.size = sizeof(CONFIG_APP_UPLINK_CLIENT_ID) - 1;
+	client->protocol_version = MQTT_VERSION_3_1_1;
+	client->rx_buf = rx_buf;
+	client->rx_buf_size = sizeof(rx_buf);
+	client->tx_buf = tx_buf;
+	client->tx_buf_size = sizeof(tx_buf);
+	client->transport.type = MQTT_TRANSPORT_NON_SECURE;
+
+	ret = mqtt_connect(client);
+	if (ret) {
+		return ret;
+	}
+
+	ret = uplink_wait(MQTT_EVT_CONNACK);
+	if (ret) {
+		mqtt_abort(client);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* A single batch is in flight, so that the broker paces the burst */
+static int uplink_publish(size_t len)
+{
+	struct mqtt_publish_param param = { 0 };
+	int ret;
+
+	uplink.message_id++;
+	if (uplink.message_id == 0) {
+		uplink.message_id++;
+	}
+
+	param.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE;
+	param.message.topic.topic.utf8 = (uint8_t *)TOPIC;
+	param.message.topic.topic.size = TOPIC_LEN;
+	param.message.payload.data = payload;
+	param.message.payload.len = len;
+	param.message_id = uplink.message_id;
+
+	ret = mqtt_publish(&uplink.client, &param);
+	if (ret) {
+		return ret;
+	}
+
+	do {
+		ret = uplink_wait(MQTT_EVT_PUBACK);
+	} while (ret == 0 && uplink.evt_message_id != uplink.message_id);
+
+	return ret;
+}
+
+/*
+ * Publish up to CONFIG_APP_UPLINK_BURST_MAX batches; returns 1 if records are
+ * left, 0 if none, or a negative error code.
+ */
+static int uplink_burst(void)
+{
+	struct fcb *fcb = fcb_staging_fcb();
+	struct uplink_cursor next;
+	uint32_t records;
+	size_t len;
+	int i, ret;
+
+	if (fcb == NULL) {
+		return -ENODEV;
+	}
+
+	/* The records still in RAM are in the burst too */
+	ret = fcb_staging_flush();
+	if (ret) {
+		return ret;
+	}
+
+	next = uplink.cursor;
+	len = uplink_batch(fcb, &next, &records);
+	if (len == 0) {
+		uplink_cursor_commit(fcb, &next);
+		return 0;
+	}
+
+	ret = uplink_connect();
+	if (ret) {
+		return ret;
+	}
+
+	uplink.bursts++;
+	for (i = 0; i < CONFIG_APP_UPLINK_BURST_MAX; i++) {
+		ret = uplink_publish(len);
+		if (ret) {
+			mqtt_abort(&uplink.client);
+			return ret;
+		}
+
+		uplink_cursor_commit(fcb, &next);
+		uplink.publishes++;
+		uplink.records += records;
+		uplink.bytes += len;
+
+		len = uplink_batch(fcb, &next, &records);
+		if (len == 0) {
+			break;
+		}
+	}
+
+	mqtt_disconnect(&uplink.client);
+
+	return len ? 1 : 0;
+}
+
+static void uplink_thread(void *p1, void *p2, void *p3)
+{
+	uint32_t delay_ms = CONFIG_APP_UPLINK_INTERVAL_MS;
+	uint32_t backoff_ms = 0;
+	int ret;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	/* Loaded here, at low priority, not to hold the boot up */
+#if defined(CONFIG_SETTINGS)
+	ret = settings_subsys_init();
+	if (ret) {
+		printk("Warning: uplink: Failed to init settings: %i\n", ret);
+	} else {
+		settings_load_subtree("uplink");
+		uplink_cursor_restore();
+	}
+#endif
+
+	while (1) {
+		(void)k_sem_take(&uplink.kick, K_MSEC(delay_ms));
+		if (!atomic_get(&uplink.online)) {
+			delay_ms = CONFIG_APP_UPLINK_INTERVAL_MS;
+			continue;
+		}
+
+		ret = uplink_burst();
+		if (ret < 0) {
+			/* Back off up to the interval */
+			uplink.error = ret;
+			uplink.retries++;
+			backoff_ms = backoff_ms ?
+				     MIN(backoff_ms * 2,
+					 CONFIG_APP_UPLINK_INTERVAL_MS) :
+				     CONFIG_APP_UPLINK_RETRY_MS;
+			delay_ms = backoff_ms;
+			continue;
+		}
+
+		backoff_ms = 0;
+
+		/* The backlog goes on shortly, the radio sleeps otherwise */
+		delay_ms = ret ? CONFIG_APP_UPLINK_RETRY_MS :
+				 CONFIG_APP_UPLINK_INTERVAL_MS;
+	}
+}
+
+/* The radio wakes up for the bursts only */
+static void uplink_power_save(struct net_if *iface)
+{
+#if defined(CONFIG_NET_L2_WIFI_MGMT)
+	struct wifi_ps_params params = { .enabled = WIFI_PS_ENABLED };
+	int ret;
+
+	ret = net_mgmt(NET_REQUEST_WIFI_PS, iface, &params, sizeof(params));
+	if (ret && ret != -ENOTSUP) {
+		printk("Warning: uplink: Failed to enable power save: %i\n",
+		       ret);
+	}
+#endif
+}
+
+static void uplink_l4_event(struct net_mgmt_event_callback *cb,
+			    uint32_t mgmt_event, struct net_if *iface)
+{
+	switch (mgmt_event) {
+	case NET_EVENT_L4_CONNECTED:
+		atomic_set(&uplink.online, 1);
+		uplink_power_save(iface);
+		k_sem_give(&uplink.kick);
+		break;
+	case NET_EVENT_L4_DISCONNECTED:
+		atomic_set(&uplink.online, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+void uplink_kick(void)
+{
+	k_sem_give(&uplink.kick);
+}
+
+int uplink_setup(void)
+{
+	int ret;
+
+	uplink.broker.sin_family = AF_INET;
+	uplink.broker.sin_port = htons(CONFIG_APP_UPLINK_BROKER_PORT);
+	ret = zsock_inet_pton(AF_INET, CONFIG_APP_UPLINK_BROKER_ADDR,
+			      &uplink.broker.sin_addr);
+	if (ret != 1) {
+		printk("Warning: uplink: Invalid broker address: %s\n",
+		       CONFIG_APP_UPLINK_BROKER_ADDR);
+		return -EINVAL;
+	}
+
+	k_sem_init(&uplink.kick, 0, 1);
+
+	k_thread_create(&uplink_thread_data, uplink_stack,
+			K_KERNEL_STACK_SIZEOF(uplink_stack), uplink_thread,
+			NULL, NULL, NULL,
+			K_PRIO_PREEMPT(CONFIG_APP_UPLINK_THREAD_PRIORITY), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&uplink_thread_data, "uplink");
+
+	net_mgmt_init_event_callback(&l4_cb, uplink_l4_event,
+				     NET_EVENT_L4_CONNECTED |
+				     NET_EVENT_L4_DISCONNECTED);
+	net_mgmt_add_event_callback(&l4_cb);
+
+	/* The network may be up already */
+	net_conn_mgr_resend_status();
+
+	return 0;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_show(const struct shell *shell, size_t argc, char *argv[])
+{
+	shell_print(shell, "Online:            %s",
+		    atomic_get(&uplink.online) ? "yes" : "no");
+	shell_print(shell, "Bursts:            %u", uplink.bursts);
+	shell_print(shell, "Publishes:         %u", uplink.publishes);
+	shell_print(shell, "Records:           %u", uplink.records);
+	shell_print(shell, "Bytes:             %u", uplink.bytes);
+	shell_print(shell, "Retries:           %u", uplink.retries);
+	shell_print(shell, "Overruns:          %u", uplink.overruns);
+	shell_print(shell, "Last error:        %i", uplink.error);
+
+	return 0;
+}
+
+static int cmd_kick(const struct shell *shell, size_t argc, char *argv[])
+{
+	uplink_kick();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(uplink_cmds,
+	SHELL_CMD_ARG(show, NULL, NULL, cmd_show, 1, 0),
+	SHELL_CMD_ARG(kick, NULL, NULL, cmd_kick, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_uplink(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(uplink, &uplink_cmds, "Uplink commands", cmd_uplink,
+		       2, 0);
+#endif
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_UPLINK_H_
+#define APP_UPLINK_H_
+
+#include <zephyr/kernel.h>
+
+/*
+ * Store-and-forward uplink: the records staged to flash are published to the
+ * MQTT broker in bursts, every CONFIG_APP_UPLINK_INTERVAL_MS while the network
+ * is up. Every publish is a batch of records, each one prefixed by its length
+ * (1 byte), sized for the PUBLISH packet to fit in a TCP segment.
+ *
+ * The records are published at least once: a batch is retried until the
+ * broker acknowledges it, unless its sector is rotated out in flash before;
+ * the uplink then resumes from the oldest record, and counts an overrun.
+ */
+
+/*
+ * Start the uplink thread, which waits for the network to be up.
+ */
+int uplink_setup(void);
+
+/*
+ * Run a burst now, e.g. before sleep.
+ */
+void uplink_kick(void);
+
+#endif /* APP_UPLINK_H_ */
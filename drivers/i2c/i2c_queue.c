@@ -0,0 +1,212 @@
+/* i2c_queue.c - I2C request queue with a single bus owner */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_queue.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/hotpath.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(i2c_queue, CONFIG_I2C_LOG_LEVEL);
+
+struct i2c_queue_sync {
+	struct i2c_queue_req req;
+	struct k_sem sem;
+	int result;
+};
+
+static K_FIFO_DEFINE(queue);
+static atomic_t depth;
+
+static struct k_spinlock lock;
+static struct i2c_queue_stats stats;
+static int64_t since;
+
+static K_KERNEL_STACK_DEFINE(owner_stack, CONFIG_I2C_QUEUE_THREAD_STACK_SIZE);
+static struct k_thread owner_thread_data;
+
+__hotpath int i2c_queue_submit(struct i2c_queue_req *req)
+{
+	k_spinlock_key_t key;
+	atomic_val_t pending;
+
+	if ((req->spec == NULL) || (req->msgs == NULL) ||
+	    (req->num_msgs == 0) || (req->cb == NULL)) {
+		return -EINVAL;
+	}
+
+	req->submit_cycles = k_cycle_get_32();
+	pending = atomic_inc(&depth) + 1;
+
+	key = k_spin_lock(&lock);
+	stats.depth_max = MAX(stats.depth_max, pending);
+	k_spin_unlock(&lock, key);
+
+	k_fifo_put(&queue, req);
+
+	return 0;
+}
+
+static __hotpath void sync_cb(struct i2c_queue_req *req, int result)
+{
+	struct i2c_queue_sync *sync = CONTAINER_OF(req, struct i2c_queue_sync,
+						   req);
+
+	sync->result = result;
+	k_sem_give(&sync->sem);
+}
+
+int i2c_queue_transfer(const struct i2c_dt_spec *spec, struct i2c_msg *msgs,
+		       uint8_t num_msgs)
+{
+	struct i2c_queue_sync sync = {
+		.req = {
+			.spec = spec,
+			.msgs = msgs,
+			.num_msgs = num_msgs,
+			.cb = sync_cb,
+		},
+	};
+	int ret;
+
+	/* The owner would wait for itself */
+	if (k_current_get() == &owner_thread_data) {
+		return i2c_transfer(spec->bus, msgs, num_msgs, spec->addr);
+	}
+
+	k_sem_init(&sync.sem, 0, 1);
+	ret = i2c_queue_submit(&sync.req);
+	if (ret) {
+		return ret;
+	}
+
+	k_sem_take(&sync.sem, K_FOREVER);
+
+	return sync.result;
+}
+
+void i2c_queue_stats_get(struct i2c_queue_stats *out)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	*out = stats;
+	k_spin_unlock(&lock, key);
+}
+
+/* Run the requests back-to-back, as long as there are some pending */
+static __hotpath void owner_thread(void *p1, void *p2, void *p3)
+{
+	struct i2c_queue_req *req;
+	uint32_t start, busy, wait;
+	k_spinlock_key_t key;
+	int ret;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		req = k_fifo_get(&queue, K_FOREVER);
+
+		start = k_cycle_get_32();
+		wait = start - req->submit_cycles;
+		ret = i2c_transfer(req->spec->bus, req->msgs, req->num_msgs,
+				   req->spec->addr);
+		busy = k_cycle_get_32() - start;
+		atomic_dec(&depth);
+
+		key = k_spin_lock(&lock);
+		stats.requests++;
+		if (ret) {
+			stats.errors++;
+		}
+		stats.busy_cycles += busy;
+		stats.wait_cycles += wait;
+		stats.wait_max_cycles = MAX(stats.wait_max_cycles, wait);
+		k_spin_unlock(&lock, key);
+
+		if (ret) {
+			LOG_DBG("Transfer to 0x%02x failed: %d",
+				req->spec->addr, ret);
+		}
+
+		req->cb(req, ret);
+	}
+}
+
+static int i2c_queue_init(const struct device *unused)
+{
+	ARG_UNUSED(unused);
+
+	since = k_uptime_get();
+
+	k_thread_create(&owner_thread_data, owner_stack,
+			K_KERNEL_STACK_SIZEOF(owner_stack), owner_thread,
+			NULL, NULL, NULL,
+			K_PRIO_COOP(CONFIG_I2C_QUEUE_THREAD_PRIORITY), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&owner_thread_data, "i2c_queue");
+
+	return 0;
+}
+
+/* Before the I2C devices, which submit their requests at init */
+SYS_INIT(i2c_queue_init, POST_KERNEL, CONFIG_I2C_QUEUE_INIT_PRIORITY);
+
+#if defined(CONFIG_I2C_QUEUE_SHELL)
+static int cmd_stats(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct i2c_queue_stats s;
+	uint64_t elapsed_us = (k_uptime_get() - since) * USEC_PER_MSEC;
+	uint64_t busy_us, util = 0;
+
+	i2c_queue_stats_get(&s);
+
+	busy_us = k_cyc_to_us_ceil64(s.busy_cycles);
+	if (elapsed_us) {
+		util = (busy_us * 10000) / elapsed_us;
+	}
+
+	shell_print(shell, "Requests:          %u", s.requests);
+	shell_print(shell, "Errors:            %u", s.errors);
+	shell_print(shell, "Pending:           %ld (max %u)",
+		    (long)atomic_get(&depth), s.depth_max);
+	shell_print(shell, "Bus utilisation:   %llu.%02llu%%", util / 100,
+		    util % 100);
+	shell_print(shell, "Transfer avg:      %lluus",
+		    s.requests ? busy_us / s.requests : 0);
+	shell_print(shell, "Queueing avg:      %lluus",
+		    s.requests ? k_cyc_to_us_ceil64(s.wait_cycles) / s.requests :
+		    0);
+	shell_print(shell, "Queueing max:      %uus",
+		    k_cyc_to_us_ceil32(s.wait_max_cycles));
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(i2c_queue_cmds,
+	SHELL_CMD_ARG(stats, NULL, NULL, cmd_stats, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_i2c_queue(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(i2c_queue, &i2c_queue_cmds, "I2C queue commands",
+		       cmd_i2c_queue, 2, 0);
+#endif
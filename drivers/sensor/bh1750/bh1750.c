@@ -0,0 +1,507 @@
+/* bh1750.c - Driver for BH1750 ambient light sensor */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT rohm_bh1750
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/i2c.h>
+#if defined(CONFIG_I2C_QUEUE)
+#include <zephyr/drivers/i2c_queue.h>
+#include <zephyr/drivers/sensor/bh1750.h>
+#endif
+#include <zephyr/init.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/hotpath.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/__assert.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(BH1750, CONFIG_SENSOR_LOG_LEVEL);
+
+#if DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) == 0
+#warning "BH1750 driver enabled without any devices"
+#endif
+
+#define BH1750_POWER_ON                         0x01
+#define BH1750_CONTINUOUS_HIGH_RESOLUTION_MODE  0x10
+#define BH1750_CHANGE_MEASUREMENT_TIME_HIGH_BIT 0x40
+#define BH1750_CHANGE_MEASUREMENT_TIME_LOW_BIT  0x60
+
+#define BH1750_MEASUREMENT_TYP_MS 120 /* At the default measurement time */
+#define BH1750_MEASUREMENT_MAX_MS 180 /* At the default measurement time */
+
+/* Measurement time register */
+#define BH1750_MTREG_DEFAULT 69
+#define BH1750_MTREG_MIN     31
+#define BH1750_MTREG_MAX						\
+	MIN(254, CONFIG_ROHM_BH1750_MEASUREMENT_TIME_MAX *		\
+		 BH1750_MTREG_DEFAULT / BH1750_MEASUREMENT_TYP_MS)
+
+/*
+ * The measurement time is changed when the count leaves the range, so that
+ * the next one lands in the middle; the range is wide not to hunt.
+ */
+#define BH1750_RAW_LOW    0x1000
+#define BH1750_RAW_TARGET 0x8000
+#define BH1750_RAW_HIGH   0xe000
+
+#if defined(CONFIG_I2C_QUEUE)
+/*
+ * Every fetch is a read of the last measurement, then, if the measurement
+ * time changes, its two halves and the mode are written.
+ */
+enum bh1750_step {
+	BH1750_STEP_READ,
+	BH1750_STEP_MTREG_HIGH,
+	BH1750_STEP_MTREG_LOW,
+	BH1750_STEP_MODE,
+	/* The first measurement is still running */
+	BH1750_STEP_POWER_ON,
+};
+#endif
+
+struct bh1750_data {
+	uint16_t raw_val;
+	/* Measurement time of the raw value, 0 if none yet */
+	uint8_t raw_mtreg;
+	uint8_t mtreg;
+	/* End of the first measurement at the measurement time */
+	int64_t ready_ms;
+#if defined(CONFIG_I2C_QUEUE)
+	const struct device *dev;
+	struct i2c_queue_req req;
+	struct i2c_msg msg;
+	uint8_t cmd;
+	uint8_t buf[2];
+	/* Measurement time being written, committed once the mode is */
+	uint8_t next_mtreg;
+	enum bh1750_step step;
+	struct k_timer timer;
+	struct k_work error_work;
+	int error;
+	atomic_t busy;
+	bh1750_fetch_cb_t cb;
+	void *user_data;
+	struct k_sem sem;
+	int result;
+#endif
+};
+
+struct bh1750_config {
+	struct i2c_dt_spec i2c;
+	uint8_t mtreg;
+};
+
+static inline int bh1750_is_ready(const struct device *dev)
+{
+	const struct bh1750_config *cfg = dev->config;
+
+	return device_is_ready(cfg->i2c.bus) ? 0 : -ENODEV;
+}
+
+static inline int bh1750_read(const struct device *dev, uint8_t *buf, int size)
+{
+	const struct bh1750_config *cfg = dev->config;
+
+#if defined(CONFIG_I2C_QUEUE)
+	return i2c_queue_read(&cfg->i2c, buf, size);
+#else
+	return i2c_read_dt(&cfg->i2c, buf, size);
+#endif
+}
+
+static inline int bh1750_write(const struct device *dev, uint8_t val)
+{
+	const struct bh1750_config *cfg = dev->config;
+	uint8_t buf = val;
+
+#if defined(CONFIG_I2C_QUEUE)
+	return i2c_queue_write(&cfg->i2c, &buf, sizeof(buf));
+#else
+	return i2c_write_dt(&cfg->i2c, &buf, sizeof(buf));
+#endif
+}
+
+/* The new measurement time applies to the measurement after the mode */
+static int bh1750_mtreg_write(const struct device *dev, uint8_t mtreg)
+{
+	int ret;
+
+	ret = bh1750_write(dev, BH1750_CHANGE_MEASUREMENT_TIME_HIGH_BIT |
+				(mtreg >> 5));
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = bh1750_write(dev, BH1750_CHANGE_MEASUREMENT_TIME_LOW_BIT |
+				(mtreg & 0x1f));
+	if (ret < 0) {
+		return ret;
+	}
+
+	return bh1750_write(dev, BH1750_CONTINUOUS_HIGH_RESOLUTION_MODE);
+}
+
+static inline int64_t bh1750_ready_ms(uint8_t mtreg)
+{
+	return k_uptime_get() +
+	       DIV_ROUND_UP(BH1750_MEASUREMENT_MAX_MS * mtreg,
+			    BH1750_MTREG_DEFAULT);
+}
+
+/*
+ * Returns the measurement time for the count to land in the middle of the
+ * range, or the current one if the count is in range already: the longest
+ * time resolves the low light, and the shortest does not saturate in the
+ * sun.
+ */
+static __hotpath uint8_t bh1750_mtreg_next(uint16_t raw, uint8_t mtreg)
+{
+	uint32_t next;
+
+	if (raw >= BH1750_RAW_LOW && raw <= BH1750_RAW_HIGH) {
+		return mtreg;
+	}
+
+	if (raw == 0) {
+		return BH1750_MTREG_MAX;
+	}
+
+	next = (uint32_t)mtreg * BH1750_RAW_TARGET / raw;
+
+	return CLAMP(next, BH1750_MTREG_MIN, BH1750_MTREG_MAX);
+}
+
+#if defined(CONFIG_I2C_QUEUE)
+static __hotpath void bh1750_async_done(struct bh1750_data *data, int result)
+{
+	bh1750_fetch_cb_t cb = data->cb;
+
+	atomic_clear(&data->busy);
+	cb(data->dev, result, data->user_data);
+}
+
+static void bh1750_error_work(struct k_work *work)
+{
+	struct bh1750_data *data = CONTAINER_OF(work, struct bh1750_data,
+						error_work);
+
+	bh1750_async_done(data, data->error);
+}
+
+/*
+ * A submit fails from the timer expiry too, i.e. an ISR; the user callback is
+ * called from the system work queue instead.
+ */
+static __hotpath void bh1750_async_error(struct bh1750_data *data, int error)
+{
+	data->error = error;
+	k_work_submit(&data->error_work);
+}
+
+static __hotpath void bh1750_async_command(struct bh1750_data *data,
+					   uint8_t cmd)
+{
+	int ret;
+
+	data->cmd = cmd;
+	data->msg.buf = &data->cmd;
+	data->msg.len = sizeof(data->cmd);
+	data->msg.flags = I2C_MSG_WRITE | I2C_MSG_STOP;
+	ret = i2c_queue_submit(&data->req);
+	if (ret < 0) {
+		bh1750_async_error(data, ret);
+	}
+}
+
+static __hotpath void bh1750_async_read(struct bh1750_data *data)
+{
+	int ret;
+
+	data->step = BH1750_STEP_READ;
+	data->msg.buf = data->buf;
+	data->msg.len = sizeof(data->buf);
+	data->msg.flags = I2C_MSG_READ | I2C_MSG_STOP;
+	ret = i2c_queue_submit(&data->req);
+	if (ret < 0) {
+		bh1750_async_error(data, ret);
+	}
+}
+
+/* The first measurement is over; read it */
+static __hotpath void bh1750_timer_expiry(struct k_timer *timer)
+{
+	struct bh1750_data *data = CONTAINER_OF(timer, struct bh1750_data,
+						timer);
+
+	bh1750_async_read(data);
+}
+
+static __hotpath void bh1750_req_cb(struct i2c_queue_req *req, int result)
+{
+	struct bh1750_data *data = CONTAINER_OF(req, struct bh1750_data, req);
+	uint8_t mtreg;
+
+	if (result < 0) {
+		LOG_DBG("Step %d failed: %d", data->step, result);
+		bh1750_async_done(data, result);
+		return;
+	}
+
+	switch (data->step) {
+	case BH1750_STEP_READ:
+		data->raw_val = sys_get_be16(data->buf);
+		data->raw_mtreg = data->mtreg;
+
+		mtreg = bh1750_mtreg_next(data->raw_val, data->mtreg);
+		if (mtreg == data->mtreg) {
+			bh1750_async_done(data, 0);
+			break;
+		}
+		data->next_mtreg = mtreg;
+
+		data->step = BH1750_STEP_MTREG_HIGH;
+		bh1750_async_command(data,
+			BH1750_CHANGE_MEASUREMENT_TIME_HIGH_BIT | (mtreg >> 5));
+		break;
+	case BH1750_STEP_MTREG_HIGH:
+		data->step = BH1750_STEP_MTREG_LOW;
+		bh1750_async_command(data,
+			BH1750_CHANGE_MEASUREMENT_TIME_LOW_BIT |
+			(data->next_mtreg & 0x1f));
+		break;
+	case BH1750_STEP_MTREG_LOW:
+		data->step = BH1750_STEP_MODE;
+		bh1750_async_command(data,
+				     BH1750_CONTINUOUS_HIGH_RESOLUTION_MODE);
+		break;
+	case BH1750_STEP_MODE:
+		data->mtreg = data->next_mtreg;
+		data->ready_ms = bh1750_ready_ms(data->mtreg);
+		bh1750_async_done(data, 0);
+		break;
+	case BH1750_STEP_POWER_ON:
+		break;
+	}
+}
+
+int bh1750_sample_fetch_async(const struct device *dev, bh1750_fetch_cb_t cb,
+			      void *user_data)
+{
+	struct bh1750_data *data = dev->data;
+
+	if (!atomic_cas(&data->busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	data->cb = cb;
+	data->user_data = user_data;
+
+	/*
+	 * The last measurement is kept until the first one at the new
+	 * measurement time is over, and the very first is waited for.
+	 */
+	if (k_uptime_get() < data->ready_ms) {
+		if (data->raw_mtreg) {
+			bh1750_async_done(data, 0);
+			return 0;
+		}
+
+		data->step = BH1750_STEP_POWER_ON;
+		k_timer_start(&data->timer, K_TIMEOUT_ABS_MS(data->ready_ms),
+			      K_NO_WAIT);
+		return 0;
+	}
+
+	bh1750_async_read(data);
+
+	return 0;
+}
+
+static void bh1750_sync_cb(const struct device *dev, int result,
+			   void *user_data)
+{
+	struct bh1750_data *data = dev->data;
+
+	data->result = result;
+	k_sem_give(&data->sem);
+}
+
+static int bh1750_sample_fetch(const struct device *dev,
+			       enum sensor_channel chan)
+{
+	struct bh1750_data *data = dev->data;
+	int ret;
+
+	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_LIGHT);
+
+	ret = bh1750_sample_fetch_async(dev, bh1750_sync_cb, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_sem_take(&data->sem, K_FOREVER);
+
+	return data->result;
+}
+#else
+static int bh1750_sample_fetch(const struct device *dev,
+			       enum sensor_channel chan)
+{
+	struct bh1750_data *data = dev->data;
+	uint8_t buf[2];
+	uint8_t mtreg;
+	int ret;
+
+	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL || chan == SENSOR_CHAN_LIGHT);
+
+	/*
+	 * The last measurement is kept until the first one at the new
+	 * measurement time is over, and the very first is waited for.
+	 */
+	if (k_uptime_get() < data->ready_ms) {
+		if (data->raw_mtreg) {
+			return 0;
+		}
+
+		k_sleep(K_TIMEOUT_ABS_MS(data->ready_ms));
+	}
+
+	ret = bh1750_read(dev, buf, sizeof(buf));
+	if (ret < 0) {
+		LOG_DBG("Read failed: %d", ret);
+		return ret;
+	}
+	data->raw_val = sys_get_be16(buf);
+	data->raw_mtreg = data->mtreg;
+
+	mtreg = bh1750_mtreg_next(data->raw_val, data->mtreg);
+	if (mtreg == data->mtreg) {
+		return 0;
+	}
+
+	ret = bh1750_mtreg_write(dev, mtreg);
+	if (ret < 0) {
+		LOG_DBG("Measurement time change failed: %d", ret);
+		return ret;
+	}
+	data->mtreg = mtreg;
+	data->ready_ms = bh1750_ready_ms(mtreg);
+
+	return 0;
+}
+#endif
+
+static __hotpath int bh1750_channel_get(const struct device *dev,
+					enum sensor_channel chan,
+					struct sensor_value *val)
+{
+	struct bh1750_data *data = dev->data;
+	uint32_t tmp;
+
+	if (chan != SENSOR_CHAN_LIGHT) {
+		return -EINVAL;
+	}
+
+	if (data->raw_mtreg == 0) {
+		return -ENODATA;
+	}
+
+	/*
+	 * The documentation says the following about the conversion at
+	 * section Measurement sequence example:
+	 *
+	 * How to calculate when the data High Byte is "10000011" and Low Byte
+	 * is "10010000"
+	 * ( 2^15 + 2^9 + 2^8 + 2^7 + 2^4 ) / 1.2 ≒ 28067 [ lx ]
+	 *
+	 * The count is in proportion to the measurement time, which is 69 by
+	 * default. In thousandths, 1000 * 69 / 1.2 is 57500; its product by
+	 * the 16-bit count fits in 32 bits.
+	 */
+	tmp = (uint32_t)data->raw_val * 57500 / data->raw_mtreg;
+	val->val1 = tmp / 1000;
+	val->val2 = tmp % 1000 * 1000;
+
+	return 0;
+}
+
+static const struct sensor_driver_api bh1750_api_funcs = {
+	.sample_fetch = bh1750_sample_fetch,
+	.channel_get = bh1750_channel_get,
+};
+
+static int bh1750_chip_init(const struct device *dev)
+{
+	const struct bh1750_config *cfg = dev->config;
+	struct bh1750_data *data = dev->data;
+	int ret;
+
+	ret = bh1750_is_ready(dev);
+	if (ret < 0) {
+		LOG_DBG("I2C bus check failed: %d", ret);
+		return ret;
+	}
+
+#if defined(CONFIG_I2C_QUEUE)
+	data->dev = dev;
+	data->req.spec = &cfg->i2c;
+	data->req.msgs = &data->msg;
+	data->req.num_msgs = 1;
+	data->req.cb = bh1750_req_cb;
+	k_timer_init(&data->timer, bh1750_timer_expiry, NULL);
+	k_work_init(&data->error_work, bh1750_error_work);
+	k_sem_init(&data->sem, 0, 1);
+#endif
+
+	ret = bh1750_write(dev, BH1750_POWER_ON);
+	if (ret < 0) {
+		LOG_DBG("Power on failed: %d", ret);
+		return ret;
+	}
+
+	data->mtreg = CLAMP(cfg->mtreg, BH1750_MTREG_MIN, BH1750_MTREG_MAX);
+	ret = bh1750_mtreg_write(dev, data->mtreg);
+	if (ret < 0) {
+		LOG_DBG("Continuous measurement failed: %d", ret);
+		return ret;
+	}
+
+	/*
+	 * Do not wait for the first measurement, not to hold the boot; the
+	 * first fetch does.
+	 */
+	data->ready_ms = bh1750_ready_ms(data->mtreg);
+
+	LOG_DBG("\"%s\" OK", dev->name);
+	return 0;
+}
+
+#define BH1750_DEFINE(inst)						\
+	static struct bh1750_data bh1750_data_##inst;			\
+	static const struct bh1750_config bh1750_config_##inst = {	\
+		.i2c = I2C_DT_SPEC_INST_GET(inst),			\
+		.mtreg = DT_INST_PROP_OR(inst, mtreg,			\
+					 BH1750_MTREG_DEFAULT),		\
+	};								\
+									\
+	DEVICE_DT_INST_DEFINE(inst,					\
+			 bh1750_chip_init,				\
+			 NULL,						\
+			 &bh1750_data_##inst,				\
+			 &bh1750_config_##inst,				\
+			 POST_KERNEL,					\
+			 CONFIG_SENSOR_INIT_PRIORITY,			\
+			 &bh1750_api_funcs);
+
+/* Create the struct device for every status "okay" node in the devicetree. */
+DT_INST_FOREACH_STATUS_OKAY(BH1750_DEFINE)
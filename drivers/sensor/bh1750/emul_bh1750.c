@@ -0,0 +1,173 @@
+/* emul_bh1750.c - Emulator for BH1750 ambient light sensor */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT rohm_bh1750
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/logging/log.h>
+
+#include "emul_bh1750.h"
+
+LOG_MODULE_REGISTER(BH1750_EMUL, CONFIG_SENSOR_LOG_LEVEL);
+
+#define BH1750_POWER_DOWN                       0x00
+#define BH1750_POWER_ON                         0x01
+#define BH1750_RESET                            0x07
+#define BH1750_CONTINUOUS_HIGH_RESOLUTION_MODE  0x10
+#define BH1750_CHANGE_MEASUREMENT_TIME_HIGH_BIT 0x40
+#define BH1750_CHANGE_MEASUREMENT_TIME_LOW_BIT  0x60
+
+#define BH1750_MTREG_DEFAULT 69
+
+struct bh1750_emul_data {
+	uint32_t mlx;
+	bool powered;
+	/* Measurement time register */
+	uint8_t mtreg;
+	/* Measurement time of the running measurement, 0 if none */
+	uint8_t measure_mtreg;
+	int fail_writes;
+};
+
+void bh1750_emul_set_light(const struct emul *target, uint32_t mlx)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	data->mlx = mlx;
+}
+
+uint8_t bh1750_emul_get_mtreg(const struct emul *target)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	return data->measure_mtreg;
+}
+
+void bh1750_emul_fail_writes(const struct emul *target, int count)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	data->fail_writes = count;
+}
+
+/*
+ * The count is the light times 1.2 in high resolution mode, in proportion to
+ * the measurement time; it saturates at 16 bits.
+ */
+static uint16_t bh1750_emul_count(struct bh1750_emul_data *data)
+{
+	uint64_t count;
+
+	count = (uint64_t)data->mlx * 12 * data->measure_mtreg /
+		(BH1750_MTREG_DEFAULT * 10000);
+
+	return MIN(count, UINT16_MAX);
+}
+
+static int bh1750_emul_write(const struct emul *target, uint8_t cmd)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	if (data->fail_writes) {
+		data->fail_writes--;
+		return -EIO;
+	}
+
+	if ((cmd & 0xf8) == BH1750_CHANGE_MEASUREMENT_TIME_HIGH_BIT) {
+		data->mtreg = (data->mtreg & 0x1f) | ((cmd & 0x07) << 5);
+		return 0;
+	}
+
+	if ((cmd & 0xe0) == BH1750_CHANGE_MEASUREMENT_TIME_LOW_BIT) {
+		data->mtreg = (data->mtreg & 0xe0) | (cmd & 0x1f);
+		return 0;
+	}
+
+	switch (cmd) {
+	case BH1750_POWER_DOWN:
+		data->powered = false;
+		data->measure_mtreg = 0;
+		break;
+	case BH1750_POWER_ON:
+		data->powered = true;
+		break;
+	case BH1750_RESET:
+		break;
+	case BH1750_CONTINUOUS_HIGH_RESOLUTION_MODE:
+		if (!data->powered) {
+			LOG_ERR("Measurement while powered down");
+			return -EIO;
+		}
+
+		/* The measurement time applies from the mode on */
+		data->measure_mtreg = data->mtreg;
+		break;
+	default:
+		LOG_ERR("Unsupported command 0x%02x", cmd);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int bh1750_emul_transfer(const struct emul *target,
+				struct i2c_msg *msgs, int num_msgs, int addr)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	if (num_msgs != 1) {
+		LOG_ERR("Unsupported transfer of %d messages", num_msgs);
+		return -EIO;
+	}
+
+	if (msgs->flags & I2C_MSG_READ) {
+		if (msgs->len != 2) {
+			return -EIO;
+		}
+
+		sys_put_be16(bh1750_emul_count(data), msgs->buf);
+		return 0;
+	}
+
+	if (msgs->len != 1) {
+		return -EIO;
+	}
+
+	return bh1750_emul_write(target, msgs->buf[0]);
+}
+
+static const struct i2c_emul_api bh1750_emul_api_i2c = {
+	.transfer = bh1750_emul_transfer,
+};
+
+static int bh1750_emul_init(const struct emul *target,
+			    const struct device *parent)
+{
+	struct bh1750_emul_data *data = target->data;
+
+	ARG_UNUSED(parent);
+
+	data->mtreg = BH1750_MTREG_DEFAULT;
+
+	return 0;
+}
+
+#define BH1750_EMUL(inst)						\
+	static struct bh1750_emul_data bh1750_emul_data_##inst;	\
+									\
+	EMUL_DT_INST_DEFINE(inst, bh1750_emul_init,			\
+			    &bh1750_emul_data_##inst, NULL,		\
+			    &bh1750_emul_api_i2c)
+
+DT_INST_FOREACH_STATUS_OKAY(BH1750_EMUL)
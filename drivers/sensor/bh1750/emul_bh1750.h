@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_BH1750_EMUL_BH1750_H_
+#define ZEPHYR_DRIVERS_SENSOR_BH1750_EMUL_BH1750_H_
+
+#include <zephyr/drivers/emul.h>
+
+/**
+ * @brief Set the light the emulated sensor measures.
+ *
+ * @param target BH1750 emulator.
+ * @param mlx Light, in millilux.
+ */
+void bh1750_emul_set_light(const struct emul *target, uint32_t mlx);
+
+/**
+ * @brief Get the measurement time of the running measurement.
+ *
+ * @param target BH1750 emulator.
+ *
+ * @return Measurement time register value, 0 if not measuring.
+ */
+uint8_t bh1750_emul_get_mtreg(const struct emul *target);
+
+/**
+ * @brief Fail the next writes to the emulated sensor.
+ *
+ * @param target BH1750 emulator.
+ * @param count Number of writes to fail with -EIO.
+ */
+void bh1750_emul_fail_writes(const struct emul *target, int count);
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_BH1750_EMUL_BH1750_H_ */
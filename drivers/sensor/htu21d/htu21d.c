@@ -13,9 +13,13 @@
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/drivers/i2c.h>
+#if defined(CONFIG_I2C_QUEUE)
+#include <zephyr/drivers/i2c_queue.h>
+#include <zephyr/drivers/sensor/htu21d.h>
+#endif
 #include <zephyr/init.h>
 #include <zephyr/sys/byteorder.h>
-#include <zephyr/sys/crc.h>
+#include <zephyr/sys/hotpath.h>
 #include <zephyr/sys/__assert.h>
 
 #include <zephyr/logging/log.h>
@@ -34,9 +38,48 @@ LOG_MODULE_REGISTER(HTU21D, CONFIG_SENSOR_LOG_LEVEL);
 #define HTU21D_READ_USER_REGISTER                     0xE7
 #define HTU21D_SOFT_RESET                             0xFE
 
+#define HTU21D_SOFT_RESET_MS              15 /* Max */
+#define HTU21D_HUMIDITY_MEASUREMENT_MS    16 /* Max at 12 bit resolution */
+#define HTU21D_TEMPERATURE_MEASUREMENT_MS 50 /* Max at 14 bit resolution */
+
+/* The two status bits of the LSB tell the measurement type */
+#define HTU21D_STATUS_MASK        0x03
+#define HTU21D_STATUS_TEMPERATURE 0x00
+#define HTU21D_STATUS_HUMIDITY    0x02
+
+#if defined(CONFIG_I2C_QUEUE)
+/* Every measurement is a command, a conversion, then a read */
+enum htu21d_step {
+	HTU21D_STEP_HUMIDITY_COMMAND,
+	HTU21D_STEP_HUMIDITY_READ,
+	HTU21D_STEP_TEMPERATURE_COMMAND,
+	HTU21D_STEP_TEMPERATURE_READ,
+	/* The soft reset is still running */
+	HTU21D_STEP_RESET,
+};
+#endif
+
 struct htu21d_data {
 	uint16_t humidity_raw_val;
 	uint16_t temperature_raw_val;
+	/* End of the soft reset issued at init */
+	int64_t ready_ms;
+#if defined(CONFIG_I2C_QUEUE)
+	const struct device *dev;
+	struct i2c_queue_req req;
+	struct i2c_msg msg;
+	uint8_t cmd;
+	uint8_t buf[3];
+	enum htu21d_step step;
+	struct k_timer timer;
+	struct k_work error_work;
+	int error;
+	atomic_t busy;
+	htu21d_fetch_cb_t cb;
+	void *user_data;
+	struct k_sem sem;
+	int result;
+#endif
 };
 
 struct htu21d_config {
@@ -54,7 +97,11 @@ static inline int htu21d_read(const struct device *dev, uint8_t *buf, int size)
 {
 	const struct htu21d_config *cfg = dev->config;
 
+#if defined(CONFIG_I2C_QUEUE)
+	return i2c_queue_read(&cfg->i2c, buf, size);
+#else
 	return i2c_read_dt(&cfg->i2c, buf, size);
+#endif
 }
 
 static inline int htu21d_write(const struct device *dev, uint8_t val)
@@ -62,24 +109,231 @@ static inline int htu21d_write(const struct device *dev, uint8_t val)
 	const struct htu21d_config *cfg = dev->config;
 	uint8_t buf = val;
 
+#if defined(CONFIG_I2C_QUEUE)
+	return i2c_queue_write(&cfg->i2c, &buf, sizeof(buf));
+#else
 	return i2c_write_dt(&cfg->i2c, &buf, sizeof(buf));
+#endif
 }
 
-static uint8_t htu21d_compute_crc(uint16_t value)
+/*
+ * CRC-8 of polynomial x^8 + x^5 + x^4 + 1, computed in place rather than by
+ * crc8(), so that the hot path does not call out to the flash.
+ */
+static __hotpath uint8_t htu21d_compute_crc(uint16_t value)
 {
-	uint8_t buf[2];
+	uint8_t crc = 0;
+	int i, j;
+
+	for (i = 8; i >= 0; i -= 8) {
+		crc ^= value >> i;
+		for (j = 0; j < 8; j++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+		}
+	}
 
-	sys_put_be16(value, buf);
-	return crc8(buf, 2, 0x31, 0x00, false);
+	return crc;
 }
 
-static int htu21d_humidity_fetch(const struct device *dev)
+static __hotpath int htu21d_parse(const uint8_t *buf, uint8_t status)
 {
-	uint8_t buf[3];
 	uint16_t tmp;
 	uint8_t crc;
 	int ret;
 
+	tmp = sys_get_be16(&buf[0]);
+	crc = htu21d_compute_crc(tmp);
+	if (crc != buf[2]) {
+		LOG_DBG("CRC invalid: %02x, expected: %02x", crc, buf[2]);
+		return -1;
+	}
+
+	/* Check for the status */
+	ret = buf[1] & HTU21D_STATUS_MASK;
+	if (ret != status) {
+		LOG_DBG("Status invalid: %d, expected: %d", ret, status);
+		return -1;
+	}
+
+	/* The status bits are cleared before the conversion */
+	return tmp & ~HTU21D_STATUS_MASK;
+}
+
+#if defined(CONFIG_I2C_QUEUE)
+static __hotpath void htu21d_async_done(struct htu21d_data *data,
+					int result)
+{
+	htu21d_fetch_cb_t cb = data->cb;
+
+	atomic_clear(&data->busy);
+	cb(data->dev, result, data->user_data);
+}
+
+static void htu21d_error_work(struct k_work *work)
+{
+	struct htu21d_data *data = CONTAINER_OF(work, struct htu21d_data,
+						error_work);
+
+	htu21d_async_done(data, data->error);
+}
+
+/*
+ * A submit fails from the timer expiry too, i.e. an ISR; the user callback is
+ * called from the system work queue instead.
+ */
+static __hotpath void htu21d_async_error(struct htu21d_data *data, int error)
+{
+	data->error = error;
+	k_work_submit(&data->error_work);
+}
+
+static __hotpath void htu21d_async_command(struct htu21d_data *data,
+					   uint8_t cmd)
+{
+	int ret;
+
+	data->cmd = cmd;
+	data->msg.buf = &data->cmd;
+	data->msg.len = sizeof(data->cmd);
+	data->msg.flags = I2C_MSG_WRITE | I2C_MSG_STOP;
+	ret = i2c_queue_submit(&data->req);
+	if (ret < 0) {
+		htu21d_async_error(data, ret);
+	}
+}
+
+/* The conversion is over; read the measurement */
+static __hotpath void htu21d_timer_expiry(struct k_timer *timer)
+{
+	struct htu21d_data *data = CONTAINER_OF(timer, struct htu21d_data,
+						timer);
+	int ret;
+
+	if (data->step == HTU21D_STEP_RESET) {
+		data->step = HTU21D_STEP_HUMIDITY_COMMAND;
+		htu21d_async_command(data,
+			HTU21D_HUMIDITY_MEASUREMENT_NO_HOLD_MASTER);
+		return;
+	}
+
+	data->step++;
+	data->msg.buf = data->buf;
+	data->msg.len = sizeof(data->buf);
+	data->msg.flags = I2C_MSG_READ | I2C_MSG_STOP;
+	ret = i2c_queue_submit(&data->req);
+	if (ret < 0) {
+		htu21d_async_error(data, ret);
+	}
+}
+
+static __hotpath void htu21d_req_cb(struct i2c_queue_req *req, int result)
+{
+	struct htu21d_data *data = CONTAINER_OF(req, struct htu21d_data, req);
+	int ret;
+
+	if (result < 0) {
+		LOG_DBG("Step %d failed: %d", data->step, result);
+		htu21d_async_done(data, result);
+		return;
+	}
+
+	switch (data->step) {
+	case HTU21D_STEP_HUMIDITY_COMMAND:
+		k_timer_start(&data->timer,
+			      K_MSEC(HTU21D_HUMIDITY_MEASUREMENT_MS), K_NO_WAIT);
+		break;
+	case HTU21D_STEP_HUMIDITY_READ:
+		ret = htu21d_parse(data->buf,
+				   HTU21D_STATUS_HUMIDITY);
+		if (ret < 0) {
+			htu21d_async_done(data, ret);
+			break;
+		}
+		data->humidity_raw_val = ret;
+
+		data->step = HTU21D_STEP_TEMPERATURE_COMMAND;
+		htu21d_async_command(data,
+			HTU21D_TEMPERATURE_MEASUREMENT_NO_HOLD_MASTER);
+		break;
+	case HTU21D_STEP_TEMPERATURE_COMMAND:
+		k_timer_start(&data->timer,
+			      K_MSEC(HTU21D_TEMPERATURE_MEASUREMENT_MS),
+			      K_NO_WAIT);
+		break;
+	case HTU21D_STEP_TEMPERATURE_READ:
+		ret = htu21d_parse(data->buf,
+				   HTU21D_STATUS_TEMPERATURE);
+		if (ret < 0) {
+			htu21d_async_done(data, ret);
+			break;
+		}
+		data->temperature_raw_val = ret;
+
+		htu21d_async_done(data, 0);
+		break;
+	case HTU21D_STEP_RESET:
+		break;
+	}
+}
+
+int htu21d_sample_fetch_async(const struct device *dev, htu21d_fetch_cb_t cb,
+			      void *user_data)
+{
+	struct htu21d_data *data = dev->data;
+
+	if (!atomic_cas(&data->busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	data->cb = cb;
+	data->user_data = user_data;
+
+	/* The first measurement waits for the end of the soft reset */
+	if (k_uptime_get() < data->ready_ms) {
+		data->step = HTU21D_STEP_RESET;
+		k_timer_start(&data->timer, K_TIMEOUT_ABS_MS(data->ready_ms),
+			      K_NO_WAIT);
+		return 0;
+	}
+
+	data->step = HTU21D_STEP_HUMIDITY_COMMAND;
+	htu21d_async_command(data, HTU21D_HUMIDITY_MEASUREMENT_NO_HOLD_MASTER);
+
+	return 0;
+}
+
+static void htu21d_sync_cb(const struct device *dev, int result,
+			   void *user_data)
+{
+	struct htu21d_data *data = dev->data;
+
+	data->result = result;
+	k_sem_give(&data->sem);
+}
+
+static int htu21d_sample_fetch(const struct device *dev,
+			       enum sensor_channel chan)
+{
+	struct htu21d_data *data = dev->data;
+	int ret;
+
+	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
+
+	ret = htu21d_sample_fetch_async(dev, htu21d_sync_cb, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_sem_take(&data->sem, K_FOREVER);
+
+	return data->result;
+}
+#else
+static int htu21d_humidity_fetch(const struct device *dev)
+{
+	uint8_t buf[3];
+	int ret;
+
 	ret = htu21d_write(dev, HTU21D_HUMIDITY_MEASUREMENT_NO_HOLD_MASTER);
 	if (ret < 0) {
 		LOG_DBG("Humidity measurement failed: %d", ret);
@@ -87,7 +341,7 @@ static int htu21d_humidity_fetch(const struct device *dev)
 	}
 
 	/* Wait for the measure to be ready */
-	k_sleep(K_MSEC(16)); /* Max at 12 bit resolution */
+	k_sleep(K_MSEC(HTU21D_HUMIDITY_MEASUREMENT_MS));
 
 	ret = htu21d_read(dev, buf, sizeof(buf));
 	if (ret < 0) {
@@ -95,28 +349,12 @@ static int htu21d_humidity_fetch(const struct device *dev)
 		return ret;
 	}
 
-	/* Check for the status */
-	ret = buf[1] & 0x03;
-	if (ret == 0x11) {
-		LOG_DBG("Status failed: %d", ret);
-		return -1;
-	}
-
-	tmp = sys_get_be16(&buf[0]);
-	crc = htu21d_compute_crc(tmp);
-	if (crc != buf[2]) {
-		LOG_DBG("CRC invalid: %02x, expected: %02x", crc, buf[2]);
-		return -1;
-	}
-
-	return tmp;
+	return htu21d_parse(buf, HTU21D_STATUS_HUMIDITY);
 }
 
 static int htu21d_temperature_fetch(const struct device *dev)
 {
 	uint8_t buf[3];
-	uint16_t tmp;
-	uint8_t crc;
 	int ret;
 
 	ret = htu21d_write(dev, HTU21D_TEMPERATURE_MEASUREMENT_NO_HOLD_MASTER);
@@ -126,7 +364,7 @@ static int htu21d_temperature_fetch(const struct device *dev)
 	}
 
 	/* Wait for the measure to be ready */
-	k_sleep(K_MSEC(50)); /* Max at 14 bit resolution */
+	k_sleep(K_MSEC(HTU21D_TEMPERATURE_MEASUREMENT_MS));
 
 	ret = htu21d_read(dev, buf, sizeof(buf));
 	if (ret < 0) {
@@ -134,21 +372,7 @@ static int htu21d_temperature_fetch(const struct device *dev)
 		return ret;
 	}
 
-	/* Check for the status */
-	ret = buf[1] & 0x03;
-	if (ret == 0x11) {
-		LOG_DBG("Status failed: %d", ret);
-		return -1;
-	}
-
-	tmp = sys_get_be16(&buf[0]);
-	crc = htu21d_compute_crc(tmp);
-	if (crc != buf[2]) {
-		LOG_DBG("CRC invalid: %02x, expected: %02x", crc, buf[2]);
-		return -1;
-	}
-
-	return tmp;
+	return htu21d_parse(buf, HTU21D_STATUS_TEMPERATURE);
 }
 
 static int htu21d_sample_fetch(const struct device *dev,
@@ -159,6 +383,11 @@ static int htu21d_sample_fetch(const struct device *dev,
 
 	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
 
+	/* The first measurement waits for the end of the soft reset */
+	if (k_uptime_get() < data->ready_ms) {
+		k_sleep(K_TIMEOUT_ABS_MS(data->ready_ms));
+	}
+
 	ret = htu21d_humidity_fetch(dev);
 	if (ret < 0) {
 		return ret;
@@ -173,13 +402,14 @@ static int htu21d_sample_fetch(const struct device *dev,
 
 	return 0;
 }
+#endif
 
-static int htu21d_channel_get(const struct device *dev,
-			      enum sensor_channel chan,
-			      struct sensor_value *val)
+static __hotpath int htu21d_channel_get(const struct device *dev,
+					enum sensor_channel chan,
+					struct sensor_value *val)
 {
 	struct htu21d_data *data = dev->data;
-	long long tmp;
+	int32_t tmp;
 
 	switch (chan) {
 	case SENSOR_CHAN_HUMIDITY:
@@ -194,9 +424,14 @@ static int htu21d_channel_get(const struct device *dev,
 		 * %RH), no matter which resolution is chosen:
 		 *
 		 * RH = -6 + 125 * SRH / 2^16
+		 *
+		 * In millionths, 125000000 / 2^16 is 1953125 / 2^10; only the
+		 * product needs 64 bits, the result is split to 32 bits before
+		 * the divisions, so that the 64-bit divisions of the libgcc are
+		 * left out of the hot path.
 		 */
-		tmp = data->humidity_raw_val;
-		tmp = ((125000000LL * tmp) / 65536LL) - 6000000LL;
+		tmp = (int32_t)(((int64_t)data->humidity_raw_val * 1953125) >>
+				10) - 6000000;
 		val->val1 = tmp / 1000000;
 		val->val2 = tmp % 1000000;
 		break;
@@ -212,9 +447,11 @@ static int htu21d_channel_get(const struct device *dev,
 		 * °C), no matter which resolution is chosen:
 		 *
 		 * temp = -46.85 + 175.72 * Stemp / 2^16
+		 *
+		 * In millionths, 175720000 / 2^16 is 2745625 / 2^10.
 		 */
-		tmp = data->temperature_raw_val;
-		tmp = ((175720000LL * tmp) / 65636LL) - 46850000LL;
+		tmp = (int32_t)(((int64_t)data->temperature_raw_val * 2745625) >>
+				10) - 46850000;
 		val->val1 = tmp / 1000000;
 		val->val2 = tmp % 1000000;
 		break;
@@ -232,6 +469,10 @@ static const struct sensor_driver_api htu21d_api_funcs = {
 
 static int htu21d_chip_init(const struct device *dev)
 {
+#if defined(CONFIG_I2C_QUEUE)
+	const struct htu21d_config *cfg = dev->config;
+#endif
+	struct htu21d_data *data = dev->data;
 	int ret;
 
 	ret = htu21d_is_ready(dev);
@@ -240,14 +481,28 @@ static int htu21d_chip_init(const struct device *dev)
 		return ret;
 	}
 
+#if defined(CONFIG_I2C_QUEUE)
+	data->dev = dev;
+	data->req.spec = &cfg->i2c;
+	data->req.msgs = &data->msg;
+	data->req.num_msgs = 1;
+	data->req.cb = htu21d_req_cb;
+	k_timer_init(&data->timer, htu21d_timer_expiry, NULL);
+	k_work_init(&data->error_work, htu21d_error_work);
+	k_sem_init(&data->sem, 0, 1);
+#endif
+
 	ret = htu21d_write(dev, HTU21D_SOFT_RESET);
 	if (ret < 0) {
 		LOG_DBG("Soft reset failed: %d", ret);
 		return ret;
 	}
 
-	/* Wait for the sensor to be ready */
-	k_sleep(K_MSEC(15)); /* The soft reset takes less than 15ms */
+	/*
+	 * Do not wait for the sensor to be ready, not to hold the boot; the
+	 * first measurement does.
+	 */
+	data->ready_ms = k_uptime_get() + HTU21D_SOFT_RESET_MS;
 
 	LOG_DBG("\"%s\" OK", dev->name);
 	return 0;
@@ -0,0 +1,704 @@
+/* replay.c - Replay sensors emulating parts from recorded traces */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/sensor/replay.h>
+#if defined(CONFIG_FCB)
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+#endif
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(REPLAY, CONFIG_SENSOR_LOG_LEVEL);
+
+#define REPLAY_LINE_MAX 80
+
+struct replay_config {
+	const enum sensor_channel *channels;
+	uint8_t num_channels;
+	const char *file;
+	int partition;
+	uint32_t speedup;
+	bool loop;
+};
+
+struct replay_data {
+	const struct device *dev;
+	struct k_mutex lock;
+
+	/* Source */
+#if defined(CONFIG_ARCH_POSIX)
+	int fd;
+	char line[REPLAY_LINE_MAX];
+	size_t len;
+#endif
+#if defined(CONFIG_FCB)
+	struct fcb fcb;
+	struct flash_sector sectors[CONFIG_REPLAY_SENSOR_FCB_SECTOR_COUNT];
+	struct fcb_entry loc;
+#endif
+	int (*read)(const struct device *dev, struct replay_record *record);
+	int (*rewind)(const struct device *dev);
+
+	/* Trace time, at the speed-up of the uptime since the base */
+	uint32_t speedup;
+	uint64_t base_us;
+	uint64_t base_time_us;
+	uint64_t offset;
+	uint64_t first;
+	uint32_t period;
+
+	struct replay_record current;
+	struct replay_record next;
+	bool has_next;
+	struct replay_record sample;
+
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+	struct k_timer timer;
+	struct k_work work;
+	sensor_trigger_handler_t handler;
+	const struct sensor_trigger *trigger;
+#endif
+
+	struct replay_stats stats;
+};
+
+#if defined(CONFIG_ARCH_POSIX)
+/* Parse the next line of the file; returns -ENODATA at its end */
+static int replay_file_read(const struct device *dev,
+			    struct replay_record *record)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	char *eol, *p, *end;
+	ssize_t ret;
+	uint8_t i;
+
+	while (1) {
+		eol = memchr(data->line, '\n', data->len);
+		if (eol == NULL) {
+			if (data->len == sizeof(data->line)) {
+				LOG_ERR("%s: Line too long", dev->name);
+				return -EINVAL;
+			}
+
+			ret = read(data->fd, &data->line[data->len],
+				   sizeof(data->line) - data->len);
+			if (ret < 0) {
+				return -EIO;
+			} else if (ret == 0) {
+				if (data->len == 0) {
+					return -ENODATA;
+				}
+
+				/* The last line may lack its end */
+				eol = &data->line[data->len];
+				data->len++;
+			} else {
+				data->len += ret;
+				continue;
+			}
+		}
+
+		*eol = '\0';
+		p = data->line;
+		ret = 0;
+		if ((*p != '#') && (*p != '\0')) {
+			record->timestamp = strtoull(p, &end, 10);
+			for (i = 0; (i < cfg->num_channels) && (end != p); i++) {
+				p = end + (*end == ',');
+				record->values[i] = strtol(p, &end, 10);
+			}
+			ret = (end == p) ? -EINVAL : 1;
+		}
+
+		data->len -= eol + 1 - data->line;
+		memmove(data->line, eol + 1, data->len);
+
+		if (ret < 0) {
+			LOG_WRN("%s: Malformed line", dev->name);
+		} else if (ret > 0) {
+			return 0;
+		}
+	}
+}
+
+static int replay_file_rewind(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+
+	data->len = 0;
+	if (lseek(data->fd, 0, SEEK_SET) < 0) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int replay_file_open(const struct device *dev)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+
+	data->fd = open(cfg->file, O_RDONLY);
+	if (data->fd < 0) {
+		LOG_ERR("%s: Failed to open %s", dev->name, cfg->file);
+		return -ENOENT;
+	}
+
+	data->read = replay_file_read;
+	data->rewind = replay_file_rewind;
+
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_FCB)
+static int replay_fcb_read(const struct device *dev,
+			   struct replay_record *record)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	uint8_t buf[sizeof(uint32_t) * (1 + REPLAY_CHANNELS_MAX)];
+	size_t len = sizeof(uint32_t) * (1 + cfg->num_channels);
+	uint8_t i;
+	int ret;
+
+	do {
+		ret = fcb_getnext(&data->fcb, &data->loc);
+		if (ret) {
+			return -ENODATA;
+		}
+	} while (data->loc.fe_data_len != len);
+
+	ret = flash_area_read(data->fcb.fap, FCB_ENTRY_FA_DATA_OFF(data->loc),
+			      buf, len);
+	if (ret) {
+		return ret;
+	}
+
+	record->timestamp = sys_get_le32(buf);
+	for (i = 0; i < cfg->num_channels; i++) {
+		record->values[i] = sys_get_le32(&buf[sizeof(uint32_t) *
+						      (1 + i)]);
+	}
+
+	return 0;
+}
+
+static int replay_fcb_rewind(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+
+	memset(&data->loc, 0, sizeof(data->loc));
+
+	return 0;
+}
+
+static int replay_fcb_open(const struct device *dev)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	const struct flash_parameters *fp;
+	const struct flash_area *fa;
+	uint32_t cnt = ARRAY_SIZE(data->sectors);
+	int ret;
+
+	ret = flash_area_open(cfg->partition, &fa);
+	if (ret) {
+		LOG_ERR("%s: Failed to open flash area: %d", dev->name, ret);
+		return ret;
+	}
+
+	fp = flash_get_parameters(fa->fa_dev);
+	flash_area_close(fa);
+	if (fp == NULL) {
+		return -ENODEV;
+	}
+
+	ret = flash_area_get_sectors(cfg->partition, &cnt, data->sectors);
+	if (ret && ret != -ENOMEM) {
+		LOG_ERR("%s: Failed to get flash sectors: %d", dev->name, ret);
+		return ret;
+	}
+
+	data->fcb.f_magic = 0xfcb1fcb1;
+	data->fcb.f_version = 1;
+	data->fcb.f_sector_cnt = cnt;
+	data->fcb.f_scratch_cnt = 1;
+	data->fcb.f_sectors = data->sectors;
+	data->fcb.f_erase_value = fp->erase_value;
+	ret = fcb_init(cfg->partition, &data->fcb);
+	if (ret) {
+		LOG_ERR("%s: Failed to init fcb: %d", dev->name, ret);
+		return ret;
+	}
+
+	data->read = replay_fcb_read;
+	data->rewind = replay_fcb_rewind;
+
+	return 0;
+}
+#endif
+
+static uint64_t replay_uptime_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/* In us, not to lose the sub-millisecond periods at high speed-ups */
+static uint64_t replay_time_us(struct replay_data *data)
+{
+	return data->base_time_us +
+	       (replay_uptime_us() - data->base_us) * data->speedup;
+}
+
+/* Read the next record, restarting the trace after its last one if looping */
+static void replay_read_next(const struct device *dev)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	struct replay_record record;
+	int ret;
+
+	ret = data->read(dev, &record);
+	if ((ret == -ENODATA) && cfg->loop && data->stats.records) {
+		data->offset = data->current.timestamp + data->period;
+		data->stats.loops++;
+		ret = data->rewind(dev);
+		if (ret == 0) {
+			ret = data->read(dev, &record);
+		}
+
+		if (ret == 0) {
+			data->first = record.timestamp;
+		}
+	}
+
+	data->has_next = ret == 0;
+	if (!data->has_next) {
+		return;
+	}
+
+	if (data->stats.records == 0) {
+		data->first = record.timestamp;
+	}
+
+	/* The trace restarts one first interval after its last record */
+	record.timestamp = record.timestamp - data->first + data->offset;
+	if (data->stats.records == 1) {
+		data->period = MAX(record.timestamp - data->next.timestamp, 1);
+	}
+
+	data->stats.records++;
+	data->next = record;
+}
+
+/* Move to the last record due at the trace time; returns how many */
+static uint32_t replay_advance(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+	uint64_t time = replay_time_us(data) / USEC_PER_MSEC;
+	uint32_t n = 0;
+
+	while (data->has_next && (data->next.timestamp <= time)) {
+		data->current = data->next;
+		replay_read_next(dev);
+		n++;
+	}
+
+	data->stats.time = time;
+
+	return n;
+}
+
+static int replay_sample_fetch(const struct device *dev,
+			       enum sensor_channel chan)
+{
+	struct replay_data *data = dev->data;
+
+	__ASSERT_NO_MSG(chan == SENSOR_CHAN_ALL);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	replay_advance(dev);
+	data->sample = data->current;
+	k_mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+static int replay_channel_get(const struct device *dev,
+			      enum sensor_channel chan,
+			      struct sensor_value *val)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	int32_t value;
+	uint8_t i;
+
+	for (i = 0; i < cfg->num_channels; i++) {
+		if (cfg->channels[i] == chan) {
+			break;
+		}
+	}
+
+	if (i == cfg->num_channels) {
+		return -ENOTSUP;
+	}
+
+	value = data->sample.values[i];
+	val->val1 = value / 1000;
+	val->val2 = (value % 1000) * 1000;
+
+	return 0;
+}
+
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+/* Arm the timer for the next record, scaled back to the real time */
+static void replay_schedule(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+	uint64_t now = replay_time_us(data), due;
+
+	if ((data->handler == NULL) || !data->has_next) {
+		return;
+	}
+
+	due = data->next.timestamp * USEC_PER_MSEC;
+	k_timer_start(&data->timer,
+		      K_USEC(due > now ? (due - now) / data->speedup : 0),
+		      K_NO_WAIT);
+}
+
+static void replay_work_handler(struct k_work *work)
+{
+	struct replay_data *data = CONTAINER_OF(work, struct replay_data,
+						work);
+	const struct device *dev = data->dev;
+	sensor_trigger_handler_t handler;
+	uint32_t n;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	n = replay_advance(dev);
+	if (n > 1) {
+		data->stats.skipped += n - 1;
+	}
+	handler = data->handler;
+	k_mutex_unlock(&data->lock);
+
+	if (n && handler) {
+		data->stats.triggers++;
+		handler(dev, data->trigger);
+	}
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	replay_schedule(dev);
+	k_mutex_unlock(&data->lock);
+}
+
+static void replay_timer_expiry(struct k_timer *timer)
+{
+	struct replay_data *data = CONTAINER_OF(timer, struct replay_data,
+						timer);
+
+	k_work_submit(&data->work);
+}
+
+static int replay_trigger_set(const struct device *dev,
+			      const struct sensor_trigger *trig,
+			      sensor_trigger_handler_t handler)
+{
+	struct replay_data *data = dev->data;
+
+	if (trig->type != SENSOR_TRIG_DATA_READY) {
+		return -ENOTSUP;
+	}
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	data->handler = handler;
+	data->trigger = trig;
+	if (handler) {
+		replay_schedule(dev);
+	} else {
+		k_timer_stop(&data->timer);
+	}
+	k_mutex_unlock(&data->lock);
+
+	return 0;
+}
+#endif
+
+int replay_speedup_set(const struct device *dev, uint32_t speedup)
+{
+	struct replay_data *data = dev->data;
+	uint64_t now;
+
+	if (speedup == 0) {
+		return -EINVAL;
+	}
+
+	/* Keep the trace time, and run on from there */
+	k_mutex_lock(&data->lock, K_FOREVER);
+	now = replay_uptime_us();
+	data->base_time_us = replay_time_us(data);
+	data->base_us = now;
+	data->speedup = speedup;
+	data->stats.speedup = speedup;
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+	replay_schedule(dev);
+#endif
+	k_mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+static int replay_start(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+	int ret;
+
+	ret = data->rewind(dev);
+	if (ret) {
+		return ret;
+	}
+
+	data->offset = 0;
+	data->period = 1;
+	data->stats.records = 0;
+	data->stats.loops = 0;
+	data->has_next = false;
+	memset(&data->current, 0, sizeof(data->current));
+	replay_read_next(dev);
+	if (!data->has_next) {
+		LOG_WRN("%s: Empty trace", dev->name);
+	}
+
+	data->base_us = replay_uptime_us();
+	data->base_time_us = 0;
+
+	return 0;
+}
+
+int replay_rewind(const struct device *dev)
+{
+	struct replay_data *data = dev->data;
+	int ret;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	ret = replay_start(dev);
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+	replay_schedule(dev);
+#endif
+	k_mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+void replay_stats_get(const struct device *dev, struct replay_stats *stats)
+{
+	struct replay_data *data = dev->data;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	*stats = data->stats;
+	k_mutex_unlock(&data->lock);
+}
+
+static const struct sensor_driver_api replay_api_funcs = {
+	.sample_fetch = replay_sample_fetch,
+	.channel_get = replay_channel_get,
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+	.trigger_set = replay_trigger_set,
+#endif
+};
+
+static int replay_init(const struct device *dev)
+{
+	const struct replay_config *cfg = dev->config;
+	struct replay_data *data = dev->data;
+	int ret = -ENODEV;
+
+	data->dev = dev;
+	k_mutex_init(&data->lock);
+	data->speedup = cfg->speedup ? cfg->speedup : 1;
+	data->stats.speedup = data->speedup;
+
+#if defined(CONFIG_REPLAY_SENSOR_TRIGGER)
+	k_timer_init(&data->timer, replay_timer_expiry, NULL);
+	k_work_init(&data->work, replay_work_handler);
+#endif
+
+#if defined(CONFIG_ARCH_POSIX)
+	if (cfg->file) {
+		ret = replay_file_open(dev);
+	}
+#endif
+#if defined(CONFIG_FCB)
+	if ((ret == -ENODEV) && (cfg->partition >= 0)) {
+		ret = replay_fcb_open(dev);
+	}
+#endif
+	if (ret) {
+		LOG_ERR("%s: No trace", dev->name);
+		return ret;
+	}
+
+	return replay_start(dev);
+}
+
+#if defined(CONFIG_REPLAY_SENSOR_SHELL)
+static const struct device *shell_device(const struct shell *shell,
+					 const char *name)
+{
+	const struct device *dev = device_get_binding(name);
+
+	if ((dev == NULL) || (dev->api != &replay_api_funcs)) {
+		shell_error(shell, "%s: No such replay sensor", name);
+		return NULL;
+	}
+
+	return dev;
+}
+
+static int cmd_status(const struct shell *shell, size_t argc, char *argv[])
+{
+	const struct device *dev = shell_device(shell, argv[1]);
+	struct replay_stats stats;
+
+	if (dev == NULL) {
+		return -ENODEV;
+	}
+
+	replay_stats_get(dev, &stats);
+	shell_print(shell, "Speed-up:          %ux", stats.speedup);
+	shell_print(shell, "Trace time:        %llums", stats.time);
+	shell_print(shell, "Records:           %u", stats.records);
+	shell_print(shell, "Loops:             %u", stats.loops);
+	shell_print(shell, "Triggers:          %u", stats.triggers);
+	shell_print(shell, "Skipped:           %u", stats.skipped);
+
+	return 0;
+}
+
+static int cmd_speed(const struct shell *shell, size_t argc, char *argv[])
+{
+	const struct device *dev = shell_device(shell, argv[1]);
+	int ret;
+
+	if (dev == NULL) {
+		return -ENODEV;
+	}
+
+	ret = replay_speedup_set(dev, strtoul(argv[2], NULL, 0));
+	if (ret) {
+		shell_error(shell, "Invalid speed-up");
+		return ret;
+	}
+
+	return 0;
+}
+
+static int cmd_rewind(const struct shell *shell, size_t argc, char *argv[])
+{
+	const struct device *dev = shell_device(shell, argv[1]);
+	int ret;
+
+	if (dev == NULL) {
+		return -ENODEV;
+	}
+
+	ret = replay_rewind(dev);
+	if (ret) {
+		shell_error(shell, "Failed to rewind, ret: %d", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(replay_cmds,
+	SHELL_CMD_ARG(status, NULL, "<device>",           cmd_status, 2, 0),
+	SHELL_CMD_ARG(speed,  NULL, "<device> <speedup>", cmd_speed,  3, 0),
+	SHELL_CMD_ARG(rewind, NULL, "<device>",           cmd_rewind, 2, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_replay(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(replay, &replay_cmds, "Replay sensor commands",
+		       cmd_replay, 2, 0);
+#endif
+
+static const enum sensor_channel replay_bme280_channels[] = {
+	SENSOR_CHAN_AMBIENT_TEMP,
+	SENSOR_CHAN_PRESS,
+};
+
+static const enum sensor_channel replay_bh1750_channels[] = {
+	SENSOR_CHAN_LIGHT,
+};
+
+static const enum sensor_channel replay_htu21d_channels[] = {
+	SENSOR_CHAN_HUMIDITY,
+	SENSOR_CHAN_AMBIENT_TEMP,
+};
+
+#define REPLAY_PARTITION(inst)						\
+	COND_CODE_1(DT_INST_NODE_HAS_PROP(inst, partition),		\
+		    (DT_FIXED_PARTITION_ID(DT_INST_PHANDLE(inst, partition))), \
+		    (-1))
+
+#define REPLAY_DEFINE(inst, part)					\
+	static struct replay_data replay_##part##_data_##inst;		\
+									\
+	static const struct replay_config replay_##part##_config_##inst = { \
+		.channels = replay_##part##_channels,			\
+		.num_channels = ARRAY_SIZE(replay_##part##_channels),	\
+		.file = DT_INST_PROP_OR(inst, file, NULL),		\
+		.partition = REPLAY_PARTITION(inst),			\
+		.speedup = DT_INST_PROP(inst, speedup),			\
+		.loop = DT_INST_PROP(inst, loop),			\
+	};								\
+									\
+	SENSOR_DEVICE_DT_INST_DEFINE(inst, replay_init, NULL,		\
+				     &replay_##part##_data_##inst,	\
+				     &replay_##part##_config_##inst,	\
+				     POST_KERNEL,			\
+				     CONFIG_SENSOR_INIT_PRIORITY,	\
+				     &replay_api_funcs);
+
+#define DT_DRV_COMPAT replay_bme280
+DT_INST_FOREACH_STATUS_OKAY_VARGS(REPLAY_DEFINE, bme280)
+#undef DT_DRV_COMPAT
+
+#define DT_DRV_COMPAT replay_bh1750
+DT_INST_FOREACH_STATUS_OKAY_VARGS(REPLAY_DEFINE, bh1750)
+#undef DT_DRV_COMPAT
+
+#define DT_DRV_COMPAT replay_htu21d
+DT_INST_FOREACH_STATUS_OKAY_VARGS(REPLAY_DEFINE, htu21d)
+#undef DT_DRV_COMPAT
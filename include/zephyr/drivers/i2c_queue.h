@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_I2C_QUEUE_H_
+#define ZEPHYR_INCLUDE_DRIVERS_I2C_QUEUE_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/i2c.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief I2C request queue
+ * @defgroup i2c_queue I2C request queue
+ * @ingroup i2c_interface
+ * @{
+ *
+ * The requests of all the devices are queued to a single bus owner thread,
+ * which runs them back-to-back and calls their completion callback; the
+ * submitters do not block while the bus is busy, nor while a device
+ * converts.
+ */
+
+struct i2c_queue_req;
+
+/**
+ * @brief Completion callback.
+ *
+ * Called from the bus owner thread, so it must be short; it may submit the
+ * next request of a chain.
+ *
+ * @param req Request.
+ * @param result Result of i2c_transfer().
+ */
+typedef void (*i2c_queue_cb_t)(struct i2c_queue_req *req, int result);
+
+/** Request; owned by the queue from submission to completion */
+struct i2c_queue_req {
+	void *fifo_reserved;		/**< Used by the queue */
+	const struct i2c_dt_spec *spec;	/**< Bus and target address */
+	struct i2c_msg *msgs;		/**< Messages */
+	uint8_t num_msgs;		/**< Number of messages */
+	i2c_queue_cb_t cb;		/**< Completion callback */
+	void *user_data;		/**< User argument */
+	uint32_t submit_cycles;		/**< Used by the queue */
+};
+
+/** Queue statistics, since boot */
+struct i2c_queue_stats {
+	uint32_t requests;	/**< Requests completed */
+	uint32_t errors;	/**< Requests failed */
+	uint32_t depth_max;	/**< Most requests pending */
+	uint64_t busy_cycles;	/**< Time spent in transfers */
+	uint64_t wait_cycles;	/**< Time spent queued, summed */
+	uint32_t wait_max_cycles; /**< Longest time spent queued */
+};
+
+/**
+ * @brief Submit a request.
+ *
+ * May be called from an ISR, such as a timer expiry.
+ *
+ * @param req Request, with spec, msgs, num_msgs and cb set.
+ *
+ * @return 0 on success, -EINVAL if the request is incomplete.
+ */
+int i2c_queue_submit(struct i2c_queue_req *req);
+
+/**
+ * @brief Submit a transfer, and wait for its completion.
+ *
+ * Must not be called from an ISR; if called from a completion callback, the
+ * transfer is run right away.
+ *
+ * @param spec Bus and target address.
+ * @param msgs Messages.
+ * @param num_msgs Number of messages.
+ *
+ * @return Result of i2c_transfer().
+ */
+int i2c_queue_transfer(const struct i2c_dt_spec *spec, struct i2c_msg *msgs,
+		       uint8_t num_msgs);
+
+/**
+ * @brief Read from a device through the queue, and wait for completion.
+ */
+static inline int i2c_queue_read(const struct i2c_dt_spec *spec, uint8_t *buf,
+				 uint32_t num_bytes)
+{
+	struct i2c_msg msg = {
+		.buf = buf,
+		.len = num_bytes,
+		.flags = I2C_MSG_READ | I2C_MSG_STOP,
+	};
+
+	return i2c_queue_transfer(spec, &msg, 1);
+}
+
+/**
+ * @brief Write to a device through the queue, and wait for completion.
+ */
+static inline int i2c_queue_write(const struct i2c_dt_spec *spec,
+				  const uint8_t *buf, uint32_t num_bytes)
+{
+	struct i2c_msg msg = {
+		.buf = (uint8_t *)buf,
+		.len = num_bytes,
+		.flags = I2C_MSG_WRITE | I2C_MSG_STOP,
+	};
+
+	return i2c_queue_transfer(spec, &msg, 1);
+}
+
+/**
+ * @brief Get the queue statistics.
+ *
+ * @param stats Statistics.
+ */
+void i2c_queue_stats_get(struct i2c_queue_stats *stats);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_I2C_QUEUE_H_ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_BH1750_H_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_BH1750_H_
+
+#include <zephyr/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fetch completion callback.
+ *
+ * Called from the I2C queue owner thread, or from the system work queue if a
+ * request fails to submit, so it must be short; never from an ISR. Or from
+ * the caller, if the last measurement is kept while the sensor measures with
+ * a new measurement time.
+ *
+ * @param dev BH1750 device.
+ * @param result 0 on success, negative errno code on fail.
+ * @param user_data User argument.
+ */
+typedef void (*bh1750_fetch_cb_t)(const struct device *dev, int result,
+				  void *user_data);
+
+/**
+ * @brief Fetch the light without blocking.
+ *
+ * The last continuous measurement is read through the I2C queue; the channel
+ * may be read with sensor_channel_get() once the callback reports success.
+ *
+ * @param dev BH1750 device.
+ * @param cb Completion callback.
+ * @param user_data User argument.
+ *
+ * @return 0 on success, -EBUSY if a fetch is in progress, negative errno code
+ *	   on fail.
+ */
+int bh1750_sample_fetch_async(const struct device *dev, bh1750_fetch_cb_t cb,
+			      void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_SENSOR_BH1750_H_ */
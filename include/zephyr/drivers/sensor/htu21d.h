@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_HTU21D_H_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_HTU21D_H_
+
+#include <zephyr/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Fetch completion callback.
+ *
+ * Called from the I2C queue owner thread, or from the system work queue if a
+ * request fails to submit, so it must be short; never from an ISR.
+ *
+ * @param dev HTU21D device.
+ * @param result 0 on success, negative errno code on fail.
+ * @param user_data User argument.
+ */
+typedef void (*htu21d_fetch_cb_t)(const struct device *dev, int result,
+				  void *user_data);
+
+/**
+ * @brief Fetch the humidity and the temperature without blocking.
+ *
+ * The measurements are requested through the I2C queue; the channels may be
+ * read with sensor_channel_get() once the callback reports success.
+ *
+ * @param dev HTU21D device.
+ * @param cb Completion callback.
+ * @param user_data User argument.
+ *
+ * @return 0 on success, -EBUSY if a fetch is in progress, negative errno code
+ *	   on fail.
+ */
+int htu21d_sample_fetch_async(const struct device *dev, htu21d_fetch_cb_t cb,
+			      void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_SENSOR_HTU21D_H_ */
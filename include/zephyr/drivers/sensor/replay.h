@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_REPLAY_H_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_REPLAY_H_
+
+#include <zephyr/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Replay sensors
+ * @defgroup replay_sensor Replay sensors
+ * @ingroup sensor_interface
+ * @{
+ *
+ * A replay sensor emulates a part by replaying a recorded trace, either from
+ * a file on native_posix, or from an FCB partition. The trace time runs at
+ * a selectable speed-up of the real time, and the data ready trigger fires
+ * as every record falls due, so that the whole pipeline can be load tested.
+ */
+
+/** Most channels of an emulated part */
+#define REPLAY_CHANNELS_MAX 2
+
+/**
+ * Trace record; in an FCB entry, the timestamp on 32 bits and then the values
+ * follow each other in little endian.
+ */
+struct replay_record {
+	uint64_t timestamp;			/**< In ms */
+	int32_t values[REPLAY_CHANNELS_MAX];	/**< In thousandths */
+};
+
+/** Replay statistics */
+struct replay_stats {
+	uint32_t records;	/**< Records read */
+	uint32_t loops;		/**< Trace restarts */
+	uint32_t triggers;	/**< Data ready triggers fired */
+	uint32_t skipped;	/**< Records due but never triggered */
+	uint32_t speedup;	/**< Speed-up of the trace time */
+	uint64_t time;		/**< Trace time, in ms */
+};
+
+/**
+ * @brief Set the speed-up of the trace time.
+ *
+ * @param dev Replay sensor.
+ * @param speedup Trace milliseconds per real millisecond.
+ *
+ * @return 0 on success, -EINVAL if speedup is 0.
+ */
+int replay_speedup_set(const struct device *dev, uint32_t speedup);
+
+/**
+ * @brief Restart the trace from its first record.
+ *
+ * @param dev Replay sensor.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int replay_rewind(const struct device *dev);
+
+/**
+ * @brief Get the replay statistics.
+ *
+ * @param dev Replay sensor.
+ * @param stats Statistics.
+ */
+void replay_stats_get(const struct device *dev, struct replay_stats *stats);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_SENSOR_REPLAY_H_ */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_FS_FCB_CODEC_H_
+#define ZEPHYR_INCLUDE_FS_FCB_CODEC_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief FCB entry codecs
+ * @defgroup fcb_codec FCB entry codecs
+ * @ingroup fcb_api
+ * @{
+ *
+ * Codecs shrinking the FCB log entries with bounded RAM:
+ *
+ * - delta-of-delta: numeric series are stored as the zig-zag varint of the
+ *   difference between consecutive deltas, so that regularly spaced timestamps
+ *   and slowly varying values take one byte per sample;
+ * - LZ: generic entries are compressed with LZSS over a 256 bytes window read
+ *   in place from the input, so that no RAM is needed besides the output.
+ */
+
+/** Maximum size of a delta-of-delta encoded value */
+#define FCB_CODEC_DOD_MAX_LEN 5
+
+/** Maximum size of a LZ compressed buffer of @p len bytes */
+#define FCB_CODEC_LZ_MAX_LEN(len) ((len) + ((len) + 7) / 8)
+
+/** Delta-of-delta encoder or decoder state of a series */
+struct fcb_codec_dod {
+	int32_t prev;
+	int32_t delta;
+	uint32_t count;
+};
+
+/**
+ * @brief Encode the next value of a series.
+ *
+ * @param dod Series state, zeroed before the first value.
+ * @param value Value.
+ * @param out Output, at least FCB_CODEC_DOD_MAX_LEN bytes.
+ *
+ * @return Number of bytes written.
+ */
+size_t fcb_codec_dod_encode(struct fcb_codec_dod *dod, int32_t value,
+			    uint8_t *out);
+
+/**
+ * @brief Decode the next value of a series.
+ *
+ * @param dod Series state, zeroed before the first value.
+ * @param in Input.
+ * @param len Input length.
+ * @param value Value.
+ *
+ * @return Number of bytes read on success, -EBADMSG if the input is truncated.
+ */
+int fcb_codec_dod_decode(struct fcb_codec_dod *dod, const uint8_t *in,
+			 size_t len, int32_t *value);
+
+/**
+ * @brief Compress a buffer.
+ *
+ * @param in Input.
+ * @param len Input length.
+ * @param out Output.
+ * @param size Output size; FCB_CODEC_LZ_MAX_LEN(len) always fits.
+ *
+ * @return Compressed length on success, -ENOSPC if it does not fit.
+ */
+int fcb_codec_lz_encode(const uint8_t *in, size_t len, uint8_t *out,
+			size_t size);
+
+/**
+ * @brief Decompress a buffer.
+ *
+ * @param in Input.
+ * @param len Input length.
+ * @param out Output.
+ * @param size Output size.
+ *
+ * @return Decompressed length on success, -EBADMSG if the input is malformed,
+ *	   -ENOSPC if it does not fit.
+ */
+int fcb_codec_lz_decode(const uint8_t *in, size_t len, uint8_t *out,
+			size_t size);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_FS_FCB_CODEC_H_ */
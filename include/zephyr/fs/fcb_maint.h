@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_FS_FCB_MAINT_H_
+#define ZEPHYR_INCLUDE_FS_FCB_MAINT_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief FCB maintenance
+ * @defgroup fcb_maint FCB maintenance
+ * @ingroup fcb_api
+ * @{
+ *
+ * A low priority thread rotates the FCB ahead of need, so that there are
+ * always CONFIG_FCB_MAINT_FREE_SECTORS sectors erased beyond the scratch
+ * ones, and an append never waits for a sector erase. This costs the
+ * retention of that many sectors.
+ *
+ * The erases of every sector are counted as the FCB is rotated, which the
+ * users of the FCB must do with fcb_maint_rotate() and fcb_maint_clear()
+ * rather than fcb_rotate() and fcb_clear(). With CONFIG_SETTINGS, and the FCB
+ * on a partition of its own, the counters are saved to the settings
+ * "fcb_maint/wear" at the next check, out of the log, and loaded back at attach
+ * time.
+ *
+ * The FCB staging attaches its FCB; the other users of the partition, such
+ * as the FCB shell, must share that instance, or their erases are missed.
+ */
+
+/** Maintenance statistics, since boot */
+struct fcb_maint_stats {
+	uint32_t erases;	/**< Sectors erased */
+	uint32_t rotations;	/**< Rotations ahead of need */
+	uint32_t checks;	/**< Free sector checks */
+	uint32_t rotate_max_cycles; /**< Longest rotation */
+};
+
+/**
+ * @brief Attach the maintenance to a FCB.
+ *
+ * Only one FCB is maintained; the FCB must be initialized, and must not be
+ * rotated by other means than fcb_maint_rotate().
+ *
+ * @param fcb Initialized FCB instance.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_maint_attach(struct fcb *fcb);
+
+/**
+ * @brief Wake the maintenance thread up, e.g. after an append.
+ */
+void fcb_maint_kick(void);
+
+#if defined(CONFIG_FCB_MAINT)
+/**
+ * @brief Rotate a FCB, counting the erase if it is the one maintained.
+ *
+ * @param fcb Initialized FCB instance.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_maint_rotate(struct fcb *fcb);
+
+/**
+ * @brief Clear a FCB, counting the erases if it is the one maintained.
+ *
+ * @param fcb Initialized FCB instance.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_maint_clear(struct fcb *fcb);
+#else
+static inline int fcb_maint_rotate(struct fcb *fcb)
+{
+	return fcb_rotate(fcb);
+}
+
+static inline int fcb_maint_clear(struct fcb *fcb)
+{
+	return fcb_clear(fcb);
+}
+#endif
+
+/**
+ * @brief Get the erase counters of the sectors.
+ *
+ * @param counts Erase counters, per sector index.
+ * @param count Size of @p counts.
+ *
+ * @return Number of sectors on success, -ENODEV if no FCB is attached.
+ */
+int fcb_maint_wear_get(uint32_t *counts, size_t count);
+
+/**
+ * @brief Get the maintenance statistics.
+ *
+ * @param stats Statistics.
+ */
+void fcb_maint_stats_get(struct fcb_maint_stats *stats);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_FS_FCB_MAINT_H_ */
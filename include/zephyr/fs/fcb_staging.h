@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_FS_FCB_STAGING_H_
+#define ZEPHYR_INCLUDE_FS_FCB_STAGING_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief FCB staging
+ * @defgroup fcb_staging FCB staging
+ * @ingroup fcb_api
+ * @{
+ *
+ * Records are staged in a RAM ring and committed to FCB in groups by a low
+ * priority thread, once the staged size or the time since the last commit
+ * reaches its threshold, or on an explicit flush. A group is committed as a
+ * single FCB entry, so a record costs neither a flash program cycle nor an
+ * entry header of its own. With CONFIG_FCB_STAGING_COMPRESS, the group is
+ * compressed with LZ (see @ref fcb_codec) whenever it gets smaller.
+ */
+
+/** Maximum size of a record */
+#define FCB_STAGING_RECORD_MAX_LEN 255
+
+/** Staging statistics */
+struct fcb_staging_stats {
+	uint32_t records;	 /**< Records staged */
+	uint32_t dropped;	 /**< Records dropped as the ring was full */
+	uint32_t commits;	 /**< Groups committed */
+	uint32_t erases;	 /**< Sectors rotated out to commit */
+	uint64_t group_bytes;	 /**< Groups bytes, uncompressed */
+	uint64_t written_bytes;	 /**< Groups bytes, as committed */
+	uint64_t flash_bytes;	 /**< Flash bytes programmed */
+	uint64_t unbatched_bytes; /**< Flash bytes as one entry per record */
+	uint32_t append_max_cycles; /**< Longest fcb_staging_append() */
+	uint32_t commit_max_cycles; /**< Longest commit */
+};
+
+/**
+ * @brief Callback invoked for every record of a committed group.
+ *
+ * @param data Record data.
+ * @param len Record length.
+ * @param arg User argument.
+ *
+ * @return 0 to continue, non-zero to stop.
+ */
+typedef int (*fcb_staging_record_cb)(const uint8_t *data, uint8_t len,
+				     void *arg);
+
+/**
+ * @brief Stage a record.
+ *
+ * Never blocks on flash; the record is dropped if the ring is full.
+ *
+ * @param data Record data.
+ * @param len Record length, up to FCB_STAGING_RECORD_MAX_LEN.
+ *
+ * @return 0 on success, -ENOMEM if the ring is full, negative errno code on
+ *	   other fail.
+ */
+int fcb_staging_append(const void *data, size_t len);
+
+/**
+ * @brief Commit the staged records now.
+ *
+ * The records are committed on reboot with CONFIG_FCB_STAGING_REBOOT_FLUSH,
+ * and before the power states turning the RAM off with CONFIG_PM.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_staging_flush(void);
+
+/**
+ * @brief Get the FCB instance the records are committed to.
+ *
+ * Other users of the partition must share this instance rather than init
+ * their own, and hold its f_mtx across an append and its write.
+ *
+ * @return FCB instance, or NULL if the staging failed to initialize.
+ */
+struct fcb *fcb_staging_fcb(void);
+
+/**
+ * @brief Get the staging statistics.
+ *
+ * @param stats Statistics to fill.
+ */
+void fcb_staging_stats_get(struct fcb_staging_stats *stats);
+
+/**
+ * @brief Iterate over the records of a committed group.
+ *
+ * @param data FCB entry data.
+ * @param len FCB entry length.
+ * @param cb Callback invoked for every record.
+ * @param arg User argument.
+ *
+ * @return 0 if all records were iterated, the callback return value if it
+ *	   stopped the iteration, -ENOMSG if the entry is not a group, -EBADMSG
+ *	   if the group is malformed.
+ */
+int fcb_staging_foreach(const uint8_t *data, size_t len,
+			fcb_staging_record_cb cb, void *arg);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_FS_FCB_STAGING_H_ */
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_FS_FCB_STATS_H_
+#define ZEPHYR_INCLUDE_FS_FCB_STATS_H_
+
+#include <zephyr/fs/fcb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief FCB windowed statistics
+ * @defgroup fcb_stats FCB windowed statistics
+ * @ingroup fcb_api
+ * @{
+ *
+ * Timestamped samples are logged as FCB entries. When the log moves on to a
+ * new sector, a summary of the previous sector (time range, count, min, max and
+ * sum) is appended to the new one. The summaries are indexed by sector in RAM,
+ * whichever entries they are interleaved with, so that queries answer the
+ * sectors out of range, or within a single bucket, without reading their
+ * samples; only the active sector, and the sectors spanning several buckets,
+ * are read.
+ *
+ * Series of samples can be logged as a single run entry, compressed as
+ * delta-of-delta series (see @ref fcb_codec).
+ */
+
+/** Aggregate of the samples falling in a time bucket */
+struct fcb_stats_bucket {
+	uint32_t count;
+	int32_t min;
+	int32_t max;
+	int64_t sum;
+};
+
+/** Writer state of a FCB statistics log */
+struct fcb_stats {
+	struct fcb *fcb;
+	struct flash_sector *sector; /**< Sector being summarized */
+	uint16_t id;		     /**< Id of that sector */
+	uint32_t first;		     /**< Oldest timestamp in sector */
+	uint32_t last;		     /**< Newest timestamp in sector */
+	struct fcb_stats_bucket sum; /**< Samples in sector */
+};
+
+/**
+ * @brief Callback invoked for every sample of an entry.
+ *
+ * @param timestamp Timestamp of the sample, in seconds.
+ * @param value Value of the sample.
+ * @param arg User argument.
+ *
+ * @return 0 to continue, non-zero to stop.
+ */
+typedef int (*fcb_stats_sample_cb)(uint32_t timestamp, int32_t value,
+				   void *arg);
+
+/**
+ * @brief Initialize the writer state of a FCB statistics log.
+ *
+ * The samples of the active sector are read back to resume its summary.
+ *
+ * @param stats Writer state.
+ * @param fcb Initialized FCB instance.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_stats_init(struct fcb_stats *stats, struct fcb *fcb);
+
+/**
+ * @brief Log a sample.
+ *
+ * The oldest sector is rotated out if the FCB is full.
+ *
+ * @param stats Writer state.
+ * @param timestamp Timestamp of the sample, in seconds.
+ * @param value Value of the sample.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_stats_append(struct fcb_stats *stats, uint32_t timestamp,
+		     int32_t value);
+
+/**
+ * @brief Log a series of samples as compressed runs.
+ *
+ * Each run holds up to CONFIG_FCB_STATS_RUN_MAX samples. The oldest sector is
+ * rotated out if the FCB is full.
+ *
+ * @param stats Writer state.
+ * @param timestamps Timestamps of the samples, in seconds.
+ * @param values Values of the samples.
+ * @param count Number of samples.
+ *
+ * @return 0 on success, negative errno code on fail.
+ */
+int fcb_stats_append_run(struct fcb_stats *stats, const uint32_t *timestamps,
+			 const int32_t *values, size_t count);
+
+/**
+ * @brief Iterate over the samples of an entry.
+ *
+ * @param data FCB entry data.
+ * @param len FCB entry length.
+ * @param cb Callback invoked for every sample.
+ * @param arg User argument.
+ *
+ * @return 0 if all samples were iterated, the callback return value if it
+ *	   stopped the iteration, -ENOMSG if the entry holds no samples,
+ *	   -EBADMSG if the entry is malformed.
+ */
+int fcb_stats_foreach(const uint8_t *data, size_t len, fcb_stats_sample_cb cb,
+		      void *arg);
+
+/**
+ * @brief Aggregate the logged samples in time buckets.
+ *
+ * Bucket i aggregates the samples with timestamps in
+ * [from + i * width, from + (i + 1) * width), up to @p to excluded.
+ *
+ * @param fcb Initialized FCB instance.
+ * @param from Oldest timestamp, included.
+ * @param to Newest timestamp, excluded.
+ * @param width Width of the buckets, in seconds.
+ * @param buckets Buckets to fill.
+ * @param count Number of buckets; at least (to - from) / width, rounded up.
+ *
+ * @return Number of sectors answered from the index on success,
+ *	   negative errno code on fail.
+ */
+int fcb_stats_query(struct fcb *fcb, uint32_t from, uint32_t to,
+		    uint32_t width, struct fcb_stats_bucket *buckets,
+		    size_t count);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_FS_FCB_STATS_H_ */
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZEPHYR_INCLUDE_SYS_HOTPATH_H_
+#define ZEPHYR_INCLUDE_SYS_HOTPATH_H_
+
+#include <zephyr/toolchain.h>
+
+/**
+ * @brief Hot path placement
+ * @defgroup hotpath Hot path placement
+ * @{
+ *
+ * The functions on the hot paths of the sensors, the I2C bus and the GATT callbacks
+ * are marked with __hotpath, which places them according to the build
+ * profile, and leaves them untouched otherwise.
+ */
+
+#if defined(CONFIG_HOTPATH_IRAM)
+#include <esp_attr.h>
+
+/** Run from IRAM, out of reach of the flash cache misses */
+#define __hotpath_iram IRAM_ATTR
+#else
+#define __hotpath_iram
+#endif
+
+#if defined(CONFIG_HOTPATH_SPEED)
+/** Optimize for speed, whatever the optimization level of the build */
+#define __hotpath_speed __attribute__((hot, optimize("O2")))
+#else
+#define __hotpath_speed
+#endif
+
+/** Hot path function */
+#define __hotpath __hotpath_iram __hotpath_speed
+
+/**
+ * @}
+ */
+
+#endif /* ZEPHYR_INCLUDE_SYS_HOTPATH_H_ */
@@ -0,0 +1,133 @@
+/* ap_details.c - Strongest access points of the Wi-Fi scans */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "ap_details.h"
+
+static bool ap_heap_less(const struct ap_details *aps, unsigned int i,
+			 unsigned int j)
+{
+	const struct ap_detail *a = &aps->details[aps->heap[i]];
+	const struct ap_detail *b = &aps->details[aps->heap[j]];
+
+	if (a->state != b->state)
+		return a->state < b->state;
+
+	return a->rssi < b->rssi;
+}
+
+static void ap_heap_swap(struct ap_details *aps, unsigned int i,
+			 unsigned int j)
+{
+	uint8_t tmp = aps->heap[i];
+
+	aps->heap[i] = aps->heap[j];
+	aps->heap[j] = tmp;
+	aps->heap_pos[aps->heap[i]] = i;
+	aps->heap_pos[aps->heap[j]] = j;
+}
+
+static void ap_heap_up(struct ap_details *aps, unsigned int i)
+{
+	while (i > 0 && ap_heap_less(aps, i, (i - 1) / 2)) {
+		ap_heap_swap(aps, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void ap_heap_down(struct ap_details *aps, unsigned int i)
+{
+	unsigned int n = aps->count;
+
+	for (;;) {
+		unsigned int min = i, l = 2 * i + 1, r = 2 * i + 2;
+
+		if (l < n && ap_heap_less(aps, l, min))
+			min = l;
+		if (r < n && ap_heap_less(aps, r, min))
+			min = r;
+		if (min == i)
+			break;
+
+		ap_heap_swap(aps, i, min);
+		i = min;
+	}
+}
+
+void ap_details_age(struct ap_details *aps)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < aps->count; i++) {
+		if (aps->details[i].state != CURRENT_DETAILS)
+			continue;
+
+		aps->details[count] = aps->details[i];
+		aps->details[count].state = STALE_DETAILS;
+		count++;
+	}
+	aps->count = count;
+
+	for (i = 0; i < count; i++) {
+		aps->heap[i] = i;
+		aps->heap_pos[i] = i;
+	}
+
+	for (i = count / 2; i-- > 0; )
+		ap_heap_down(aps, i);
+}
+
+/* Hidden SSIDs are told apart by their BSSID, which is not kept */
+int ap_details_find(const struct ap_details *aps, const uint8_t *ssid,
+		    uint8_t ssid_len)
+{
+	unsigned int i;
+
+	if (ssid_len == 0)
+		return -1;
+
+	for (i = 0; i < aps->count; i++) {
+		const struct ap_detail *ap = &aps->details[i];
+
+		if (ap->ssid_len == ssid_len &&
+		    memcmp(ap->ssid, ssid, ssid_len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+int ap_details_update(struct ap_details *aps, const struct ap_detail *entry)
+{
+	struct ap_detail *ap;
+	int i;
+
+	i = ap_details_find(aps, entry->ssid, entry->ssid_len);
+	if (i < 0 && aps->count < AP_DETAILS_MAX_LEN) {
+		i = aps->count++;
+		aps->heap[i] = i;
+		aps->heap_pos[i] = i;
+		aps->details[i].state = NO_DETAILS;
+	} else if (i < 0) {
+		i = aps->heap[0];
+	}
+
+	ap = &aps->details[i];
+	if (ap->state == CURRENT_DETAILS && ap->rssi >= entry->rssi)
+		return -1;
+
+	*ap = *entry;
+	ap->state = CURRENT_DETAILS;
+
+	/* The key only grows, but a new AP starts at the bottom */
+	ap_heap_up(aps, aps->heap_pos[i]);
+	ap_heap_down(aps, aps->heap_pos[i]);
+
+	return i;
+}
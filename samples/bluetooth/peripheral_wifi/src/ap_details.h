@@ -0,0 +1,65 @@
+/* ap_details.h - Strongest access points of the Wi-Fi scans */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef AP_DETAILS_H_
+#define AP_DETAILS_H_
+
+#include <zephyr/types.h>
+#include <zephyr/net/wifi.h>
+
+enum ap_state_detail {
+	NO_DETAILS = 0x00U,
+	STALE_DETAILS = 0x01U,
+	CURRENT_DETAILS = 0x02U,
+};
+
+struct ap_detail {
+	uint8_t state;
+	uint8_t channel;
+	uint8_t freq_band;
+	int8_t rssi;
+	uint8_t ssid_len;
+	uint8_t ssid[WIFI_SSID_MAX_LEN];
+};
+
+#define AP_DETAILS_MAX_LEN 16
+
+/*
+ * The strongest APs are kept, once per SSID, in a min-heap of the indexes of
+ * their details, by state then RSSI: the root is the first to be replaced,
+ * and the stale ones go first. The details do not move, so that their index
+ * holds for the notifications and the pages.
+ */
+struct ap_details {
+	uint8_t count;
+	struct ap_detail details[AP_DETAILS_MAX_LEN];
+	uint8_t heap[AP_DETAILS_MAX_LEN];
+	uint8_t heap_pos[AP_DETAILS_MAX_LEN];
+};
+
+/*
+ * The APs of the last scan are stale until this one sees them again, and the
+ * ones it missed already are dropped.
+ */
+void ap_details_age(struct ap_details *aps);
+
+/*
+ * Returns the index of the details of the SSID, or -1 if none; hidden SSIDs
+ * are never found.
+ */
+int ap_details_find(const struct ap_details *aps, const uint8_t *ssid,
+		    uint8_t ssid_len);
+
+/*
+ * Returns the index of the details updated with the scan result, or -1 if it
+ * is weaker than all the current ones, or than the same SSID on another band
+ * or BSSID.
+ */
+int ap_details_update(struct ap_details *aps, const struct ap_detail *entry);
+
+#endif /* AP_DETAILS_H_ */
@@ -25,6 +25,10 @@
 #include <zephyr/net/wifi.h>
 #include <zephyr/net/wifi_mgmt.h>
 
+#include <zephyr/settings/settings.h>
+
+#include "ap_details.h"
+
 #ifndef BT_GATT_CPF_FORMAT_UINT8
 #define BT_GATT_CPF_FORMAT_UINT8 0x04
 #endif
@@ -52,27 +56,12 @@ enum scanning_mode {
 	SCAN_DONE = 0x02U,
 };
 
-enum ap_state_detail {
-	NO_DETAILS = 0x00U,
-	STALE_DETAILS = 0x01U,
-	CURRENT_DETAILS = 0x02U,
-};
-
 enum ap_freq_band {
 	BAND_2_4_GHZ = 0U,
 	BAND_5_GHZ = 1U,
 	BAND_6_GHZ = 2U,
 };
 
-struct ap_detail {
-	uint8_t state;
-	uint8_t channel;
-	uint8_t freq_band;
-	int8_t rssi;
-	uint8_t ssid_len;
-	uint8_t ssid[WIFI_SSID_MAX_LEN];
-};
-
 /*
  * The Wi-Fi® Scan Service, allows a BLE peripheral to retrieve a list of Wi-Fi
  * networks (access points) that are in range of the ATWINC3400.
@@ -94,18 +83,47 @@ static struct bt_uuid_128 ss_ap_count_uuid = BT_UUID_INIT_128(
 static struct bt_uuid_128 ss_ap_details_uuid = BT_UUID_INIT_128(
 	BT_UUID_128_ENCODE(0xfb8c0004, 0xd224, 0x11e4, 0x85a1, 0x0002a5d5c51b));
 
-#define AP_DETAILS_MAX_LEN 16
+static struct bt_uuid_128 ss_ap_result_uuid = BT_UUID_INIT_128(
+	BT_UUID_128_ENCODE(0xfb8c0005, 0xd224, 0x11e4, 0x85a1, 0x0002a5d5c51b));
 
+/*
+ * The AP details are read a page at a time, and every scan result is notified
+ * as it arrives; both as packed AP records, which carry the SSID bytes only:
+ *
+ *	index		u8, in the AP details
+ *	state		u8
+ *	channel		u8
+ *	freq_band	u8
+ *	rssi		s8
+ *	ssid_len	u8
+ *	ssid		ssid_len bytes, cut to the ATT MTU if notified
+ *
+ * A page starts with its index and the number of pages, u8 each.
+ */
+#define AP_RECORD_HEADER_LEN 6
+#define AP_RECORD_MAX_LEN (AP_RECORD_HEADER_LEN + WIFI_SSID_MAX_LEN)
+#define AP_DETAILS_PAGE_LEN 4
+#define AP_DETAILS_PAGES \
+	DIV_ROUND_UP(AP_DETAILS_MAX_LEN, AP_DETAILS_PAGE_LEN)
+#define AP_PAGE_HEADER_LEN 2
+#define AP_PAGE_MAX_LEN \
+	(AP_PAGE_HEADER_LEN + AP_DETAILS_PAGE_LEN * AP_RECORD_MAX_LEN)
+
+/* The AP Details page is selected by every connection for itself */
 struct wifi_scan_service {
 	uint8_t scanning_mode;
-	uint8_t ap_count;
-	struct ap_detail ap_details[AP_DETAILS_MAX_LEN];
+	uint8_t ap_details_page[CONFIG_BT_MAX_CONN];
+	struct ap_details aps;
 };
 
 static bool scanning_mode_notify;
 
+static bool ap_result_notify;
+
 static struct wifi_scan_service scan_service;
 
+static unsigned int scan_results;
+
 static ssize_t read_scanning_mode(struct bt_conn *conn,
 				  const struct bt_gatt_attr *attr,
 				  void *buf,
@@ -140,7 +158,9 @@ static ssize_t write_scanning_mode(struct bt_conn *conn,
 	if (!iface)
 		return -ENODEV;
 
-	val->ap_count = 0;
+	ap_details_age(&val->aps);
+	scan_results = 0;
+	memset(val->ap_details_page, 0, sizeof(val->ap_details_page));
 	val->scanning_mode = SCAN_RUNNING;
 	err = net_mgmt(NET_REQUEST_WIFI_SCAN, iface, NULL, 0);
 	if (err)
@@ -186,8 +206,8 @@ static ssize_t read_ap_count(struct bt_conn *conn,
 {
 	struct wifi_scan_service *val = attr->user_data;
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, &val->ap_count,
-				 sizeof(val->ap_count));
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &val->aps.count,
+				 sizeof(val->aps.count));
 }
 
 static const struct bt_gatt_cpf ap_details_cpf = {
@@ -198,6 +218,20 @@ static const struct bt_gatt_cpf ap_details_cpf = {
 	.description = BT_GATT_CPF_NAMESPACE_DESCRIPTION_UNKNOWN,
 };
 
+static size_t ap_record_pack(uint8_t index, const struct ap_detail *ap,
+			     uint8_t *buf)
+{
+	buf[0] = index;
+	buf[1] = ap->state;
+	buf[2] = ap->channel;
+	buf[3] = ap->freq_band;
+	buf[4] = ap->rssi;
+	buf[5] = ap->ssid_len;
+	memcpy(&buf[AP_RECORD_HEADER_LEN], ap->ssid, ap->ssid_len);
+
+	return AP_RECORD_HEADER_LEN + ap->ssid_len;
+}
+
 static ssize_t read_ap_details(struct bt_conn *conn,
 			       const struct bt_gatt_attr *attr,
 			       void *buf,
@@ -205,9 +239,51 @@ static ssize_t read_ap_details(struct bt_conn *conn,
 			       uint16_t offset)
 {
 	struct wifi_scan_service *val = attr->user_data;
+	uint8_t index = val->ap_details_page[bt_conn_index(conn)];
+	uint8_t page[AP_PAGE_MAX_LEN];
+	size_t size = AP_PAGE_HEADER_LEN;
+	uint8_t i, first, last;
+
+	first = index * AP_DETAILS_PAGE_LEN;
+	last = MIN(first + AP_DETAILS_PAGE_LEN, val->aps.count);
+
+	page[0] = index;
+	page[1] = DIV_ROUND_UP(val->aps.count, AP_DETAILS_PAGE_LEN);
+	for (i = first; i < last; i++)
+		size += ap_record_pack(i, &val->aps.details[i], &page[size]);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, page, size);
+}
+
+static ssize_t write_ap_details(struct bt_conn *conn,
+				const struct bt_gatt_attr *attr,
+				const void *buf,
+				uint16_t len,
+				uint16_t offset,
+				uint8_t flags)
+{
+	struct wifi_scan_service *val = attr->user_data;
+	uint8_t value;
 
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, val->ap_details,
-				 sizeof(val->ap_details));
+	if (offset)
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+
+	if (len != sizeof(value))
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+
+	value = *(uint8_t *)buf;
+	if (value >= AP_DETAILS_PAGES)
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+
+	val->ap_details_page[bt_conn_index(conn)] = value;
+
+	return len;
+}
+
+static void ap_result_ccc_changed(const struct bt_gatt_attr *attr,
+				  uint16_t value)
+{
+	ap_result_notify = value == BT_GATT_CCC_NOTIFY;
 }
 
 /*
@@ -261,6 +337,177 @@ static bool connection_state_notify;
 
 static struct wifi_connect_service connect_service;
 
+/*
+ * The last AP connected to, with the band, the channel and the BSSID it
+ * resolved to, is saved to the settings, so that the next boot connects on
+ * its channel rather than scanning them all; the full scan is the fallback.
+ */
+struct ap_cache {
+	struct ap_parameters ap_parameters;
+	uint8_t band;
+	uint8_t channel;
+	uint8_t bssid[WIFI_MAC_ADDR_LEN];
+};
+
+#define CACHED_CONNECT_TIMEOUT_MS 5000
+
+static struct ap_cache ap_cache;
+static bool ap_cache_valid;
+static bool connect_cached;
+static const char *connect_mode = "provisioned";
+
+static int wifi_settings_set(const char *name, size_t len,
+			     settings_read_cb read_cb, void *cb_arg)
+{
+	struct ap_cache cache;
+	ssize_t ret;
+
+	if (strcmp(name, "ap"))
+		return -ENOENT;
+
+	if (len != sizeof(cache))
+		return -EINVAL;
+
+	ret = read_cb(cb_arg, &cache, sizeof(cache));
+	if (ret < 0)
+		return ret;
+
+	if (cache.ap_parameters.ssid_len > WIFI_SSID_MAX_LEN ||
+	    cache.ap_parameters.passphrase_len >
+	    sizeof(cache.ap_parameters.passphrase))
+		return -EINVAL;
+
+	ap_cache = cache;
+	ap_cache_valid = true;
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(wifi, "wifi", NULL, wifi_settings_set, NULL,
+			       NULL);
+
+static int wifi_connect(struct net_if *iface, uint8_t band, uint8_t channel,
+			int timeout)
+{
+	struct wifi_connect_req_params params = { 0 };
+
+	params.ssid = connect_service.ap_parameters.ssid;
+	params.ssid_length = connect_service.ap_parameters.ssid_len;
+	params.psk = connect_service.ap_parameters.passphrase;
+	params.psk_length = connect_service.ap_parameters.passphrase_len;
+	params.band = band;
+	params.channel = channel;
+	params.security = WIFI_SECURITY_TYPE_PSK;
+	params.timeout = timeout;
+	params.mfp = WIFI_MFP_OPTIONAL;
+
+	return net_mgmt(NET_REQUEST_WIFI_CONNECT, iface, &params,
+			sizeof(params));
+}
+
+static void connection_state_set(uint8_t state);
+
+/* The disconnection which aborts the cached connection is not reported */
+static bool disconnect_fallback;
+
+static void connect_fallback(struct k_work *work)
+{
+	struct net_if *iface = net_if_get_default();
+	int err;
+
+	if (!connect_cached)
+		return;
+
+	printk("Connection on channel %u failed, scanning\n",
+	       ap_cache.channel);
+
+	/* The driver may still be connecting on the cached channel */
+	disconnect_fallback = true;
+	err = net_mgmt(NET_REQUEST_WIFI_DISCONNECT, iface, NULL, 0);
+	if (err)
+		disconnect_fallback = false;
+
+	connect_cached = false;
+	connect_mode = "full scan";
+	err = wifi_connect(iface, ap_cache.band, WIFI_CHANNEL_ANY,
+			   SYS_FOREVER_MS);
+	if (err) {
+		printk("Connection request failed (%d)\n", err);
+		connection_state_set(DISCONNECTED);
+	}
+}
+
+static K_WORK_DELAYABLE_DEFINE(connect_fallback_work, connect_fallback);
+
+static void ap_cache_save(struct k_work *work)
+{
+	struct net_if *iface = net_if_get_default();
+	struct wifi_iface_status status = { 0 };
+	struct ap_cache cache = { 0 };
+	int err;
+
+	err = net_mgmt(NET_REQUEST_WIFI_IFACE_STATUS, iface, &status,
+		       sizeof(status));
+	if (err) {
+		printk("Interface status failed (%d)\n", err);
+		return;
+	}
+
+	cache.ap_parameters = connect_service.ap_parameters;
+	cache.band = status.band;
+	cache.channel = status.channel;
+	memcpy(cache.bssid, status.bssid, sizeof(cache.bssid));
+
+	/* Spare the flash if nothing changed */
+	if (ap_cache_valid && memcmp(&cache, &ap_cache, sizeof(cache)) == 0)
+		return;
+
+	err = settings_save_one("wifi/ap", &cache, sizeof(cache));
+	if (err) {
+		printk("AP parameters save failed (%d)\n", err);
+		return;
+	}
+
+	ap_cache = cache;
+	ap_cache_valid = true;
+
+	printk("AP parameters saved (channel %u)\n", cache.channel);
+}
+
+static K_WORK_DEFINE(ap_cache_work, ap_cache_save);
+
+static void wifi_connect_cached(void)
+{
+	struct net_if *iface = net_if_get_default();
+	const uint8_t *bssid = ap_cache.bssid;
+	int err;
+
+	if (!ap_cache_valid || !iface)
+		return;
+
+	printk("Connecting to %.*s on channel %u "
+	       "(%02x:%02x:%02x:%02x:%02x:%02x)\n",
+	       ap_cache.ap_parameters.ssid_len, ap_cache.ap_parameters.ssid,
+	       ap_cache.channel, bssid[0], bssid[1], bssid[2], bssid[3],
+	       bssid[4], bssid[5]);
+
+	connect_service.ap_parameters = ap_cache.ap_parameters;
+	connect_service.connection_state = CONNECTING;
+	connect_cached = true;
+	connect_mode = "cached channel";
+	err = wifi_connect(iface, ap_cache.band, ap_cache.channel,
+			   CACHED_CONNECT_TIMEOUT_MS);
+	if (err) {
+		printk("Connection request failed (%d)\n", err);
+		k_work_reschedule(&connect_fallback_work, K_NO_WAIT);
+		return;
+	}
+
+	/* Not every driver reports the timeout */
+	k_work_reschedule(&connect_fallback_work,
+			  K_MSEC(CACHED_CONNECT_TIMEOUT_MS));
+}
+
 static ssize_t read_connection_state(struct bt_conn *conn,
 				     const struct bt_gatt_attr *attr,
 				     void *buf,
@@ -337,7 +584,6 @@ static ssize_t write_ap_parameters(struct bt_conn *conn,
 				   uint8_t flags)
 {
 	struct wifi_connect_service *val = attr->user_data;
-	struct wifi_connect_req_params params = { 0 };
 	struct net_if *iface = net_if_get_default();
 	struct ap_parameters *value = (struct ap_parameters *)buf;
 	int err;
@@ -349,18 +595,10 @@ static ssize_t write_ap_parameters(struct bt_conn *conn,
 		return -ENODEV;
 
 	memcpy(&val->ap_parameters, value, len);
-	params.ssid = val->ap_parameters.ssid;
-	params.ssid_length = val->ap_parameters.ssid_len;
-	params.psk = val->ap_parameters.passphrase;
-	params.psk_length = val->ap_parameters.passphrase_len;
-	params.band = WIFI_FREQ_BAND_2_4_GHZ;
-	params.channel = WIFI_CHANNEL_ANY;
-	params.security = WIFI_SECURITY_TYPE_PSK;
-	params.timeout = SYS_FOREVER_MS;
-	params.mfp = WIFI_MFP_OPTIONAL;
 	val->connection_state = CONNECTING;
-	err = net_mgmt(NET_REQUEST_WIFI_CONNECT, iface, &params,
-		       sizeof(params));
+	connect_mode = "provisioned";
+	err = wifi_connect(iface, WIFI_FREQ_BAND_2_4_GHZ, WIFI_CHANNEL_ANY,
+			   SYS_FOREVER_MS);
 	if (err)
 		return err;
 
@@ -393,13 +631,23 @@ BT_GATT_SERVICE_DEFINE(wifi_svc,
 	BT_GATT_CPF(&ap_count_cpf),
 	BT_GATT_CUD("AP Count", BT_GATT_PERM_READ),
 	BT_GATT_CHARACTERISTIC(&ss_ap_details_uuid.uuid,
-			       BT_GATT_CHRC_READ,
-			       BT_GATT_PERM_READ,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
 			       read_ap_details,
-			       NULL,
+			       write_ap_details,
 			       &scan_service),
 	BT_GATT_CPF(&ap_details_cpf),
 	BT_GATT_CUD("AP Details", BT_GATT_PERM_READ),
+	BT_GATT_CHARACTERISTIC(&ss_ap_result_uuid.uuid,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE,
+			       NULL,
+			       NULL,
+			       &scan_service),
+	BT_GATT_CCC(ap_result_ccc_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CPF(&ap_details_cpf),
+	BT_GATT_CUD("AP Scan Result", BT_GATT_PERM_READ),
 	BT_GATT_PRIMARY_SERVICE(&wifi_connect_service_uuid),
 	BT_GATT_CHARACTERISTIC(&ss_connection_state_uuid.uuid,
 		  BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
@@ -442,6 +690,19 @@ static void bt_ready(void)
 	printk("Advertising successfully started\n");
 }
 
+/* A new connection reads the first page, whatever the previous one read */
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err)
+		return;
+
+	scan_service.ap_details_page[bt_conn_index(conn)] = 0;
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+};
+
 static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
@@ -467,33 +728,58 @@ static struct bt_conn_auth_cb auth_cb_display = {
 };
 
 static struct net_mgmt_event_callback wifi_shell_mgmt_cb;
+static struct net_mgmt_event_callback ipv4_mgmt_cb;
+
+struct ap_record {
+	uint8_t data[AP_RECORD_MAX_LEN];
+	size_t len;
+};
+
+/* The SSID is cut to the ATT MTU of every connection, and so is its length */
+static void ap_record_notify(struct bt_conn *conn, void *user_data)
+{
+	const struct bt_gatt_attr *chrc = &wifi_svc.attrs[15];
+	const struct ap_record *rec = user_data;
+	uint16_t mtu = bt_gatt_get_mtu(conn) - 3;
+	uint8_t data[AP_RECORD_MAX_LEN];
+	size_t len = MIN(rec->len, mtu);
+
+	memcpy(data, rec->data, len);
+	data[AP_RECORD_HEADER_LEN - 1] = len - AP_RECORD_HEADER_LEN;
+	bt_gatt_notify(conn, chrc, data, len);
+}
 
 static void handle_wifi_scan_result(struct net_mgmt_event_callback *cb)
 {
 	const struct wifi_scan_result *entry =
 		(const struct wifi_scan_result *)cb->info;
+	struct ap_detail ap = {
+		.channel = entry->channel,
+		.freq_band = entry->band,
+		.rssi = entry->rssi,
+		.ssid_len = entry->ssid_length,
+	};
+	int index;
 
-	if (scan_service.ap_count == 0U) {
+	if (scan_results == 0U) {
 		printk("\n%-4s | %-32s %-5s | %-13s | %-4s | %-15s\n",
 		       "Num", "SSID", "(len)", "Channel", "RSSI", "Security");
 	}
 
-	printk("%-4d | %-32s %-5u | %-4u (%-6s) | %-4d | %-15s\n",
-	       scan_service.ap_count, entry->ssid, entry->ssid_length,
+	printk("%-4u | %-32s %-5u | %-4u (%-6s) | %-4d | %-15s\n",
+	       scan_results, entry->ssid, entry->ssid_length,
 	       entry->channel, wifi_band_txt(entry->band), entry->rssi,
 	       wifi_security_txt(entry->security));
+	scan_results++;
 
-	if (scan_service.ap_count < AP_DETAILS_MAX_LEN) {
-		struct ap_detail *ap;
-
-		ap = &scan_service.ap_details[scan_service.ap_count];
-		ap->state = CURRENT_DETAILS;
-		ap->channel = entry->channel;
-		ap->freq_band = entry->band;
-		ap->rssi = entry->rssi;
-		ap->ssid_len = entry->ssid_length;
-		memcpy(ap->ssid, entry->ssid, entry->ssid_length);
-		scan_service.ap_count++;
+	memcpy(ap.ssid, entry->ssid, entry->ssid_length);
+	index = ap_details_update(&scan_service.aps, &ap);
+	if (index >= 0 && ap_result_notify) {
+		struct ap_record rec;
+
+		rec.len = ap_record_pack(index, &scan_service.aps.details[index],
+					 rec.data);
+		bt_conn_foreach(BT_CONN_TYPE_LE, ap_record_notify, &rec);
 	}
 }
 
@@ -517,18 +803,11 @@ static void handle_wifi_scan_done(struct net_mgmt_event_callback *cb)
 	}
 }
 
-static void handle_wifi_connect_result(struct net_mgmt_event_callback *cb)
+static void connection_state_set(uint8_t state)
 {
-	const struct bt_gatt_attr *chrc = &wifi_svc.attrs[16];
-	const struct wifi_status *status =
-		(const struct wifi_status *) cb->info;
-
-	if (status->status)
-		printk("Connection request failed (%d)\n", status->status);
-	else
-		printk("Connected\n");
+	const struct bt_gatt_attr *chrc = &wifi_svc.attrs[21];
 
-	connect_service.connection_state = CONNECTED;
+	connect_service.connection_state = state;
 
 	if (connection_state_notify) {
 		uint8_t value = sys_cpu_to_le16(
@@ -538,26 +817,58 @@ static void handle_wifi_connect_result(struct net_mgmt_event_callback *cb)
 	}
 }
 
+static void handle_wifi_connect_result(struct net_mgmt_event_callback *cb)
+{
+	const struct wifi_status *status =
+		(const struct wifi_status *) cb->info;
+
+	/*
+	 * The driver may not report the disconnection of the fallback, if it
+	 * was not connecting anymore; do not let it swallow the next one.
+	 */
+	disconnect_fallback = false;
+
+	if (status->status) {
+		printk("Connection request failed (%d)\n", status->status);
+		if (connect_cached) {
+			k_work_reschedule(&connect_fallback_work, K_NO_WAIT);
+			return;
+		}
+
+		connection_state_set(DISCONNECTED);
+		return;
+	}
+
+	printk("Connected\n");
+	connect_cached = false;
+	k_work_cancel_delayable(&connect_fallback_work);
+	k_work_submit(&ap_cache_work);
+
+	connection_state_set(CONNECTED);
+}
+
 static void handle_wifi_disconnect_result(struct net_mgmt_event_callback *cb)
 {
-	const struct bt_gatt_attr *chrc = &wifi_svc.attrs[16];
 	const struct wifi_status *status =
 		(const struct wifi_status *) cb->info;
 
+	if (disconnect_fallback) {
+		disconnect_fallback = false;
+		return;
+	}
+
+	if (connect_cached) {
+		k_work_reschedule(&connect_fallback_work, K_NO_WAIT);
+		return;
+	}
+
 	if (connect_service.connection_state == CONNECTING)
 		printk("Disconnection request %s (%d)\n",
 		       status->status ? "failed" : "done", status->status);
 	else
 		printk("Disconnected\n");
 
-	connect_service.connection_state = DISCONNECTED;
-
-	if (connection_state_notify) {
-		uint8_t value = sys_cpu_to_le16(
-					     connect_service.connection_state);
-
-		bt_gatt_notify(NULL, chrc, &value, sizeof(value));
-	}
+	connection_state_set(DISCONNECTED);
 }
 
 static void wifi_mgmt_event_handler(struct net_mgmt_event_callback *cb,
@@ -581,19 +892,22 @@ static void wifi_mgmt_event_handler(struct net_mgmt_event_callback *cb,
 	}
 }
 
-void main(void)
+/* Boot to IP, to compare the connection on the cached channel to the scan */
+static void ipv4_mgmt_event_handler(struct net_mgmt_event_callback *cb,
+				    uint32_t mgmt_event, struct net_if *iface)
 {
-	int err;
+	static bool reported;
 
-	err = bt_enable(NULL);
-	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
+	if (mgmt_event != NET_EVENT_IPV4_ADDR_ADD || reported)
 		return;
-	}
 
-	bt_ready();
+	reported = true;
+	printk("Boot to IP: %u ms (%s)\n", k_uptime_get_32(), connect_mode);
+}
 
-	bt_conn_auth_cb_register(&auth_cb_display);
+void main(void)
+{
+	int err;
 
 	net_mgmt_init_event_callback(&wifi_shell_mgmt_cb,
 				     wifi_mgmt_event_handler,
@@ -604,6 +918,30 @@ void main(void)
 
 	net_mgmt_add_event_callback(&wifi_shell_mgmt_cb);
 
+	net_mgmt_init_event_callback(&ipv4_mgmt_cb, ipv4_mgmt_event_handler,
+				     NET_EVENT_IPV4_ADDR_ADD);
+
+	net_mgmt_add_event_callback(&ipv4_mgmt_cb);
+
+	/* Connect to the last AP first, while the Bluetooth comes up */
+	err = settings_subsys_init();
+	if (err)
+		printk("Settings init failed (err %d)\n", err);
+	else
+		settings_load_subtree("wifi");
+
+	wifi_connect_cached();
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	bt_ready();
+
+	bt_conn_auth_cb_register(&auth_cb_display);
+
 	while (1)
 		k_sleep(K_SECONDS(1));
 }
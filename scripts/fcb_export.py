@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+#
+# Decode the output of the "fcb export" shell command to CSV.
+#
+# Every frame line starts with '>' followed by the base64 encoding of:
+#
+#   - the offset of the entry in the flash area (u32 le)
+#   - the length of the entry (u16 le)
+#   - the offset of the fragment in the entry (u16 le)
+#   - the fragment data
+#   - the CRC32 (IEEE) of all the above (u32 le)
+#
+# Other lines (shell prompt, logs...) are ignored.
+#
+# In raw mode ("fcb export raw"), the frames are binary, each one preceded by
+# the 0x5a 0xfc sync bytes; the bytes in between (shell echo, prompt...) are
+# skipped.
+
+import argparse
+import base64
+import binascii
+import csv
+import os
+import stat
+import struct
+import sys
+import zlib
+
+HDR = struct.Struct('<IHH')
+CRC = struct.Struct('<I')
+SYNC = b'\x5a\xfc'
+FRAG_LEN = 192
+
+
+def frames(lines):
+    for num, line in enumerate(lines, 1):
+        line = line.strip()
+        if not line.startswith('>'):
+            continue
+
+        try:
+            frame = base64.b64decode(line[1:], validate=True)
+        except binascii.Error:
+            print(f'{num}: invalid base64', file=sys.stderr)
+            continue
+
+        if len(frame) < HDR.size + CRC.size:
+            print(f'{num}: truncated frame', file=sys.stderr)
+            continue
+
+        crc, = CRC.unpack_from(frame, len(frame) - CRC.size)
+        if zlib.crc32(frame[:-CRC.size]) != crc:
+            print(f'{num}: invalid CRC', file=sys.stderr)
+            continue
+
+        off, length, frag = HDR.unpack_from(frame)
+        yield off, length, frag, frame[HDR.size:-CRC.size]
+
+
+def raw_frames(chunks):
+    buf = bytearray()
+    for chunk in chunks:
+        buf += chunk
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                del buf[:-1]
+                break
+
+            del buf[:start]
+            if len(buf) < len(SYNC) + HDR.size:
+                break
+
+            off, length, frag = HDR.unpack_from(buf, len(SYNC))
+            size = HDR.size + min(max(length - frag, 0), FRAG_LEN) + CRC.size
+            if len(buf) < len(SYNC) + size:
+                break
+
+            frame = bytes(buf[len(SYNC):len(SYNC) + size])
+            crc, = CRC.unpack_from(frame, size - CRC.size)
+            if zlib.crc32(frame[:-CRC.size]) != crc:
+                # Not a frame, or a corrupted one: resync on the next byte
+                del buf[:1]
+                continue
+
+            del buf[:len(SYNC) + size]
+            yield off, length, frag, frame[HDR.size:-CRC.size]
+
+
+def entries(frames):
+    off, length, data = None, 0, bytearray()
+    for frame_off, frame_len, frag, chunk in frames:
+        if frag == 0:
+            off, length, data = frame_off, frame_len, bytearray()
+        elif frame_off != off or frag != len(data):
+            print(f'0x{frame_off:x}: missing fragment', file=sys.stderr)
+            off = None
+            continue
+
+        data += chunk
+        if off is not None and len(data) == length:
+            yield off, bytes(data)
+            off = None
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode the output of the "fcb export" shell command to CSV.')
+    parser.add_argument('input', nargs='?',
+                        help='captured shell output or tty (default: stdin)')
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'),
+                        default=sys.stdout,
+                        help='CSV output (default: stdout)')
+    parser.add_argument('-t', '--text', action='store_true',
+                        help='output the data as text instead of hex')
+    parser.add_argument('-r', '--raw', action='store_true',
+                        help='decode the binary output of "fcb export raw"')
+    parser.add_argument('-b', '--baud', type=int, default=115200,
+                        help='tty baud rate in raw mode (default: 115200)')
+    parser.add_argument('-c', '--command',
+                        help='shell command to send to the tty in raw mode, '
+                             'e.g. "fcb export raw"')
+    args = parser.parse_args()
+
+    if args.raw and args.input and stat.S_ISCHR(os.stat(args.input).st_mode):
+        from sensor_stream import read_tty
+        records = entries(raw_frames(read_tty(args.input, args.baud,
+                                              args.command)))
+    elif args.raw:
+        with open(args.input or sys.stdin.fileno(), 'rb',
+                  closefd=args.input is not None) as f:
+            chunks = iter(lambda: f.read(4096), b'')
+            records = list(entries(raw_frames(chunks)))
+    else:
+        with open(args.input or sys.stdin.fileno(), 'r',
+                  closefd=args.input is not None) as f:
+            records = list(entries(frames(f)))
+
+    writer = csv.writer(args.output)
+    writer.writerow(['offset', 'length', 'data'])
+    last = None
+    for off, data in records:
+        if args.text:
+            value = data.decode(errors='backslashreplace')
+        else:
+            value = data.hex()
+        writer.writerow([f'0x{off:x}', len(data), value])
+        last = off
+
+    if last is not None:
+        mode = 'raw ' if args.raw else ''
+        print(f'Resume with: fcb export {mode}0x{last:x}', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
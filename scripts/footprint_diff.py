@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+#
+# Compare the footprint of two builds of the same application, e.g. the
+# default one and the performance profile:
+#
+#   footprint_diff.py build/zephyr/zephyr.elf build-perf/zephyr/zephyr.elf
+#
+# The sizes of the allocated sections are compared, and then the functions
+# which changed of size or of section; the hot path functions moving from the
+# flash to IRAM show up there.
+#
+# The ELF files are read with pyelftools, as do the Zephyr scripts.
+
+import argparse
+import sys
+
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+
+def allocated(elf):
+    return [s for s in elf.iter_sections()
+            if s['sh_flags'] & SH_FLAGS.SHF_ALLOC]
+
+
+def section_at(sections, addr):
+    for s in sections:
+        if s['sh_size'] and s['sh_addr'] <= addr < s['sh_addr'] + s['sh_size']:
+            return s.name
+
+    return '?'
+
+
+def functions(elf):
+    sections = allocated(elf)
+    funcs = {}
+    for s in elf.iter_sections():
+        if not isinstance(s, SymbolTableSection):
+            continue
+
+        for sym in s.iter_symbols():
+            if sym['st_info']['type'] != 'STT_FUNC' or not sym['st_size']:
+                continue
+
+            funcs[sym.name] = (sym['st_size'],
+                               section_at(sections, sym['st_value']))
+
+    return funcs
+
+
+def footprint(path):
+    with open(path, 'rb') as f:
+        elf = ELFFile(f)
+        sizes = {s.name: s['sh_size'] for s in allocated(elf)}
+        return sizes, functions(elf)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('old', help='reference ELF file')
+    parser.add_argument('new', help='ELF file compared')
+    args = parser.parse_args()
+
+    old_sizes, old_funcs = footprint(args.old)
+    new_sizes, new_funcs = footprint(args.new)
+
+    print(f'{"Section":32} {"Old":>8} {"New":>8} {"Diff":>8}')
+    total = 0
+    for name in sorted(set(old_sizes) | set(new_sizes)):
+        o, n = old_sizes.get(name, 0), new_sizes.get(name, 0)
+        if o == n:
+            continue
+
+        total += n - o
+        print(f'{name:32} {o:8} {n:8} {n - o:+8}')
+    print(f'{"Total":32} {"":8} {"":8} {total:+8}')
+
+    print(f'\n{"Function":40} {"Old":>16} {"New":>16} {"Diff":>6}')
+    for name in sorted(set(old_funcs) & set(new_funcs)):
+        (o, os_), (n, ns) = old_funcs[name], new_funcs[name]
+        if (o, os_) == (n, ns):
+            continue
+
+        print(f'{name:40} {o:6} {os_:>9} {n:6} {ns:>9} {n - o:+6}')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+#
+# Decode the frames of the "sensor_stream start" shell command to CSV.
+#
+# Every frame is laid out as:
+#
+#   - the sync bytes 0xa5 0x5a
+#   - the length of the fields up to the CRC (u8)
+#   - the sequence number (u16 le)
+#   - the timestamp in microseconds (u32 le)
+#   - the number of channels (u8)
+#   - the channel (u8) and its value in thousandths (s32 le), per channel
+#   - the CRC32 (IEEE) of the length and the fields (u32 le)
+#
+# The bytes between the frames (shell prompt, logs...) are skipped. The input
+# is a capture file, or a serial device the start command is sent to, e.g.:
+#
+#   sensor_stream.py /dev/ttyUSB0 -c 'sensor_stream start bh1750 10 light'
+#
+# The sequence gaps count the frames dropped on the device, or lost on the
+# link; a summary is printed to stderr at the end.
+
+import argparse
+import csv
+import os
+import stat
+import struct
+import sys
+import termios
+import time
+import zlib
+
+SYNC = b'\xa5\x5a'
+FIELDS = struct.Struct('<HIB')
+VALUE = struct.Struct('<Bi')
+CRC = struct.Struct('<I')
+
+# enum sensor_channel
+CHANNELS = {
+    0: 'accel_x', 1: 'accel_y', 2: 'accel_z',
+    4: 'gyro_x', 5: 'gyro_y', 6: 'gyro_z',
+    12: 'die_temp', 13: 'ambient_temp', 14: 'press', 15: 'prox',
+    16: 'humidity', 17: 'light',
+}
+
+
+class Stats:
+    def __init__(self):
+        self.frames = 0
+        self.invalid = 0
+        self.missing = 0
+        self.first = None
+        self.last = None
+
+
+def frames(chunks, stats):
+    buf = bytearray()
+    for chunk in chunks:
+        buf += chunk
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                del buf[:-1]
+                break
+
+            del buf[:start]
+            if len(buf) < 3:
+                break
+
+            length = buf[2]
+            end = 3 + length + CRC.size
+            if len(buf) < end:
+                break
+
+            crc, = CRC.unpack_from(buf, 3 + length)
+            if length < FIELDS.size or zlib.crc32(buf[2:3 + length]) != crc:
+                stats.invalid += 1
+                del buf[:1]
+                continue
+
+            seq, timestamp, count = FIELDS.unpack_from(buf, 3)
+            if length != FIELDS.size + count * VALUE.size:
+                stats.invalid += 1
+                del buf[:1]
+                continue
+
+            values = [VALUE.unpack_from(buf, 3 + FIELDS.size + i * VALUE.size)
+                      for i in range(count)]
+            del buf[:end]
+            yield seq, timestamp, values
+
+
+def read_file(f):
+    while True:
+        chunk = f.read(4096)
+        if not chunk:
+            return
+
+        yield chunk
+
+
+def read_tty(path, baud, command):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attrs = termios.tcgetattr(fd)
+    speed = getattr(termios, f'B{baud}')
+    attrs[0] = 0
+    attrs[1] = 0
+    attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attrs[3] = 0
+    attrs[4] = attrs[5] = speed
+    attrs[6][termios.VMIN] = 1
+    attrs[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+
+    if command:
+        os.write(fd, command.encode() + b'\r')
+
+    try:
+        while True:
+            yield os.read(fd, 4096)
+    except KeyboardInterrupt:
+        # Any byte stops the stream
+        os.write(fd, b'\r')
+    finally:
+        os.close(fd)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('input', nargs='?', default='-',
+                        help='capture file or serial device')
+    parser.add_argument('-c', '--command',
+                        help='shell command sent to the serial device')
+    parser.add_argument('-b', '--baud', type=int, default=115200,
+                        help='serial device baud rate')
+    args = parser.parse_args()
+
+    if args.input == '-':
+        chunks = read_file(sys.stdin.buffer)
+    elif stat.S_ISCHR(os.stat(args.input).st_mode):
+        chunks = read_tty(args.input, args.baud, args.command)
+    else:
+        chunks = read_file(open(args.input, 'rb'))
+
+    stats = Stats()
+    writer = csv.writer(sys.stdout)
+    header = None
+    prev = None
+    started = time.monotonic()
+    for seq, timestamp, values in frames(chunks, stats):
+        channels = [chan for chan, _ in values]
+        if channels != header:
+            header = channels
+            writer.writerow(['seq', 'timestamp_us'] +
+                            [CHANNELS.get(c, f'chan{c}') for c in channels])
+
+        if prev is not None:
+            stats.missing += (seq - prev - 1) & 0xffff
+        prev = seq
+
+        if stats.first is None:
+            stats.first = timestamp
+        stats.last = timestamp
+        stats.frames += 1
+
+        writer.writerow([seq, timestamp] +
+                        [f'{value / 1000:.3f}' for _, value in values])
+
+    elapsed = time.monotonic() - started
+    print(f'Frames: {stats.frames}, missing: {stats.missing}, '
+          f'invalid: {stats.invalid}', file=sys.stderr)
+    if stats.frames > 1:
+        span = ((stats.last - stats.first) & 0xffffffff) / 1e6
+        if span:
+            print(f'Rate: {(stats.frames - 1) / span:.1f} Hz over {span:.1f}s '
+                  f'({elapsed:.1f}s read)', file=sys.stderr)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+#
+# Report the thread stack sizes of a build, and flag the oversized and the
+# undersized ones.
+#
+# The stack sizes are read from the zephyr/.config of the build directory.
+#
+# With CONFIG_STACK_USAGE=y, the compiler writes the frame size of every
+# function to the .su files of the build directory; the largest frames are
+# listed, as they set the floor of the stacks they run on (e.g. the fcb shell
+# commands putting an FCB entry buffer on the shell stack).
+#
+# With the log of the application monitor (CONFIG_APP_MONITOR=y), or the
+# output of the "monitor show" shell command, the stack high-water marks are
+# compared to the sizes; a size is suggested for the stacks short of headroom
+# or mostly unused, as the high-water mark plus the headroom, rounded up.
+
+import argparse
+import os
+import re
+import sys
+
+# Thread names, as set by k_thread_name_set(), to the Kconfig stack sizes
+THREADS = {
+    'main': 'CONFIG_MAIN_STACK_SIZE',
+    'idle': 'CONFIG_IDLE_STACK_SIZE',
+    'sysworkq': 'CONFIG_SYSTEM_WORKQUEUE_STACK_SIZE',
+    'shell_uart': 'CONFIG_SHELL_STACK_SIZE',
+    'logging': 'CONFIG_LOG_PROCESS_THREAD_STACK_SIZE',
+    'BT RX': 'CONFIG_BT_RX_STACK_SIZE',
+    'BT TX': 'CONFIG_BT_HCI_TX_STACK_SIZE',
+    'i2c_queue': 'CONFIG_I2C_QUEUE_THREAD_STACK_SIZE',
+    'fcb_maint': 'CONFIG_FCB_MAINT_THREAD_STACK_SIZE',
+    'fcb_staging': 'CONFIG_FCB_STAGING_THREAD_STACK_SIZE',
+}
+
+# "Monitor: <name> <load>% cpu <used>/<size> stack", or the shell table
+MONITOR_LOG = re.compile(r'Monitor: (.+?)\s+[\d.]+% cpu\s+(\d+)/\s*(\d+) stack')
+MONITOR_SHELL = re.compile(r'^(.+?)\s+[\d.]+%\s+(\d+)\s+(\d+)\s+\d+%')
+
+
+def config(path):
+    symbols = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'(CONFIG_\w*STACK_SIZE)=(\d+)', line)
+            if m:
+                symbols[m.group(1)] = int(m.group(2))
+
+    return symbols
+
+
+def frames(build):
+    for root, _, files in os.walk(build):
+        for name in files:
+            if not name.endswith('.su'):
+                continue
+
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.rstrip('\n').split('\t')
+                    if len(fields) < 2 or not fields[1].isdigit():
+                        continue
+
+                    yield fields[0], int(fields[1]), fields[2:]
+
+
+def marks(path):
+    # The last report of every thread wins
+    threads = {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.strip()
+            m = MONITOR_LOG.search(line) or MONITOR_SHELL.match(line)
+            if m:
+                threads[m.group(1).strip()] = (int(m.group(2)),
+                                               int(m.group(3)))
+
+    return threads
+
+
+def suggest(used, headroom, align):
+    size = used * 100 // (100 - headroom) + 1
+    return (size + align - 1) // align * align
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('build', help='build directory')
+    parser.add_argument('-m', '--monitor',
+                        help='monitor log or shell output')
+    parser.add_argument('-n', '--frames', type=int, default=10,
+                        help='number of largest frames listed')
+    parser.add_argument('--headroom', type=int, default=10,
+                        help='minimum headroom, in percent')
+    parser.add_argument('--usage', type=int, default=50,
+                        help='minimum usage, in percent')
+    parser.add_argument('--align', type=int, default=256,
+                        help='alignment of the suggested sizes')
+    args = parser.parse_args()
+
+    symbols = config(os.path.join(args.build, 'zephyr', '.config'))
+
+    print('Stack sizes:')
+    for symbol, size in sorted(symbols.items()):
+        print(f'  {symbol:48} {size:6}')
+
+    largest = sorted(frames(args.build), key=lambda f: f[1], reverse=True)
+    if largest:
+        print('\nLargest frames:')
+        for function, size, qualifiers in largest[:args.frames]:
+            print(f'  {function:48} {size:6} {" ".join(qualifiers)}')
+
+    if not args.monitor:
+        return 0
+
+    status = 0
+    print('\nHigh-water marks:')
+    for name, (used, size) in sorted(marks(args.monitor).items()):
+        symbol = THREADS.get(name, '')
+        flag = ''
+        if (size - used) * 100 < size * args.headroom:
+            flag = 'undersized'
+            status = 1
+        elif used * 100 < size * args.usage:
+            flag = 'oversized'
+
+        hint = ''
+        if flag:
+            hint = f'{symbol or "size"}={suggest(used, args.headroom, args.align)}'
+
+        print(f'  {name:16} {used:6}/{size:6} {flag:10} {hint}')
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+#
+# Decode the batches of records published by the uplink to CSV.
+#
+# Every line is the hex encoding of a batch, as output by:
+#
+#   mosquitto_sub -t esperimentative-idiot/records -q 1 -F %x
+#
+# A batch is a sequence of records, each one prefixed by its length (u8). A
+# record, version 2, is laid out as:
+#
+#   - the version (u8)
+#   - the bitmap of the channels that follow (u8)
+#   - the timestamp in seconds since the epoch (u32 le), or since boot until
+#     the RTC is read
+#   - the value in thousandths (s32 le), per channel set, in ascending order
+#
+# The records of version 1 are alike, but for their timestamp in milliseconds
+# since boot, output in seconds. Other lines, and the records of other
+# versions, are ignored.
+
+import argparse
+import csv
+import struct
+import sys
+
+HDR = struct.Struct('<BBI')
+VALUE = struct.Struct('<i')
+CHANNELS = ['temperature', 'pressure', 'light', 'humidity']
+
+
+def records(lines, stats):
+    for num, line in enumerate(lines, 1):
+        try:
+            batch = bytes.fromhex(line.strip())
+        except ValueError:
+            continue
+
+        off = 0
+        while off < len(batch):
+            length = batch[off]
+            record = batch[off + 1:off + 1 + length]
+            off += 1 + length
+            if len(record) != length or length < HDR.size:
+                print(f'{num}: truncated record', file=sys.stderr)
+                stats['invalid'] += 1
+                break
+
+            version, channels, timestamp = HDR.unpack_from(record)
+            if version == 1:
+                timestamp /= 1000
+            elif version != 2:
+                stats['invalid'] += 1
+                continue
+
+            count = bin(channels).count('1')
+            if length != HDR.size + count * VALUE.size:
+                print(f'{num}: malformed record', file=sys.stderr)
+                stats['invalid'] += 1
+                continue
+
+            values = {}
+            for i, chan in enumerate(c for c in range(8) if channels & 1 << c):
+                value, = VALUE.unpack_from(record, HDR.size + i * VALUE.size)
+                values[chan] = value
+            yield timestamp, values
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode the batches of records published by the uplink to CSV.')
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'),
+                        default=sys.stdin,
+                        help='hex encoded batches, one per line (default: stdin)')
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'),
+                        default=sys.stdout,
+                        help='CSV output (default: stdout)')
+    args = parser.parse_args()
+
+    stats = {'records': 0, 'invalid': 0}
+    writer = csv.writer(args.output)
+    writer.writerow(['timestamp'] + CHANNELS)
+    for timestamp, values in records(args.input, stats):
+        writer.writerow([timestamp] +
+                        ['' if c not in values else f'{values[c] / 1000:.3f}'
+                         for c in range(len(CHANNELS))])
+        stats['records'] += 1
+        args.output.flush()
+
+    print(f'Records: {stats["records"]}, invalid: {stats["invalid"]}',
+          file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
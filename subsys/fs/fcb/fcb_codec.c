@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb_codec.h>
+#include <zephyr/sys/util.h>
+
+#include <errno.h>
+
+/*
+ * The LZ stream is made of groups of up to 8 items, each group prefixed by a
+ * flag byte whose bit i tells whether item i is a literal byte (0) or a match
+ * (1). A match is 2 bytes: the distance minus 1, and the length minus 3, so
+ * that it refers to up to LZ_MAX_MATCH bytes within the last LZ_WINDOW ones.
+ */
+#define LZ_WINDOW 256
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 255)
+
+static inline uint32_t zigzag_encode(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t varint_encode(uint32_t value, uint8_t *out)
+{
+	size_t len = 0;
+
+	while (value >= 0x80) {
+		out[len++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	out[len++] = value;
+
+	return len;
+}
+
+static int varint_decode(const uint8_t *in, size_t len, uint32_t *value)
+{
+	size_t i;
+
+	*value = 0;
+	for (i = 0; (i < len) && (i < FCB_CODEC_DOD_MAX_LEN); i++) {
+		*value |= (uint32_t)(in[i] & 0x7f) << (7 * i);
+		if ((in[i] & 0x80) == 0) {
+			return i + 1;
+		}
+	}
+
+	return -EBADMSG;
+}
+
+size_t fcb_codec_dod_encode(struct fcb_codec_dod *dod, int32_t value,
+			    uint8_t *out)
+{
+	/* Wrap around rather than overflow */
+	int32_t delta = (int32_t)((uint32_t)value - (uint32_t)dod->prev);
+	int32_t diff;
+
+	switch (dod->count) {
+	case 0:
+		diff = value;
+		break;
+	case 1:
+		diff = delta;
+		break;
+	default:
+		diff = (int32_t)((uint32_t)delta - (uint32_t)dod->delta);
+		break;
+	}
+
+	dod->delta = delta;
+	dod->prev = value;
+	dod->count++;
+
+	return varint_encode(zigzag_encode(diff), out);
+}
+
+int fcb_codec_dod_decode(struct fcb_codec_dod *dod, const uint8_t *in,
+			 size_t len, int32_t *value)
+{
+	uint32_t raw;
+	int32_t diff;
+	int ret;
+
+	ret = varint_decode(in, len, &raw);
+	if (ret < 0) {
+		return ret;
+	}
+
+	diff = zigzag_decode(raw);
+	switch (dod->count) {
+	case 0:
+		*value = diff;
+		break;
+	case 1:
+		*value = (int32_t)((uint32_t)dod->prev + (uint32_t)diff);
+		break;
+	default:
+		*value = (int32_t)((uint32_t)dod->prev + (uint32_t)dod->delta +
+				   (uint32_t)diff);
+		break;
+	}
+
+	dod->delta = (int32_t)((uint32_t)*value - (uint32_t)dod->prev);
+	dod->prev = *value;
+	dod->count++;
+
+	return ret;
+}
+
+int fcb_codec_lz_encode(const uint8_t *in, size_t len, uint8_t *out,
+			size_t size)
+{
+	size_t pos = 0, olen = 0, flag = 0;
+	int item = 8;
+
+	while (pos < len) {
+		size_t best_len = 0, best_dist = 0;
+		size_t max = MIN(len - pos, LZ_MAX_MATCH);
+		size_t dist, n;
+
+		if (item == 8) {
+			if (olen >= size) {
+				return -ENOSPC;
+			}
+
+			flag = olen++;
+			out[flag] = 0;
+			item = 0;
+		}
+
+		/* Look for the longest match, possibly overlapping pos */
+		for (dist = 1; (dist <= MIN(pos, LZ_WINDOW)) &&
+			       (best_len < max); dist++) {
+			n = 0;
+			while ((n < max) && (in[pos - dist + n] == in[pos + n])) {
+				n++;
+			}
+
+			if (n > best_len) {
+				best_len = n;
+				best_dist = dist;
+			}
+		}
+
+		if (best_len >= LZ_MIN_MATCH) {
+			if (olen + 2 > size) {
+				return -ENOSPC;
+			}
+
+			out[flag] |= BIT(item);
+			out[olen++] = best_dist - 1;
+			out[olen++] = best_len - LZ_MIN_MATCH;
+			pos += best_len;
+		} else {
+			if (olen + 1 > size) {
+				return -ENOSPC;
+			}
+
+			out[olen++] = in[pos++];
+		}
+
+		item++;
+	}
+
+	return olen;
+}
+
+int fcb_codec_lz_decode(const uint8_t *in, size_t len, uint8_t *out,
+			size_t size)
+{
+	size_t pos = 0, olen = 0;
+	uint8_t flag = 0;
+	int item = 8;
+
+	while (pos < len) {
+		if (item == 8) {
+			flag = in[pos++];
+			item = 0;
+			continue;
+		}
+
+		if (flag & BIT(item)) {
+			size_t dist, n;
+
+			if (pos + 2 > len) {
+				return -EBADMSG;
+			}
+
+			dist = in[pos++] + 1;
+			n = in[pos++] + LZ_MIN_MATCH;
+			if (dist > olen) {
+				return -EBADMSG;
+			}
+
+			if (olen + n > size) {
+				return -ENOSPC;
+			}
+
+			/* Byte per byte, as the match may overlap */
+			while (n--) {
+				out[olen] = out[olen - dist];
+				olen++;
+			}
+		} else {
+			if (olen + 1 > size) {
+				return -ENOSPC;
+			}
+
+			out[olen++] = in[pos++];
+		}
+
+		item++;
+	}
+
+	return olen;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/fs/fcb_maint.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/util.h>
+#if defined(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(fcb_maint, CONFIG_FCB_MAINT_LOG_LEVEL);
+
+/*
+ * The counters are saved to the settings, unless the FCB is on the settings
+ * partition, for want of a partition of its own.
+ */
+#if defined(CONFIG_SETTINGS) && DT_HAS_CHOSEN(zephyr_fcb_staging_partition)
+#define MAINT_SETTINGS 1
+#endif
+
+static struct fcb *fcb;
+static uint32_t wear[CONFIG_FCB_MAINT_SECTOR_COUNT];
+static bool dirty;
+static bool loaded;
+
+static struct k_spinlock lock;
+static struct fcb_maint_stats stats;
+
+static K_SEM_DEFINE(maint_sem, 0, 1);
+static K_KERNEL_STACK_DEFINE(maint_stack, CONFIG_FCB_MAINT_THREAD_STACK_SIZE);
+static struct k_thread maint_thread_data;
+
+#if defined(MAINT_SETTINGS)
+/*
+ * The counters are kept in the settings rather than in the log, so that the
+ * rotations do not erase them, and the readers of the log do not see them.
+ * They are loaded once, at attach time, and added to the erases counted
+ * before; a later load of all the settings does not roll them back.
+ */
+static int maint_settings_set(const char *name, size_t len,
+			      settings_read_cb read_cb, void *cb_arg)
+{
+	uint32_t counts[CONFIG_FCB_MAINT_SECTOR_COUNT];
+	k_spinlock_key_t key;
+	ssize_t ret;
+	int i;
+
+	if (strcmp(name, "wear")) {
+		return -ENOENT;
+	}
+
+	if (loaded || (fcb == NULL)) {
+		return 0;
+	}
+
+	if (len != fcb->f_sector_cnt * sizeof(counts[0])) {
+		return -EINVAL;
+	}
+
+	ret = read_cb(cb_arg, counts, len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	key = k_spin_lock(&lock);
+	for (i = 0; i < fcb->f_sector_cnt; i++) {
+		wear[i] += counts[i];
+	}
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(fcb_maint, "fcb_maint", NULL,
+			       maint_settings_set, NULL, NULL);
+
+static void wear_load(void)
+{
+	int ret;
+
+	ret = settings_subsys_init();
+	if (ret == 0) {
+		ret = settings_load_subtree("fcb_maint");
+	}
+	if (ret) {
+		LOG_WRN("Failed to load wear counters, ret: %d", ret);
+	}
+
+	loaded = true;
+}
+
+static void wear_save(void)
+{
+	uint32_t counts[CONFIG_FCB_MAINT_SECTOR_COUNT];
+	k_spinlock_key_t key;
+	int ret;
+
+	key = k_spin_lock(&lock);
+	memcpy(counts, wear, fcb->f_sector_cnt * sizeof(counts[0]));
+	dirty = false;
+	k_spin_unlock(&lock, key);
+
+	ret = settings_save_one("fcb_maint/wear", counts,
+				fcb->f_sector_cnt * sizeof(counts[0]));
+	if (ret) {
+		LOG_ERR("Failed to save wear counters, ret: %d", ret);
+		key = k_spin_lock(&lock);
+		dirty = true;
+		k_spin_unlock(&lock, key);
+	}
+}
+#else
+static inline void wear_load(void)
+{
+	loaded = true;
+}
+
+static inline void wear_save(void)
+{
+	dirty = false;
+}
+#endif
+
+static void maint_check(void)
+{
+	uint32_t start, cycles;
+	k_spinlock_key_t key;
+	int i, ret;
+
+	ret = k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (ret) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	stats.checks++;
+	k_spin_unlock(&lock, key);
+
+	/* Rotate at most once per sector, should the FCB misbehave */
+	for (i = 0; i < fcb->f_sector_cnt; i++) {
+		if (fcb_free_sector_cnt(fcb) >=
+		    fcb->f_scratch_cnt + CONFIG_FCB_MAINT_FREE_SECTORS) {
+			break;
+		}
+
+		start = k_cycle_get_32();
+		ret = fcb_maint_rotate(fcb);
+		cycles = k_cycle_get_32() - start;
+		if (ret) {
+			LOG_ERR("Failed to rotate fcb, ret: %d", ret);
+			break;
+		}
+
+		key = k_spin_lock(&lock);
+		stats.rotations++;
+		stats.rotate_max_cycles = MAX(stats.rotate_max_cycles, cycles);
+		k_spin_unlock(&lock, key);
+	}
+
+	k_mutex_unlock(&fcb->f_mtx);
+
+	/* Saved out of the FCB lock, the settings are on another partition */
+	if (dirty) {
+		wear_save();
+	}
+}
+
+static void maint_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		maint_check();
+
+		/* Check on kick, or once the interval has elapsed */
+		(void)k_sem_take(&maint_sem,
+				 K_MSEC(CONFIG_FCB_MAINT_INTERVAL_MS));
+	}
+}
+
+int fcb_maint_attach(struct fcb *f)
+{
+	if (fcb) {
+		return -EALREADY;
+	}
+
+	if (f->f_sector_cnt > ARRAY_SIZE(wear)) {
+		return -EINVAL;
+	}
+
+	/* The active sector is never free */
+	if (f->f_scratch_cnt + CONFIG_FCB_MAINT_FREE_SECTORS >=
+	    f->f_sector_cnt - 1) {
+		LOG_ERR("Too few sectors to keep %u free",
+			CONFIG_FCB_MAINT_FREE_SECTORS);
+		return -EINVAL;
+	}
+
+	fcb = f;
+	wear_load();
+
+	k_thread_create(&maint_thread_data, maint_stack,
+			K_KERNEL_STACK_SIZEOF(maint_stack), maint_thread,
+			NULL, NULL, NULL,
+			K_PRIO_PREEMPT(CONFIG_FCB_MAINT_THREAD_PRIORITY), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&maint_thread_data, "fcb_maint");
+
+	return 0;
+}
+
+void fcb_maint_kick(void)
+{
+	k_sem_give(&maint_sem);
+}
+
+/* The sector erased is the oldest one, even when it is the active one */
+int fcb_maint_rotate(struct fcb *f)
+{
+	const struct flash_sector *sector;
+	k_spinlock_key_t key;
+	int ret;
+
+	if (f != fcb) {
+		return fcb_rotate(f);
+	}
+
+	ret = k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (ret) {
+		return ret;
+	}
+
+	sector = fcb->f_oldest;
+	ret = fcb_rotate(fcb);
+	if (ret == 0) {
+		key = k_spin_lock(&lock);
+		wear[sector - fcb->f_sectors]++;
+		stats.erases++;
+		dirty = true;
+		k_spin_unlock(&lock, key);
+	}
+
+	k_mutex_unlock(&fcb->f_mtx);
+
+	return ret;
+}
+
+int fcb_maint_clear(struct fcb *f)
+{
+	int ret = 0;
+
+	while (!fcb_is_empty(f)) {
+		ret = fcb_maint_rotate(f);
+		if (ret) {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+int fcb_maint_wear_get(uint32_t *counts, size_t count)
+{
+	k_spinlock_key_t key;
+
+	if (!fcb) {
+		return -ENODEV;
+	}
+
+	count = MIN(count, fcb->f_sector_cnt);
+	key = k_spin_lock(&lock);
+	memcpy(counts, wear, count * sizeof(counts[0]));
+	k_spin_unlock(&lock, key);
+
+	return fcb->f_sector_cnt;
+}
+
+void fcb_maint_stats_get(struct fcb_maint_stats *out)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	*out = stats;
+	k_spin_unlock(&lock, key);
+}
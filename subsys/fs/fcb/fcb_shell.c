@@ -8,13 +8,22 @@
 #include <zephyr/kernel.h>
 #include <zephyr/devicetree.h>
 
+#include <zephyr/random/rand32.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/sys/base64.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
 #include <zephyr/sys/util.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <zephyr/drivers/flash.h>
+#include <zephyr/drivers/uart.h>
 #include <zephyr/fs/fcb.h>
+#include <zephyr/fs/fcb_codec.h>
+#include <zephyr/fs/fcb_maint.h>
+#include <zephyr/fs/fcb_staging.h>
+#include <zephyr/fs/fcb_stats.h>
 
 #if DT_HAS_CHOSEN(zephyr_settings_partition)
 #define SETTINGS_PARTITION DT_FIXED_PARTITION_ID(DT_CHOSEN(zephyr_settings_partition))
@@ -69,26 +78,163 @@ static int init_helper(const struct shell *shell, int id, struct fcb *fcb,
 	return 0;
 }
 
-static int cmd_info(const struct shell *shell, size_t argc, char *argv[])
+typedef int (*fcb_cmd_handler)(const struct shell *shell, struct fcb *fcb,
+			       size_t argc, char *argv[]);
+
+/*
+ * The commands run on the FCB the staging commits to, if any, as a second
+ * instance over the same partition would miss its appends and rotations, and
+ * write over them. The FCB is locked for the whole command, so neither the
+ * staging nor the maintenance interleave with it.
+ */
+static int fcb_cmd(const struct shell *shell, size_t argc, char *argv[],
+		   fcb_cmd_handler handler)
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
+	static struct flash_sector fs[10];
+	static struct fcb shell_fcb;
+	struct fcb *fcb = NULL;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
+#if defined(CONFIG_FCB_STAGING)
+	fcb = fcb_staging_fcb();
+#endif
+	if (fcb == NULL) {
+		ret = init_helper(shell, SETTINGS_PARTITION, &shell_fcb, fs,
+				  ARRAY_SIZE(fs));
+		if (ret) {
+			return ret;
+		}
+
+		fcb = &shell_fcb;
+	}
+
+	ret = k_mutex_lock(&fcb->f_mtx, K_FOREVER);
 	if (ret) {
+		shell_error(shell, "Failed to lock fcb, ret: %d", ret);
 		return ret;
 	}
 
+	ret = handler(shell, fcb, argc, argv);
+	k_mutex_unlock(&fcb->f_mtx);
+
+#if defined(CONFIG_FCB_MAINT)
+	/* Count the sectors the command erased, if any */
+	fcb_maint_kick();
+#endif
+
+	return ret;
+}
+
+#define FCB_CMD_DEFINE(name)							\
+	static int cmd_##name(const struct shell *shell, size_t argc,		\
+			      char *argv[])					\
+	{									\
+		return fcb_cmd(shell, argc, argv, name##_handler);		\
+	}
+
+#if defined(CONFIG_FCB_STATS)
+static int print_sample_cb(uint32_t timestamp, int32_t value, void *arg)
+{
+	const struct shell *shell = (const struct shell *)arg;
+
+	shell_print(shell, "%10u %11d", timestamp, value);
+
+	return 0;
+}
+#endif
+
+#if defined(CONFIG_FCB_STAGING)
+static int print_record_cb(const uint8_t *data, uint8_t len, void *arg)
+{
+	const struct shell *shell = (const struct shell *)arg;
+
+	shell_hexdump(shell, data, len);
+
+	return 0;
+}
+#endif
+
+/* Decode the entries of known types, compressed or not; dump the others */
+static void print_entry(const struct shell *shell, const uint8_t *buf,
+			uint16_t len)
+{
+	int ret = -ENOMSG;
+
+#if defined(CONFIG_FCB_STATS)
+	ret = fcb_stats_foreach(buf, len, print_sample_cb, (void *)shell);
+#endif
+#if defined(CONFIG_FCB_STAGING)
+	if (ret == -ENOMSG) {
+		ret = fcb_staging_foreach(buf, len, print_record_cb,
+					  (void *)shell);
+	}
+#endif
+	if (ret == 0) {
+		return;
+	}
+
+	if (ret != -ENOMSG) {
+		shell_warn(shell, "Failed to decode entry, ret: %d", ret);
+	}
+
+	shell_hexdump(shell, buf, len);
+}
+
+#if defined(CONFIG_FCB_MAINT)
+static void print_wear(const struct shell *shell)
+{
+	uint32_t wear[CONFIG_FCB_MAINT_SECTOR_COUNT], max = 0;
+	uint64_t uptime = k_uptime_get() / MSEC_PER_SEC;
+	struct fcb_maint_stats stats;
+	uint64_t per_day = 0;
+	int i, n;
+
+	n = fcb_maint_wear_get(wear, ARRAY_SIZE(wear));
+	if (n < 0) {
+		shell_print(shell, "Wear:              n/a");
+		return;
+	}
+
+	fcb_maint_stats_get(&stats);
+
+	for (i = 0; i < n; i++) {
+		shell_print(shell, "Sector %2d erases:  %u", i, wear[i]);
+		max = MAX(max, wear[i]);
+	}
+
+	shell_print(shell, "Erases:            %u (%u ahead of need)",
+		    stats.erases, stats.rotations);
+	shell_print(shell, "Rotate max:        %uus",
+		    k_cyc_to_us_ceil32(stats.rotate_max_cycles));
+
+	/* Extrapolate the wear of the most erased sector at the current rate */
+	if (uptime) {
+		per_day = (stats.erases * 86400ULL) / uptime;
+	}
+	if (max >= CONFIG_FCB_MAINT_ENDURANCE) {
+		shell_print(shell, "End of life:       reached");
+	} else if (per_day) {
+		shell_print(shell, "End of life:       %llu day(s)",
+			    ((CONFIG_FCB_MAINT_ENDURANCE - max) * (uint64_t)n) /
+			    per_day);
+	} else {
+		shell_print(shell, "End of life:       n/a");
+	}
+}
+#endif
+
+static int info_handler(const struct shell *shell, struct fcb *fcb,
+			size_t argc, char *argv[])
+{
+	int ret;
 
-	shell_print(shell, "Magic:             %08x", fcb.f_magic);
-	shell_print(shell, "Version:           %d", fcb.f_version);
-	shell_print(shell, "Sector count:      %d", fcb.f_sector_cnt);
-	shell_print(shell, "Scratch count:     %d", fcb.f_scratch_cnt);
-	shell_print(shell, "Erase value:       %x", fcb.f_erase_value);
+	shell_print(shell, "Magic:             %08x", fcb->f_magic);
+	shell_print(shell, "Version:           %d", fcb->f_version);
+	shell_print(shell, "Sector count:      %d", fcb->f_sector_cnt);
+	shell_print(shell, "Scratch count:     %d", fcb->f_scratch_cnt);
+	shell_print(shell, "Erase value:       %x", fcb->f_erase_value);
 
-	ret = fcb_free_sector_cnt(&fcb);
+	ret = fcb_free_sector_cnt(fcb);
 	if (ret < 0) {
 		shell_error(shell, "Failed to get free sector count from fcb, ret: %d",
 			    ret);
@@ -97,7 +243,7 @@ static int cmd_info(const struct shell *shell, size_t argc, char *argv[])
 
 	shell_print(shell, "Free sector count: %d", ret);
 
-	ret = fcb_is_empty(&fcb);
+	ret = fcb_is_empty(fcb);
 	if (ret < 0) {
 		shell_error(shell, "Failed to get emptyness from fcb, ret: %d",
 			    ret);
@@ -106,23 +252,22 @@ static int cmd_info(const struct shell *shell, size_t argc, char *argv[])
 
 	shell_print(shell, "Empty:             %d", ret);
 
+#if defined(CONFIG_FCB_MAINT)
+	print_wear(shell);
+#endif
+
 	return 0;
 }
 
-static int cmd_is_empty(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(info);
+
+static int is_empty_handler(const struct shell *shell, struct fcb *fcb,
+			    size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	struct fcb_entry loc;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
-	if (ret) {
-		return ret;
-	}
-
-	ret = fcb_is_empty(&fcb);
+	ret = fcb_is_empty(fcb);
 	if (ret < 0) {
 		shell_error(shell, "Failed to get emptyness from fcb, ret: %d",
 			    ret);
@@ -137,23 +282,18 @@ static int cmd_is_empty(const struct shell *shell, size_t argc, char *argv[])
 	return 0;
 }
 
-static int cmd_next(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(is_empty);
+
+static int next_handler(const struct shell *shell, struct fcb *fcb,
+			size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	uint8_t buf[FCB_MAX_LEN];
 	uint16_t len;
 	struct fcb_entry loc;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
-	if (ret) {
-		return ret;
-	}
-
 	memset(&loc, 0, sizeof(loc));
-	ret = fcb_getnext(&fcb, &loc);
+	ret = fcb_getnext(fcb, &loc);
 	if (ret) {
 		shell_error(shell, "Failed to get next from fcb, ret: %d",
 			    ret);
@@ -163,37 +303,32 @@ static int cmd_next(const struct shell *shell, size_t argc, char *argv[])
 	len = loc.fe_data_len;
 	shell_print(shell, "Reading %u bytes to offset 0x%lx", len,
 		    FCB_ENTRY_FA_DATA_OFF(loc));
-	ret = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
+	ret = flash_area_read(fcb->fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
 	if (ret) {
 		shell_error(shell, "Failed to read flash area, ret: %d", ret);
 		return ret;
 	}
 
-	shell_hexdump(shell, buf, len);
+	print_entry(shell, buf, len);
 
 	return 0;
 }
 
-static int cmd_last(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(next);
+
+static int last_handler(const struct shell *shell, struct fcb *fcb,
+			size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	uint8_t n = 0, buf[FCB_MAX_LEN];
 	uint16_t len;
 	struct fcb_entry loc;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
-	if (ret) {
-		return ret;
-	}
-
 	if (argc > 1)
 		n = strtoul(argv[1], NULL, 16);
 
 	memset(&loc, 0, sizeof(loc));
-	ret = fcb_offset_last_n(&fcb, n, &loc);
+	ret = fcb_offset_last_n(fcb, n, &loc);
 	if (ret) {
 		shell_error(shell, "Failed to get offset last n from fcb, ret: %d",
 			    ret);
@@ -203,36 +338,31 @@ static int cmd_last(const struct shell *shell, size_t argc, char *argv[])
 	len = loc.fe_data_len;
 	shell_print(shell, "Reading %u bytes to offset 0x%lx", len,
 		    FCB_ENTRY_FA_DATA_OFF(loc));
-	ret = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
+	ret = flash_area_read(fcb->fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
 	if (ret) {
 		shell_error(shell, "Failed to read flash area, ret: %d", ret);
 		return ret;
 	}
 
-	shell_hexdump(shell, buf, len);
+	print_entry(shell, buf, len);
 
 	return 0;
 }
 
-static int cmd_append(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(last);
+
+static int append_handler(const struct shell *shell, struct fcb *fcb,
+			  size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	uint8_t *buf;
 	uint16_t len;
 	struct fcb_entry loc;
 	int i, ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
-	if (ret) {
-		return ret;
-	}
-
 	for (i = 1; i < argc; i ++) {
 		buf = argv[i];
 		len = strlen(argv[i]);
-		ret = fcb_append(&fcb, len, &loc);
+		ret = fcb_append(fcb, len, &loc);
 		if (ret) {
 			shell_error(shell, "Failed to append to fcb, ret: %d", ret);
 			return ret;
@@ -240,14 +370,14 @@ static int cmd_append(const struct shell *shell, size_t argc, char *argv[])
 
 		shell_print(shell, "Writing %u byte(s) to offset 0x%lx", len,
 			    FCB_ENTRY_FA_DATA_OFF(loc));
-		ret = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
+		ret = flash_area_write(fcb->fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
 		if (ret) {
 			shell_error(shell, "Failed to write flash area, ret: %d",
 				    ret);
 			return ret;
 		}
 
-		ret = fcb_append_finish(&fcb, &loc);
+		ret = fcb_append_finish(fcb, &loc);
 		if (ret) {
 			shell_error(shell, "Failed to finish append to fcb, ret: %d",
 				    ret);
@@ -258,19 +388,14 @@ static int cmd_append(const struct shell *shell, size_t argc, char *argv[])
 	return 0;
 }
 
-static int cmd_scratch(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(append);
+
+static int scratch_handler(const struct shell *shell, struct fcb *fcb,
+			   size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
-	if (ret) {
-		return ret;
-	}
-
-	ret = fcb_append_to_scratch(&fcb);
+	ret = fcb_append_to_scratch(fcb);
 	if (ret) {
 		shell_error(shell, "Failed to finish append to fcb, ret: %d",
 			    ret);
@@ -280,6 +405,8 @@ static int cmd_scratch(const struct shell *shell, size_t argc, char *argv[])
 	return 0;
 }
 
+FCB_CMD_DEFINE(scratch);
+
 static int walk_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
 {
 	const struct shell *shell = (const struct shell *)arg;
@@ -296,45 +423,614 @@ static int walk_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
 		return ret;
 	}
 
-	shell_hexdump(shell, buf, len);
+	print_entry(shell, buf, len);
 
 	return 0;
 }
 
-static int cmd_walk(const struct shell *shell, size_t argc, char *argv[])
+static int walk_handler(const struct shell *shell, struct fcb *fcb,
+			size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
+	ret = fcb_walk(fcb, NULL, walk_cb, (void *)shell);
 	if (ret) {
+		shell_error(shell, "Failed to walk from fcb, ret: %d", ret);
 		return ret;
 	}
 
-	ret = fcb_walk(&fcb, NULL, walk_cb, (void *)shell);
+	return 0;
+}
+
+FCB_CMD_DEFINE(walk);
+
+static int rotate_handler(const struct shell *shell, struct fcb *fcb,
+			  size_t argc, char *argv[])
+{
+	int ret;
+
+	ret = fcb_maint_rotate(fcb);
 	if (ret) {
-		shell_error(shell, "Failed to walk from fcb, ret: %d", ret);
+		shell_error(shell, "Failed to rotate fcb, ret: %d", ret);
 		return ret;
 	}
 
 	return 0;
 }
 
-static int cmd_rotate(const struct shell *shell, size_t argc, char *argv[])
+FCB_CMD_DEFINE(rotate);
+
+static int clear_handler(const struct shell *shell, struct fcb *fcb,
+			 size_t argc, char *argv[])
+{
+	int ret;
+
+	ret = fcb_maint_clear(fcb);
+	if (ret) {
+		shell_error(shell, "Failed to clear fcb, ret: %d", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+FCB_CMD_DEFINE(clear);
+
+#if defined(CONFIG_FCB_STATS)
+#define STATS_MAX_BUCKETS 32
+
+/* "fcb sample" then the pairs, within the arguments the shell splits */
+#define STATS_MAX_SAMPLES MIN(127, (CONFIG_SHELL_ARGC_MAX - 2) / 2)
+
+static int sample_handler(const struct shell *shell, struct fcb *fcb,
+			  size_t argc, char *argv[])
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
+	static uint32_t timestamps[STATS_MAX_SAMPLES];
+	static int32_t values[STATS_MAX_SAMPLES];
+	struct fcb_stats stats;
+	size_t i, count = argc / 2;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
+	if ((argc % 2) == 0) {
+		shell_error(shell, "Missing value");
+		return -EINVAL;
+	}
+
+	ret = fcb_stats_init(&stats, fcb);
 	if (ret) {
+		shell_error(shell, "Failed to init fcb stats, ret: %d", ret);
 		return ret;
 	}
 
-	ret = fcb_rotate(&fcb);
+	for (i = 0; i < count; i++) {
+		timestamps[i] = strtoul(argv[1 + 2 * i], NULL, 0);
+		values[i] = strtol(argv[2 + 2 * i], NULL, 0);
+	}
+
+	/* Several samples are logged as compressed runs */
+	if (count == 1) {
+		ret = fcb_stats_append(&stats, timestamps[0], values[0]);
+	} else {
+		ret = fcb_stats_append_run(&stats, timestamps, values, count);
+	}
+	if (ret) {
+		shell_error(shell, "Failed to append sample to fcb, ret: %d",
+			    ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+FCB_CMD_DEFINE(sample);
+
+static int stats_handler(const struct shell *shell, struct fcb *fcb,
+			 size_t argc, char *argv[])
+{
+	static struct fcb_stats_bucket buckets[STATS_MAX_BUCKETS];
+	uint32_t from, to, width;
+	int i, n, ret;
+
+	from = strtoul(argv[1], NULL, 0);
+	to = strtoul(argv[2], NULL, 0);
+	width = strtoul(argv[3], NULL, 0);
+	ret = fcb_stats_query(fcb, from, to, width, buckets,
+			      ARRAY_SIZE(buckets));
+	if (ret < 0) {
+		shell_error(shell, "Failed to query fcb stats, ret: %d", ret);
+		return ret;
+	}
+
+	shell_print(shell, "%10s %8s %11s %11s %11s", "Start", "Count", "Min",
+		    "Max", "Mean");
+	n = (to - from - 1) / width + 1;
+	for (i = 0; i < n; i++) {
+		if (buckets[i].count == 0) {
+			shell_print(shell, "%10u %8u", from + i * width, 0);
+			continue;
+		}
+
+		shell_print(shell, "%10u %8u %11d %11d %11lld",
+			    from + i * width, buckets[i].count, buckets[i].min,
+			    buckets[i].max, buckets[i].sum / buckets[i].count);
+	}
+
+	shell_print(shell, "Sectors answered from index: %d", ret);
+
+	return 0;
+}
+
+FCB_CMD_DEFINE(stats);
+#endif
+
+#if defined(CONFIG_FCB_STAGING)
+static int cmd_staging_append(const struct shell *shell, size_t argc,
+			      char *argv[])
+{
+	int i, ret;
+
+	for (i = 1; i < argc; i++) {
+		ret = fcb_staging_append(argv[i], strlen(argv[i]));
+		if (ret) {
+			shell_error(shell, "Failed to stage record, ret: %d",
+				    ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_staging_flush(const struct shell *shell, size_t argc,
+			     char *argv[])
+{
+	int ret;
+
+	ret = fcb_staging_flush();
+	if (ret) {
+		shell_error(shell, "Failed to flush staging, ret: %d", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int cmd_staging_stats(const struct shell *shell, size_t argc,
+			     char *argv[])
+{
+	struct fcb_staging_stats stats;
+	uint64_t uptime = k_uptime_get() / MSEC_PER_SEC;
+	uint64_t per_day = 0, unbatched_per_day = 0, ratio = 0;
+
+	fcb_staging_stats_get(&stats);
+
+	/*
+	 * Without staging, every record would have been an entry on its own,
+	 * wearing the flash as many times as many more bytes programmed.
+	 */
+	if (uptime) {
+		per_day = (stats.erases * 86400ULL) / uptime;
+	}
+	if (stats.flash_bytes) {
+		unbatched_per_day = (per_day * stats.unbatched_bytes) /
+				    stats.flash_bytes;
+	}
+	if (stats.written_bytes) {
+		ratio = (stats.group_bytes * 100) / stats.written_bytes;
+	}
+
+	shell_print(shell, "Records:           %u", stats.records);
+	shell_print(shell, "Dropped:           %u", stats.dropped);
+	shell_print(shell, "Commits:           %u", stats.commits);
+	shell_print(shell, "Erases:            %u", stats.erases);
+	shell_print(shell, "Flash bytes:       %llu", stats.flash_bytes);
+	shell_print(shell, "Unbatched bytes:   %llu", stats.unbatched_bytes);
+	shell_print(shell, "Compression:       %llu.%02llu (%llu/%llu)",
+		    ratio / 100, ratio % 100, stats.group_bytes,
+		    stats.written_bytes);
+	shell_print(shell, "Erases/day:        %llu (%llu unbatched)",
+		    per_day, unbatched_per_day);
+	shell_print(shell, "Append max:        %uus",
+		    k_cyc_to_us_ceil32(stats.append_max_cycles));
+	shell_print(shell, "Commit max:        %uus",
+		    k_cyc_to_us_ceil32(stats.commit_max_cycles));
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(staging_cmds,
+	SHELL_CMD_ARG(append, NULL, "data [...]", cmd_staging_append, 2, 255),
+	SHELL_CMD_ARG(flush,  NULL, NULL,         cmd_staging_flush,  1, 0),
+	SHELL_CMD_ARG(stats,  NULL, NULL,         cmd_staging_stats,  1, 0),
+	SHELL_SUBCMD_SET_END
+);
+#endif
+
+#if defined(CONFIG_FCB_SHELL_EXPORT)
+/*
+ * An exported entry is split into frames of up to EXPORT_FRAG_LEN bytes of
+ * data. Every frame is printed as a base64 line starting with '>' and is laid
+ * out as follows (little-endian):
+ *
+ * - the offset of the entry in the flash area (4 bytes)
+ * - the length of the entry (2 bytes)
+ * - the offset of the fragment in the entry (2 bytes)
+ * - the fragment data (up to EXPORT_FRAG_LEN bytes)
+ * - the CRC32 (IEEE) of all the above (4 bytes)
+ *
+ * In raw mode, the frames are written as is to the shell UART instead, each
+ * one after the sync bytes 0x5a 0xfc, so that the output is not inflated by a
+ * third; the host resyncs on the sync bytes past the shell output.
+ *
+ * See scripts/fcb_export.py for the host decoder.
+ */
+#define EXPORT_HDR_LEN 8
+#define EXPORT_FRAG_LEN 192
+#define EXPORT_CRC_LEN 4
+#define EXPORT_FRAME_LEN (EXPORT_HDR_LEN + EXPORT_FRAG_LEN + EXPORT_CRC_LEN)
+#define EXPORT_LINE_LEN (((EXPORT_FRAME_LEN + 2) / 3) * 4 + 1)
+#define EXPORT_CHUNK_LEN 1024
+#define EXPORT_CHUNK_ALIGN 32
+#define EXPORT_SYNC0 0x5a
+#define EXPORT_SYNC1 0xfc
+
+#if DT_HAS_CHOSEN(zephyr_shell_uart)
+#define EXPORT_RAW 1
+#endif
+
+static struct {
+	off_t off;
+	size_t len;
+	uint8_t buf[EXPORT_CHUNK_LEN];
+} export_chunk;
+
+static uint8_t export_frame[EXPORT_FRAME_LEN];
+static char export_line[EXPORT_LINE_LEN];
+
+/*
+ * Entries are read through a chunk covering many of them, so that the flash is
+ * read once per chunk rather than once per entry.
+ */
+static const uint8_t *export_read(const struct flash_area *fap, off_t off,
+				  size_t len)
+{
+	int ret;
+
+	if ((export_chunk.len == 0) || (off < export_chunk.off) ||
+	    (off + len > export_chunk.off + export_chunk.len)) {
+		export_chunk.off = ROUND_DOWN(off, EXPORT_CHUNK_ALIGN);
+		export_chunk.len = MIN(sizeof(export_chunk.buf),
+				       fap->fa_size - export_chunk.off);
+		ret = flash_area_read(fap, export_chunk.off, export_chunk.buf,
+				      export_chunk.len);
+		if (ret) {
+			export_chunk.len = 0;
+			return NULL;
+		}
+	}
+
+	return &export_chunk.buf[off - export_chunk.off];
+}
+
+#if defined(EXPORT_RAW)
+/* The UART is polled, so that the frames do not go through the shell */
+static void export_raw_write(const uint8_t *data, size_t len)
+{
+	const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(zephyr_shell_uart));
+
+	while (len--) {
+		uart_poll_out(uart, *data++);
+	}
+}
+#endif
+
+static int export_entry(const struct shell *shell, struct fcb *fcb,
+			struct fcb_entry *loc, bool raw)
+{
+	off_t off = loc->fe_sector->fs_off + loc->fe_elem_off;
+	uint16_t len = loc->fe_data_len;
+	const uint8_t *data;
+	uint16_t frag = 0;
+	size_t olen;
+	int ret;
+
+	do {
+		uint16_t frag_len = MIN(len - frag, EXPORT_FRAG_LEN);
+
+		data = export_read(fcb->fap,
+				   FCB_ENTRY_FA_DATA_OFF((*loc)) + frag,
+				   frag_len);
+		if (data == NULL) {
+			shell_error(shell, "Failed to read flash area");
+			return -EIO;
+		}
+
+		sys_put_le32(off, &export_frame[0]);
+		sys_put_le16(len, &export_frame[4]);
+		sys_put_le16(frag, &export_frame[6]);
+		memcpy(&export_frame[EXPORT_HDR_LEN], data, frag_len);
+		sys_put_le32(crc32_ieee(export_frame, EXPORT_HDR_LEN + frag_len),
+			     &export_frame[EXPORT_HDR_LEN + frag_len]);
+
+#if defined(EXPORT_RAW)
+		if (raw) {
+			static const uint8_t sync[] = {
+				EXPORT_SYNC0, EXPORT_SYNC1
+			};
+
+			export_raw_write(sync, sizeof(sync));
+			export_raw_write(export_frame, EXPORT_HDR_LEN +
+					 frag_len + EXPORT_CRC_LEN);
+			frag += frag_len;
+			continue;
+		}
+#endif
+
+		ret = base64_encode(export_line, sizeof(export_line), &olen,
+				    export_frame,
+				    EXPORT_HDR_LEN + frag_len + EXPORT_CRC_LEN);
+		if (ret) {
+			shell_error(shell, "Failed to encode frame, ret: %d",
+				    ret);
+			return ret;
+		}
+
+		shell_print(shell, ">%s", export_line);
+		frag += frag_len;
+	} while (frag < len);
+
+	return 0;
+}
+
+/*
+ * Resume after the entry at the offset, which must be the one of an entry still
+ * in the FCB; only the entries of its sector are walked.
+ */
+static int export_resume(struct fcb *fcb, off_t off, struct fcb_entry *loc)
+{
+	int n = fcb->f_sector_cnt;
+	int oldest = fcb->f_oldest - fcb->f_sectors;
+	int active = fcb->f_active.fe_sector - fcb->f_sectors;
+	struct flash_sector *sector;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sector = &fcb->f_sectors[i];
+		if ((off >= sector->fs_off) &&
+		    (off < sector->fs_off + sector->fs_size)) {
+			break;
+		}
+	}
+
+	/* The sectors in use are the oldest one up to the active one */
+	if ((i == n) || ((i - oldest + n) % n > (active - oldest + n) % n)) {
+		return -EINVAL;
+	}
+
+	memset(loc, 0, sizeof(*loc));
+	loc->fe_sector = sector;
+	while ((fcb_getnext(fcb, loc) == 0) && (loc->fe_sector == sector)) {
+		if (sector->fs_off + loc->fe_elem_off == off) {
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int export_handler(const struct shell *shell, struct fcb *fcb,
+			  size_t argc, char *argv[])
+{
+	struct fcb_entry loc;
+	uint32_t count = 0;
+	bool raw = false;
+	off_t last = 0;
+	int ret;
+
+	if ((argc > 1) && (strcmp(argv[1], "raw") == 0)) {
+#if defined(EXPORT_RAW)
+		raw = true;
+		argc--;
+		argv++;
+#else
+		shell_error(shell, "No shell UART for the raw mode");
+		return -ENOTSUP;
+#endif
+	}
+
+	if (argc > 2) {
+		shell_error(shell, "Invalid parameter: %s", argv[2]);
+		return -EINVAL;
+	}
+
+	memset(&loc, 0, sizeof(loc));
+	if (argc > 1) {
+		ret = export_resume(fcb, strtoul(argv[1], NULL, 0), &loc);
+		if (ret) {
+			shell_error(shell, "Invalid offset: %s", argv[1]);
+			return ret;
+		}
+	}
+
+	export_chunk.len = 0;
+	while ((ret = fcb_getnext(fcb, &loc)) == 0) {
+		ret = export_entry(shell, fcb, &loc, raw);
+		if (ret) {
+			return ret;
+		}
+
+		last = loc.fe_sector->fs_off + loc.fe_elem_off;
+		count++;
+	}
+	if (ret != -ENOTSUP) {
+		shell_error(shell, "Failed to get next from fcb, ret: %d", ret);
+		return ret;
+	}
+
+	shell_print(shell, "Exported %u entries, last offset 0x%lx", count,
+		    last);
+
+	return 0;
+}
+
+FCB_CMD_DEFINE(export);
+#endif
+
+#if defined(CONFIG_FCB_SHELL_BENCH)
+#define BENCH_MAX_LEN 256
+#define BENCH_HIST_BUCKETS 16
+
+struct bench_hist {
+	uint32_t buckets[BENCH_HIST_BUCKETS];
+	uint32_t cnt;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t sum_us;
+};
+
+struct bench_stats {
+	uint64_t cycles;
+	uint64_t data_bytes;
+	uint64_t flash_bytes;
+	uint64_t walk_bytes;
+	uint32_t writes;
+	uint32_t erases;
+	struct bench_hist append;
+	struct bench_hist rotate;
+};
+
+static uint8_t bench_buf[BENCH_MAX_LEN];
+
+/*
+ * The flash writes and erases are counted as the FCB issues them, rather than
+ * inferred from the entry layout: while the benchmark runs, the flash area of
+ * the FCB is swapped for a copy on a pass-through flash device counting them.
+ * The other flash users, and the other areas, are not counted.
+ */
+static const struct device *bench_backing;
+static struct bench_stats *bench_counted;
+
+static int bench_flash_read(const struct device *dev, off_t off, void *data,
+			    size_t len)
+{
+	return flash_read(bench_backing, off, data, len);
+}
+
+static int bench_flash_write(const struct device *dev, off_t off,
+			     const void *data, size_t len)
+{
+	struct bench_stats *stats = bench_counted;
+
+	if (stats) {
+		stats->writes++;
+		stats->flash_bytes += len;
+	}
+
+	return flash_write(bench_backing, off, data, len);
+}
+
+static int bench_flash_erase(const struct device *dev, off_t off, size_t len)
+{
+	struct bench_stats *stats = bench_counted;
+
+	if (stats) {
+		stats->erases++;
+	}
+
+	return flash_erase(bench_backing, off, len);
+}
+
+static const struct flash_parameters *
+bench_flash_get_parameters(const struct device *dev)
+{
+	return flash_get_parameters(bench_backing);
+}
+
+#if defined(CONFIG_FLASH_PAGE_LAYOUT)
+static void bench_flash_page_layout(const struct device *dev,
+				    const struct flash_pages_layout **layout,
+				    size_t *layout_size)
+{
+	const struct flash_driver_api *api = bench_backing->api;
+
+	api->page_layout(bench_backing, layout, layout_size);
+}
+#endif
+
+static const struct flash_driver_api bench_flash_api = {
+	.read = bench_flash_read,
+	.write = bench_flash_write,
+	.erase = bench_flash_erase,
+	.get_parameters = bench_flash_get_parameters,
+#if defined(CONFIG_FLASH_PAGE_LAYOUT)
+	.page_layout = bench_flash_page_layout,
+#endif
+};
+
+DEVICE_DEFINE(fcb_bench_flash, "fcb_bench_flash", NULL, NULL, NULL, NULL,
+	      POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+	      &bench_flash_api);
+
+static const uint16_t bench_sizes[] = { 8, 16, 32, 64, 128, 256 };
+
+static void bench_hist_add(struct bench_hist *hist, uint32_t cycles)
+{
+	uint32_t us = k_cyc_to_us_ceil32(cycles);
+	int i = 0;
+
+	/* Bucket i holds latencies below 2^i us; the last one is open */
+	while ((i < BENCH_HIST_BUCKETS - 1) && (us >= BIT(i))) {
+		i++;
+	}
+
+	hist->buckets[i]++;
+	if ((hist->cnt == 0) || (us < hist->min_us)) {
+		hist->min_us = us;
+	}
+	if (us > hist->max_us) {
+		hist->max_us = us;
+	}
+	hist->sum_us += us;
+	hist->cnt++;
+}
+
+static void bench_hist_print(const struct shell *shell, const char *name,
+			     const struct bench_hist *hist)
+{
+	int i;
+
+	if (hist->cnt == 0) {
+		shell_print(shell, "%s latency: no samples", name);
+		return;
+	}
+
+	shell_print(shell, "%s latency: n=%u min=%uus avg=%lluus max=%uus",
+		    name, hist->cnt, hist->min_us, hist->sum_us / hist->cnt,
+		    hist->max_us);
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+		if (hist->buckets[i] == 0) {
+			continue;
+		}
+
+		if (i == BENCH_HIST_BUCKETS - 1) {
+			shell_print(shell, "  >= %6luus: %u", BIT(i - 1),
+				    hist->buckets[i]);
+		} else {
+			shell_print(shell, "  <  %6luus: %u", BIT(i),
+				    hist->buckets[i]);
+		}
+	}
+}
+
+static int bench_rotate(const struct shell *shell, struct fcb *fcb,
+			struct bench_stats *stats)
+{
+	uint32_t start;
+	int ret;
+
+	start = k_cycle_get_32();
+	ret = fcb_maint_rotate(fcb);
+	bench_hist_add(&stats->rotate, k_cycle_get_32() - start);
 	if (ret) {
 		shell_error(shell, "Failed to rotate fcb, ret: %d", ret);
 		return ret;
@@ -343,27 +1039,387 @@ static int cmd_rotate(const struct shell *shell, size_t argc, char *argv[])
 	return 0;
 }
 
-static int cmd_clear(const struct shell *shell, size_t argc, char *argv[])
+static int bench_append(const struct shell *shell, struct fcb *fcb,
+			uint16_t len, struct bench_stats *stats)
 {
-	struct fcb fcb;
-	struct flash_sector fs[10];
-	uint32_t fs_cnt = ARRAY_SIZE(fs);
+	struct fcb_entry loc;
+	uint32_t start, cycles;
 	int ret;
 
-	ret = init_helper(shell, SETTINGS_PARTITION, &fcb, fs, fs_cnt);
+	start = k_cycle_get_32();
+	ret = fcb_append(fcb, len, &loc);
+	cycles = k_cycle_get_32() - start;
+	if (ret == -ENOSPC) {
+		ret = bench_rotate(shell, fcb, stats);
+		if (ret) {
+			return ret;
+		}
+
+		start = k_cycle_get_32();
+		ret = fcb_append(fcb, len, &loc);
+		cycles = k_cycle_get_32() - start;
+	}
+	if (ret) {
+		shell_error(shell, "Failed to append to fcb, ret: %d", ret);
+		return ret;
+	}
+
+	start = k_cycle_get_32();
+	ret = flash_area_write(fcb->fap, FCB_ENTRY_FA_DATA_OFF(loc), bench_buf,
+			       len);
 	if (ret) {
+		shell_error(shell, "Failed to write flash area, ret: %d", ret);
+		return ret;
+	}
+
+	ret = fcb_append_finish(fcb, &loc);
+	cycles += k_cycle_get_32() - start;
+	if (ret) {
+		shell_error(shell, "Failed to finish append to fcb, ret: %d",
+			    ret);
 		return ret;
 	}
 
-	ret = fcb_clear(&fcb);
+	bench_hist_add(&stats->append, cycles);
+	stats->cycles += cycles;
+	stats->data_bytes += len;
+
+	return 0;
+}
+
+static int bench_walk_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
+{
+	uint64_t *bytes = arg;
+	uint16_t len = MIN(entry_ctx->loc.fe_data_len, sizeof(bench_buf));
+	int ret;
+
+	ret = flash_area_read(entry_ctx->fap,
+			      FCB_ENTRY_FA_DATA_OFF(entry_ctx->loc), bench_buf,
+			      len);
+	if (ret) {
+		return ret;
+	}
+
+	*bytes += len;
+
+	return 0;
+}
+
+static uint64_t bench_rate(uint64_t n, uint64_t us)
+{
+	return us ? (n * USEC_PER_SEC) / us : 0;
+}
+
+#if defined(CONFIG_FCB_CODEC)
+#define BENCH_CODEC_RUN 64
+#define BENCH_CODEC_TEXT_LEN 1024
+
+/* Temperature in centidegrees, sampled every 10s with some jitter */
+static void bench_temperature(uint32_t *ts, int32_t *value)
+{
+	*ts += 10 + ((sys_rand32_get() % 8) == 0);
+	*value += (int32_t)(sys_rand32_get() % 5) - 2;
+}
+
+/* Illuminance in lux, sampled every second, with sudden changes */
+static void bench_light(uint32_t *ts, int32_t *value)
+{
+	*ts += 1;
+	if ((sys_rand32_get() % 32) == 0) {
+		*value = sys_rand32_get() % 2000;
+	} else {
+		*value += (int32_t)(sys_rand32_get() % 3) - 1;
+	}
+}
+
+static int bench_dod(const struct shell *shell, const char *name,
+		     void (*next)(uint32_t *ts, int32_t *value),
+		     uint32_t count)
+{
+	static uint8_t enc[BENCH_CODEC_RUN * 2 * FCB_CODEC_DOD_MAX_LEN];
+	static uint32_t ts[BENCH_CODEC_RUN];
+	static int32_t values[BENCH_CODEC_RUN];
+	struct fcb_codec_dod ts_dod, value_dod;
+	uint64_t enc_cycles = 0, dec_cycles = 0, bytes = 0, samples = 0, ratio;
+	uint32_t t = 0, start;
+	int32_t v = 2150, dec;
+	size_t len, off;
+	int i, n, ret;
+
+	for (n = 0; n < count; n++) {
+		for (i = 0; i < BENCH_CODEC_RUN; i++) {
+			next(&t, &v);
+			ts[i] = t;
+			values[i] = v;
+		}
+
+		memset(&ts_dod, 0, sizeof(ts_dod));
+		memset(&value_dod, 0, sizeof(value_dod));
+		len = 0;
+		start = k_cycle_get_32();
+		for (i = 0; i < BENCH_CODEC_RUN; i++) {
+			len += fcb_codec_dod_encode(&ts_dod, ts[i], &enc[len]);
+			len += fcb_codec_dod_encode(&value_dod, values[i],
+						    &enc[len]);
+		}
+		enc_cycles += k_cycle_get_32() - start;
+
+		memset(&ts_dod, 0, sizeof(ts_dod));
+		memset(&value_dod, 0, sizeof(value_dod));
+		off = 0;
+		start = k_cycle_get_32();
+		for (i = 0; i < BENCH_CODEC_RUN; i++) {
+			ret = fcb_codec_dod_decode(&ts_dod, &enc[off],
+						   len - off, &dec);
+			if ((ret < 0) || ((uint32_t)dec != ts[i])) {
+				break;
+			}
+			off += ret;
+
+			ret = fcb_codec_dod_decode(&value_dod, &enc[off],
+						   len - off, &dec);
+			if ((ret < 0) || (dec != values[i])) {
+				break;
+			}
+			off += ret;
+		}
+		dec_cycles += k_cycle_get_32() - start;
+		if (i != BENCH_CODEC_RUN) {
+			shell_error(shell, "%s: mismatch at sample %d", name,
+				    i);
+			return -EBADMSG;
+		}
+
+		bytes += len;
+		samples += BENCH_CODEC_RUN;
+	}
+
+	ratio = (samples * (sizeof(ts[0]) + sizeof(values[0])) * 100) / bytes;
+	shell_print(shell, "%-12s %5llu.%02llu %11llu %11llu", name,
+		    ratio / 100, ratio % 100,
+		    enc_cycles / samples, dec_cycles / samples);
+
+	return 0;
+}
+
+static int bench_lz(const struct shell *shell, uint32_t count)
+{
+	static uint8_t raw[BENCH_CODEC_TEXT_LEN];
+	static uint8_t enc[FCB_CODEC_LZ_MAX_LEN(BENCH_CODEC_TEXT_LEN)];
+	static uint8_t dec[BENCH_CODEC_TEXT_LEN];
+	uint64_t enc_cycles = 0, dec_cycles = 0, bytes = 0, raw_bytes = 0;
+	uint64_t ratio;
+	uint32_t start;
+	size_t len;
+	int n, enc_len, ret;
+
+	for (n = 0; n < count; n++) {
+		/* A group of text records, such as staged log lines */
+		len = 0;
+		while (len < sizeof(raw) - 64) {
+			len += snprintk((char *)&raw[len], sizeof(raw) - len,
+					"t=%u temp=%u.%02u hum=%u%% lux=%u\n",
+					n * 60 + (uint32_t)len,
+					21 + sys_rand32_get() % 2,
+					sys_rand32_get() % 100,
+					40 + sys_rand32_get() % 5,
+					sys_rand32_get() % 1000);
+		}
+
+		start = k_cycle_get_32();
+		enc_len = fcb_codec_lz_encode(raw, len, enc, sizeof(enc));
+		enc_cycles += k_cycle_get_32() - start;
+		if (enc_len < 0) {
+			shell_error(shell, "Failed to compress, ret: %d",
+				    enc_len);
+			return enc_len;
+		}
+
+		start = k_cycle_get_32();
+		ret = fcb_codec_lz_decode(enc, enc_len, dec, sizeof(dec));
+		dec_cycles += k_cycle_get_32() - start;
+		if ((ret != len) || memcmp(raw, dec, len)) {
+			shell_error(shell, "Text: mismatch, ret: %d", ret);
+			return -EBADMSG;
+		}
+
+		bytes += enc_len;
+		raw_bytes += len;
+	}
+
+	ratio = (raw_bytes * 100) / bytes;
+	shell_print(shell, "%-12s %5llu.%02llu %11llu %11llu", "Text (LZ)",
+		    ratio / 100, ratio % 100,
+		    enc_cycles / raw_bytes, dec_cycles / raw_bytes);
+
+	return 0;
+}
+
+static int bench_codec(const struct shell *shell, uint32_t count)
+{
+	int ret;
+
+	/* In cycles, to compare the codecs whatever the CPU clock */
+	shell_print(shell, "%-12s %8s %11s %11s", "Series", "Ratio",
+		    "Enc cyc/smp", "Dec cyc/smp");
+
+	ret = bench_dod(shell, "Temperature", bench_temperature, count);
+	if (ret) {
+		return ret;
+	}
+
+	ret = bench_dod(shell, "Light", bench_light, count);
+	if (ret) {
+		return ret;
+	}
+
+	/* Text is per byte rather than per sample */
+	return bench_lz(shell, count);
+}
+#endif
+
+static int bench_run(const struct shell *shell, struct fcb *fcb,
+		     uint32_t count)
+{
+	static struct bench_stats stats;
+	uint32_t start, cycles;
+	int i, n, ret;
+
+	for (i = 0; i < sizeof(bench_buf); i++) {
+		bench_buf[i] = i;
+	}
+
+	shell_warn(shell, "Clearing fcb for benchmark");
+	start = k_cycle_get_32();
+	ret = fcb_maint_clear(fcb);
+	cycles = k_cycle_get_32() - start;
+	if (ret) {
+		shell_error(shell, "Failed to clear fcb, ret: %d", ret);
+		return ret;
+	}
+
+	shell_print(shell, "Clear:             %uus",
+		    k_cyc_to_us_ceil32(cycles));
+	shell_print(shell, "Alignment:         %u", fcb->f_align);
+	shell_print(shell, "%6s %10s %10s %8s %11s %11s", "Size", "Appends/s",
+		    "Bytes/s", "W-amp", "Writes/KiB", "Erases/MiB");
+
+	memset(&stats, 0, sizeof(stats));
+	for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+		struct bench_stats prev = stats;
+		uint64_t us, data_bytes, wa;
+
+		bench_counted = &stats;
+		for (n = 0; n < count; n++) {
+			ret = bench_append(shell, fcb, bench_sizes[i], &stats);
+			if (ret) {
+				break;
+			}
+		}
+		bench_counted = NULL;
+		if (ret) {
+			return ret;
+		}
+
+		us = k_cyc_to_us_ceil64(stats.cycles - prev.cycles);
+		data_bytes = stats.data_bytes - prev.data_bytes;
+		wa = ((stats.flash_bytes - prev.flash_bytes) * 100) /
+		     data_bytes;
+		shell_print(shell, "%6u %10llu %10llu %5llu.%02llu %11llu %11llu",
+			    bench_sizes[i], bench_rate(count, us),
+			    bench_rate(data_bytes, us), wa / 100, wa % 100,
+			    ((stats.writes - prev.writes) * 1024ULL) /
+			    data_bytes,
+			    ((stats.erases - prev.erases) * 1048576ULL) /
+			    data_bytes);
+	}
+
+	start = k_cycle_get_32();
+	ret = fcb_walk(fcb, NULL, bench_walk_cb, &stats.walk_bytes);
+	cycles = k_cycle_get_32() - start;
+	if (ret) {
+		shell_error(shell, "Failed to walk from fcb, ret: %d", ret);
+		return ret;
+	}
+
+	shell_print(shell, "Walk:              %llu bytes/s",
+		    bench_rate(stats.walk_bytes, k_cyc_to_us_ceil64(cycles)));
+	shell_print(shell, "Flash writes:      %u", stats.writes);
+	shell_print(shell, "Flash erases:      %u", stats.erases);
+	shell_print(shell, "Flash bytes:       %llu", stats.flash_bytes);
+	shell_print(shell, "Logical bytes:     %llu", stats.data_bytes);
+	bench_hist_print(shell, "Append", &stats.append);
+	bench_hist_print(shell, "Rotate", &stats.rotate);
+
+	ret = fcb_maint_clear(fcb);
 	if (ret) {
 		shell_error(shell, "Failed to clear fcb, ret: %d", ret);
 		return ret;
 	}
 
+#if defined(CONFIG_FCB_CODEC)
+	ret = bench_codec(shell, count);
+	if (ret) {
+		return ret;
+	}
+#endif
+
 	return 0;
 }
 
+static int bench_handler(const struct shell *shell, struct fcb *fcb,
+			 size_t argc, char *argv[])
+{
+	static struct flash_area counted_fa;
+	const struct flash_area *fa = fcb->fap;
+	uint32_t count = 100;
+	bool force = false;
+	int ret;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 0);
+
+	if (argc > 2) {
+		if (strcmp(argv[2], "force")) {
+			shell_error(shell, "Invalid parameter: %s", argv[2]);
+			return -EINVAL;
+		}
+
+		force = true;
+	}
+
+	if (count == 0) {
+		shell_error(shell, "Invalid count");
+		return -EINVAL;
+	}
+
+	/* The partition is shared with the settings and the logs */
+	ret = fcb_is_empty(fcb);
+	if (ret < 0) {
+		shell_error(shell, "Failed to get emptyness from fcb, ret: %d",
+			    ret);
+		return ret;
+	} else if ((ret == 0) && !force) {
+		shell_error(shell, "FCB is not empty; the benchmark clears it, "
+			    "run \"fcb bench %u force\" to erase it anyway",
+			    count);
+		return -ENOTEMPTY;
+	}
+
+	/* The FCB is locked, so that no other user writes in between */
+	counted_fa = *fa;
+	counted_fa.fa_dev = DEVICE_GET(fcb_bench_flash);
+	bench_backing = fa->fa_dev;
+	fcb->fap = &counted_fa;
+	ret = bench_run(shell, fcb, count);
+	fcb->fap = fa;
+
+	return ret;
+}
+
+FCB_CMD_DEFINE(bench);
+#endif
+
 SHELL_STATIC_SUBCMD_SET_CREATE(fcb_cmds,
 	SHELL_CMD_ARG(info,     NULL, NULL,         cmd_info,     1, 0),
 	SHELL_CMD_ARG(is-empty, NULL, NULL,         cmd_is_empty, 1, 0),
@@ -374,6 +1430,20 @@ SHELL_STATIC_SUBCMD_SET_CREATE(fcb_cmds,
 	SHELL_CMD_ARG(walk,     NULL, NULL,         cmd_walk,     1, 0),
 	SHELL_CMD_ARG(rotate,   NULL, NULL,         cmd_rotate,   1, 0),
 	SHELL_CMD_ARG(clear,    NULL, NULL,         cmd_clear,    1, 0),
+#if defined(CONFIG_FCB_STATS)
+	SHELL_CMD_ARG(sample,   NULL, "timestamp value [...]", cmd_sample, 3,
+		      2 * STATS_MAX_SAMPLES - 2),
+	SHELL_CMD_ARG(stats,    NULL, "from to bucket", cmd_stats, 4, 0),
+#endif
+#if defined(CONFIG_FCB_STAGING)
+	SHELL_CMD(staging,      &staging_cmds, "Staging commands", NULL),
+#endif
+#if defined(CONFIG_FCB_SHELL_EXPORT)
+	SHELL_CMD_ARG(export,   NULL, "[raw] [offset]", cmd_export, 1, 2),
+#endif
+#if defined(CONFIG_FCB_SHELL_BENCH)
+	SHELL_CMD_ARG(bench,    NULL, "[count [force]]", cmd_bench, 1, 2),
+#endif
 	SHELL_SUBCMD_SET_END
 );
 
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/fs/fcb_codec.h>
+#include <zephyr/fs/fcb_maint.h>
+#include <zephyr/fs/fcb_staging.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+#if defined(CONFIG_PM)
+#include <zephyr/pm/pm.h>
+#endif
+
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(fcb_staging, CONFIG_FCB_STAGING_LOG_LEVEL);
+
+/* A partition of its own if chosen, the one of the settings otherwise */
+#if DT_HAS_CHOSEN(zephyr_fcb_staging_partition)
+#define STAGING_PARTITION DT_FIXED_PARTITION_ID(DT_CHOSEN(zephyr_fcb_staging_partition))
+#elif DT_HAS_CHOSEN(zephyr_settings_partition)
+#define STAGING_PARTITION DT_FIXED_PARTITION_ID(DT_CHOSEN(zephyr_settings_partition))
+#else
+#define STAGING_PARTITION FIXED_PARTITION_ID(storage_partition)
+#endif
+
+/*
+ * A group is committed as a single entry laid out as follows: the type, then
+ * the records, each one prefixed by its length (1 byte). A compressed group
+ * is laid out as follows: the type, the length of the records (2 bytes), then
+ * the records compressed with LZ (see fcb_codec). The types are not printable,
+ * and differ from the ones of fcb_stats.
+ */
+#define STAGING_GROUP 0x83
+#define STAGING_GROUP_LZ 0x85
+#define STAGING_GROUP_LZ_HDR_LEN 3
+#define STAGING_MAGIC 0x57a6e5fc
+#define STAGING_ALIGN_MAX 32
+#define STAGING_CRC_INIT 0xff
+#define STAGING_REBOOT_TIMEOUT K_SECONDS(1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_FCB_STAGING_BUF_SIZE),
+	     "Staging buffer size must be a power of two");
+
+/*
+ * The indexes are free-running; their difference is the staged size. A record
+ * is staged as its length, its data, then the CRC8 of both, so that the records
+ * retained across a warm reset are checked one by one.
+ */
+struct staging_ring {
+	uint32_t magic;
+	uint32_t head;
+	uint32_t tail;
+	uint8_t buf[CONFIG_FCB_STAGING_BUF_SIZE];
+};
+
+#if defined(CONFIG_FCB_STAGING_RETAINED)
+static __noinit struct staging_ring ring;
+#else
+static struct staging_ring ring;
+#endif
+
+static struct fcb fcb;
+static struct flash_sector sectors[CONFIG_FCB_STAGING_SECTOR_COUNT];
+static bool ready;
+
+static struct k_spinlock lock;
+static struct fcb_staging_stats stats;
+
+static K_MUTEX_DEFINE(commit_lock);
+static K_SEM_DEFINE(commit_sem, 0, 1);
+static uint8_t group[1 + CONFIG_FCB_STAGING_BUF_SIZE + STAGING_ALIGN_MAX];
+
+#if defined(CONFIG_FCB_STAGING_COMPRESS)
+static uint8_t packed[STAGING_GROUP_LZ_HDR_LEN + CONFIG_FCB_STAGING_BUF_SIZE +
+		      STAGING_ALIGN_MAX];
+static K_MUTEX_DEFINE(decode_lock);
+static uint8_t decoded[1 + CONFIG_FCB_STAGING_BUF_SIZE];
+#endif
+
+static K_KERNEL_STACK_DEFINE(staging_stack, CONFIG_FCB_STAGING_THREAD_STACK_SIZE);
+static struct k_thread staging_thread_data;
+
+static inline uint8_t ring_at(uint32_t idx)
+{
+	return ring.buf[idx & (sizeof(ring.buf) - 1)];
+}
+
+static void ring_put(const uint8_t *data, size_t len)
+{
+	while (len--) {
+		ring.buf[ring.head++ & (sizeof(ring.buf) - 1)] = *data++;
+	}
+}
+
+static void ring_copy(uint32_t idx, uint8_t *data, size_t len)
+{
+	while (len--) {
+		*data++ = ring_at(idx++);
+	}
+}
+
+static uint8_t ring_crc(uint32_t idx, size_t len)
+{
+	uint32_t off = idx & (sizeof(ring.buf) - 1);
+	size_t first = MIN(len, sizeof(ring.buf) - off);
+	uint8_t crc;
+
+	crc = crc8_ccitt(STAGING_CRC_INIT, &ring.buf[off], first);
+
+	return crc8_ccitt(crc, ring.buf, len - first);
+}
+
+/*
+ * Keep the records of a warm reset up to the first one that is cut or fails
+ * its CRC, provided the magic and the indexes hold.
+ */
+static void ring_init(void)
+{
+	uint32_t idx;
+	uint8_t len;
+
+	if (IS_ENABLED(CONFIG_FCB_STAGING_RETAINED) &&
+	    (ring.magic == STAGING_MAGIC) &&
+	    (ring.head - ring.tail <= sizeof(ring.buf))) {
+		for (idx = ring.tail; idx != ring.head; idx += 2 + len) {
+			len = ring_at(idx);
+			if ((ring.head - idx < 2 + len) ||
+			    (ring_crc(idx, 1 + len) != ring_at(idx + 1 + len))) {
+				break;
+			}
+		}
+
+		if (idx != ring.head) {
+			LOG_WRN("Dropped %u corrupted staged byte(s)",
+				ring.head - idx);
+			ring.head = idx;
+		}
+
+		if (ring.head != ring.tail) {
+			LOG_INF("Recovered %u staged byte(s)",
+				ring.head - ring.tail);
+		}
+
+		return;
+	}
+
+	ring.magic = STAGING_MAGIC;
+	ring.head = 0;
+	ring.tail = 0;
+}
+
+static uint32_t entry_len(uint16_t len)
+{
+	uint32_t align = fcb.f_align;
+
+	/* Length (1 or 2 bytes), data and CRC, each one aligned */
+	return ROUND_UP(len < 0x80 ? 1 : 2, align) + ROUND_UP(len, align) +
+	       align;
+}
+
+static int staging_write_locked(uint8_t *buf, uint16_t len, uint16_t padded)
+{
+	struct fcb_entry loc;
+	k_spinlock_key_t key;
+	int ret;
+
+	ret = fcb_append(&fcb, len, &loc);
+	if (ret == -ENOSPC) {
+		ret = fcb_maint_rotate(&fcb);
+		if (ret) {
+			return ret;
+		}
+
+		key = k_spin_lock(&lock);
+		stats.erases++;
+		k_spin_unlock(&lock, key);
+
+		ret = fcb_append(&fcb, len, &loc);
+	}
+	if (ret) {
+		return ret;
+	}
+
+	ret = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf,
+			       padded);
+	if (ret) {
+		return ret;
+	}
+
+	return fcb_append_finish(&fcb, &loc);
+}
+
+static int staging_write(uint8_t *buf, uint16_t len, k_timeout_t timeout)
+{
+	uint16_t padded = ROUND_UP(len, fcb.f_align);
+	int ret;
+
+	memset(&buf[len], fcb.f_erase_value, padded - len);
+
+	/* Do not let the maintenance rotate the sector being written */
+	ret = k_mutex_lock(&fcb.f_mtx, timeout);
+	if (ret) {
+		return ret;
+	}
+
+	ret = staging_write_locked(buf, len, padded);
+	k_mutex_unlock(&fcb.f_mtx);
+
+	return ret;
+}
+
+static int staging_commit(k_timeout_t timeout)
+{
+	uint32_t start = k_cycle_get_32(), cycles;
+	uint32_t idx, head, unbatched = 0;
+	k_spinlock_key_t key;
+	uint8_t *buf = group;
+	size_t len = 1, written;
+	uint8_t rlen;
+	int ret;
+
+	ret = k_mutex_lock(&commit_lock, timeout);
+	if (ret) {
+		return ret;
+	}
+
+	key = k_spin_lock(&lock);
+	idx = ring.tail;
+	head = ring.head;
+	k_spin_unlock(&lock, key);
+
+	/*
+	 * The records up to the head are copied without the lock, as the
+	 * appends only write past it, and released only once committed.
+	 * Records staged meanwhile are left to the next commit.
+	 */
+	for (; idx != head; idx += 2 + rlen) {
+		rlen = ring_at(idx);
+		ring_copy(idx, &group[len], 1 + rlen);
+		len += 1 + rlen;
+		unbatched += entry_len(rlen);
+	}
+
+	if (len == 1) {
+		k_mutex_unlock(&commit_lock);
+		return 0;
+	}
+
+	group[0] = STAGING_GROUP;
+	written = len;
+
+#if defined(CONFIG_FCB_STAGING_COMPRESS)
+	/* Keep the compressed group only if it is smaller */
+	ret = -ENOSPC;
+	if (len > 1 + STAGING_GROUP_LZ_HDR_LEN) {
+		ret = fcb_codec_lz_encode(&group[1], len - 1,
+					  &packed[STAGING_GROUP_LZ_HDR_LEN],
+					  len - 1 - STAGING_GROUP_LZ_HDR_LEN);
+	}
+	if (ret > 0) {
+		packed[0] = STAGING_GROUP_LZ;
+		sys_put_le16(len - 1, &packed[1]);
+		buf = packed;
+		written = STAGING_GROUP_LZ_HDR_LEN + ret;
+	}
+#endif
+
+	ret = staging_write(buf, written, timeout);
+	cycles = k_cycle_get_32() - start;
+
+	key = k_spin_lock(&lock);
+	if (ret == 0) {
+		ring.tail = idx;
+		stats.commits++;
+		stats.group_bytes += len;
+		stats.written_bytes += written;
+		stats.flash_bytes += entry_len(written);
+		stats.unbatched_bytes += unbatched;
+	}
+	stats.commit_max_cycles = MAX(stats.commit_max_cycles, cycles);
+	k_spin_unlock(&lock, key);
+
+	if (IS_ENABLED(CONFIG_FCB_MAINT) && (ret == 0)) {
+		fcb_maint_kick();
+	}
+
+	k_mutex_unlock(&commit_lock);
+
+	return ret;
+}
+
+static void staging_thread(void *p1, void *p2, void *p3)
+{
+	int ret;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		/* Commit on threshold, or once the interval has elapsed */
+		(void)k_sem_take(&commit_sem,
+				 K_MSEC(CONFIG_FCB_STAGING_COMMIT_INTERVAL_MS));
+
+		ret = staging_commit(K_FOREVER);
+		if (ret) {
+			LOG_ERR("Failed to commit, ret: %d", ret);
+		}
+	}
+}
+
+int fcb_staging_append(const void *data, size_t len)
+{
+	uint32_t start = k_cycle_get_32();
+	k_spinlock_key_t key;
+	uint8_t hdr = len, crc;
+	uint32_t staged;
+
+	if ((len == 0) || (len > FCB_STAGING_RECORD_MAX_LEN)) {
+		return -EINVAL;
+	}
+
+	if (!ready) {
+		return -ENODEV;
+	}
+
+	crc = crc8_ccitt(crc8_ccitt(STAGING_CRC_INIT, &hdr, sizeof(hdr)), data,
+			 len);
+
+	key = k_spin_lock(&lock);
+	if (sizeof(ring.buf) - (ring.head - ring.tail) < 2 + len) {
+		stats.dropped++;
+		k_spin_unlock(&lock, key);
+		return -ENOMEM;
+	}
+
+	ring_put(&hdr, sizeof(hdr));
+	ring_put(data, len);
+	ring_put(&crc, sizeof(crc));
+	staged = ring.head - ring.tail;
+	stats.records++;
+	stats.append_max_cycles = MAX(stats.append_max_cycles,
+				      k_cycle_get_32() - start);
+	k_spin_unlock(&lock, key);
+
+	if (staged >= CONFIG_FCB_STAGING_COMMIT_THRESHOLD) {
+		k_sem_give(&commit_sem);
+	}
+
+	return 0;
+}
+
+int fcb_staging_flush(void)
+{
+	if (!ready) {
+		return -ENODEV;
+	}
+
+	return staging_commit(K_FOREVER);
+}
+
+#if defined(CONFIG_PM)
+/*
+ * The ring does not survive the states powering the RAM off: commit it on the
+ * way in, unless a commit or another FCB user is under way, as the idle thread
+ * cannot wait.
+ */
+static void staging_pm_entry(enum pm_state state)
+{
+	if ((state != PM_STATE_SOFT_OFF) &&
+	    (state != PM_STATE_SUSPEND_TO_DISK)) {
+		return;
+	}
+
+	if (staging_commit(K_NO_WAIT)) {
+		LOG_WRN("Failed to commit before power off");
+	}
+}
+
+static struct pm_notifier staging_pm_notifier = {
+	.state_entry = staging_pm_entry,
+};
+#endif
+
+#if defined(CONFIG_FCB_STAGING_REBOOT_FLUSH)
+void __real_sys_reboot(int type);
+
+/* Every reboot commits the staged records first, whoever asks for it */
+FUNC_NORETURN void __wrap_sys_reboot(int type)
+{
+	if (ready && !k_is_in_isr()) {
+		(void)staging_commit(STAGING_REBOOT_TIMEOUT);
+	}
+
+	__real_sys_reboot(type);
+	CODE_UNREACHABLE;
+}
+#endif
+
+struct fcb *fcb_staging_fcb(void)
+{
+	return ready ? &fcb : NULL;
+}
+
+void fcb_staging_stats_get(struct fcb_staging_stats *out)
+{
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&lock);
+	*out = stats;
+	k_spin_unlock(&lock, key);
+}
+
+static int group_foreach(const uint8_t *data, size_t len,
+			 fcb_staging_record_cb cb, void *arg)
+{
+	size_t off = 1;
+	uint8_t rlen;
+	int ret;
+
+	while (off < len) {
+		rlen = data[off++];
+		if (rlen > len - off) {
+			return -EBADMSG;
+		}
+
+		ret = cb(&data[off], rlen, arg);
+		if (ret) {
+			return ret;
+		}
+
+		off += rlen;
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_FCB_STAGING_COMPRESS)
+static int group_lz_foreach(const uint8_t *data, size_t len,
+			    fcb_staging_record_cb cb, void *arg)
+{
+	int ret;
+
+	if ((len < STAGING_GROUP_LZ_HDR_LEN) ||
+	    (sys_get_le16(&data[1]) > sizeof(decoded) - 1)) {
+		return -EBADMSG;
+	}
+
+	ret = k_mutex_lock(&decode_lock, K_FOREVER);
+	if (ret) {
+		return ret;
+	}
+
+	ret = fcb_codec_lz_decode(&data[STAGING_GROUP_LZ_HDR_LEN],
+				  len - STAGING_GROUP_LZ_HDR_LEN, &decoded[1],
+				  sizeof(decoded) - 1);
+	if (ret == sys_get_le16(&data[1])) {
+		decoded[0] = STAGING_GROUP;
+		ret = group_foreach(decoded, 1 + ret, cb, arg);
+	} else if (ret >= 0) {
+		ret = -EBADMSG;
+	}
+
+	k_mutex_unlock(&decode_lock);
+
+	return ret;
+}
+#endif
+
+int fcb_staging_foreach(const uint8_t *data, size_t len,
+			fcb_staging_record_cb cb, void *arg)
+{
+	if ((len >= 1) && (data[0] == STAGING_GROUP)) {
+		return group_foreach(data, len, cb, arg);
+	}
+
+#if defined(CONFIG_FCB_STAGING_COMPRESS)
+	if ((len >= 1) && (data[0] == STAGING_GROUP_LZ)) {
+		return group_lz_foreach(data, len, cb, arg);
+	}
+#endif
+
+	return -ENOMSG;
+}
+
+static int fcb_staging_init(const struct device *unused)
+{
+	const struct flash_parameters *fp;
+	const struct flash_area *fa;
+	uint32_t cnt = ARRAY_SIZE(sectors);
+	int ret;
+
+	ARG_UNUSED(unused);
+
+	ring_init();
+
+	ret = flash_area_open(STAGING_PARTITION, &fa);
+	if (ret) {
+		LOG_ERR("Failed to open flash area, ret: %d", ret);
+		return ret;
+	}
+
+	fp = flash_get_parameters(fa->fa_dev);
+	flash_area_close(fa);
+	if (fp == NULL) {
+		LOG_ERR("Failed to get flash device parameters");
+		return -ENODEV;
+	}
+
+	/* Like the FCB shell, use the first sectors if there are more */
+	ret = flash_area_get_sectors(STAGING_PARTITION, &cnt, sectors);
+	if (ret && ret != -ENOMEM) {
+		LOG_ERR("Failed to get flash sectors, ret: %d", ret);
+		return ret;
+	}
+
+	fcb.f_magic = 0xfcb1fcb1;
+	fcb.f_version = 1;
+	fcb.f_sector_cnt = cnt;
+	fcb.f_scratch_cnt = 1;
+	fcb.f_sectors = sectors;
+	fcb.f_erase_value = fp->erase_value;
+	ret = fcb_init(STAGING_PARTITION, &fcb);
+	if (ret) {
+		LOG_ERR("Failed to init fcb, ret: %d", ret);
+		return ret;
+	}
+
+	if (fcb.f_align > STAGING_ALIGN_MAX) {
+		LOG_ERR("Unsupported flash alignment: %u", fcb.f_align);
+		return -EINVAL;
+	}
+
+	if (IS_ENABLED(CONFIG_FCB_MAINT)) {
+		ret = fcb_maint_attach(&fcb);
+		if (ret) {
+			LOG_ERR("Failed to attach maintenance, ret: %d", ret);
+			return ret;
+		}
+	}
+
+	k_thread_create(&staging_thread_data, staging_stack,
+			K_KERNEL_STACK_SIZEOF(staging_stack), staging_thread,
+			NULL, NULL, NULL,
+			K_PRIO_PREEMPT(CONFIG_FCB_STAGING_THREAD_PRIORITY), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&staging_thread_data, "fcb_staging");
+
+#if defined(CONFIG_PM)
+	pm_notifier_register(&staging_pm_notifier);
+#endif
+
+	ready = true;
+
+	/* Commit what survived the reset */
+	if (ring.head != ring.tail) {
+		k_sem_give(&commit_sem);
+	}
+
+	return 0;
+}
+
+SYS_INIT(fcb_staging_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,707 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/fs/fcb_codec.h>
+#include <zephyr/fs/fcb_maint.h>
+#include <zephyr/fs/fcb_stats.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <string.h>
+
+/*
+ * The entries are laid out as follows (little-endian):
+ *
+ * - sample: type (1), timestamp (4), value (4)
+ * - summary: type (1), offset and id of the summarized sector (4 + 2), first
+ *   and last timestamps (4 + 4), count (4), min (4), max (4), sum (8)
+ * - run: type (1), count (1), then the timestamp and the value of every
+ *   sample, both as delta-of-delta series (see fcb_codec)
+ *
+ * The types are not printable so that the text entries appended from the shell
+ * are told apart.
+ */
+#define STATS_SAMPLE 0x81
+#define STATS_SUMMARY 0x82
+#define STATS_RUN 0x84
+
+#define STATS_SAMPLE_LEN 9
+#define STATS_SUMMARY_LEN 35
+#define STATS_RUN_MAX_LEN (2 + CONFIG_FCB_STATS_RUN_MAX * 2 * \
+			   FCB_CODEC_DOD_MAX_LEN)
+#define STATS_ALIGN_MAX 32
+#define STATS_BUF_LEN (MAX(STATS_SUMMARY_LEN, STATS_RUN_MAX_LEN) + \
+		       STATS_ALIGN_MAX)
+
+/*
+ * A run takes up to 2.5 KiB with CONFIG_FCB_STATS_RUN_MAX=255; the entries are
+ * built and read in a single buffer rather than on the stack of the caller,
+ * e.g. the shell.
+ */
+static K_MUTEX_DEFINE(buf_lock);
+static uint8_t stats_buf[STATS_BUF_LEN];
+
+struct stats_summary {
+	uint32_t sector_off;
+	uint16_t id;
+	uint32_t first;
+	uint32_t last;
+	struct fcb_stats_bucket sum;
+};
+
+/*
+ * The summaries by sector position, filled from the summary entries, and from
+ * the sectors read while querying; a summary holds as long as the sector has
+ * the id it was made for, whatever rotated the sector out since (the staging,
+ * the maintenance, the shell...). Guarded by buf_lock.
+ */
+static struct fcb *index_fcb;
+static struct stats_summary stats_index[CONFIG_FCB_STATS_INDEX_SECTORS];
+
+struct query_ctx {
+	struct fcb *fcb;
+	uint32_t from;
+	uint32_t to;
+	uint32_t width;
+	struct fcb_stats_bucket *buckets;
+	/* Summary of the sector being read */
+	struct stats_summary summary;
+};
+
+static void bucket_add(struct fcb_stats_bucket *bucket, int32_t value)
+{
+	if ((bucket->count == 0) || (value < bucket->min)) {
+		bucket->min = value;
+	}
+	if ((bucket->count == 0) || (value > bucket->max)) {
+		bucket->max = value;
+	}
+	bucket->sum += value;
+	bucket->count++;
+}
+
+static void bucket_merge(struct fcb_stats_bucket *bucket,
+			 const struct fcb_stats_bucket *other)
+{
+	if (other->count == 0) {
+		return;
+	}
+
+	if ((bucket->count == 0) || (other->min < bucket->min)) {
+		bucket->min = other->min;
+	}
+	if ((bucket->count == 0) || (other->max > bucket->max)) {
+		bucket->max = other->max;
+	}
+	bucket->sum += other->sum;
+	bucket->count += other->count;
+}
+
+/* The FCB is locked first, as the shell holds it across its commands */
+static int stats_lock(struct fcb *fcb)
+{
+	int ret;
+
+	ret = k_mutex_lock(&fcb->f_mtx, K_FOREVER);
+	if (ret) {
+		return ret;
+	}
+
+	ret = k_mutex_lock(&buf_lock, K_FOREVER);
+	if (ret) {
+		k_mutex_unlock(&fcb->f_mtx);
+	}
+
+	return ret;
+}
+
+static void stats_unlock(struct fcb *fcb)
+{
+	k_mutex_unlock(&buf_lock);
+	k_mutex_unlock(&fcb->f_mtx);
+}
+
+static int stats_write(struct fcb *fcb, uint8_t *buf, uint16_t len,
+		       uint16_t size, struct fcb_entry *loc)
+{
+	uint16_t padded = ROUND_UP(len, fcb->f_align);
+	int ret;
+
+	if (padded > size) {
+		return -EINVAL;
+	}
+
+	/* Pad the data to the flash write block size */
+	memset(&buf[len], fcb->f_erase_value, padded - len);
+
+	ret = fcb_append(fcb, len, loc);
+	if (ret == -ENOSPC) {
+		ret = fcb_maint_rotate(fcb);
+		if (ret) {
+			return ret;
+		}
+
+		ret = fcb_append(fcb, len, loc);
+	}
+	if (ret) {
+		return ret;
+	}
+
+	ret = flash_area_write(fcb->fap, FCB_ENTRY_FA_DATA_OFF((*loc)), buf,
+			       padded);
+	if (ret) {
+		return ret;
+	}
+
+	return fcb_append_finish(fcb, loc);
+}
+
+/* Returns the type of the entry, or -ENOMSG if it is not a stats entry */
+static int stats_read(const struct flash_area *fap,
+		      const struct fcb_entry *loc, uint8_t *buf)
+{
+	int ret;
+
+	if ((loc->fe_data_len != STATS_SAMPLE_LEN) &&
+	    (loc->fe_data_len != STATS_SUMMARY_LEN) &&
+	    (loc->fe_data_len > STATS_RUN_MAX_LEN)) {
+		return -ENOMSG;
+	}
+
+	ret = flash_area_read(fap, FCB_ENTRY_FA_DATA_OFF((*loc)), buf,
+			      loc->fe_data_len);
+	if (ret) {
+		return ret;
+	}
+
+	if ((buf[0] == STATS_SAMPLE) &&
+	    (loc->fe_data_len == STATS_SAMPLE_LEN)) {
+		return STATS_SAMPLE;
+	}
+
+	if ((buf[0] == STATS_SUMMARY) &&
+	    (loc->fe_data_len == STATS_SUMMARY_LEN)) {
+		return STATS_SUMMARY;
+	}
+
+	if ((buf[0] == STATS_RUN) && (loc->fe_data_len >= 2)) {
+		return STATS_RUN;
+	}
+
+	return -ENOMSG;
+}
+
+int fcb_stats_foreach(const uint8_t *data, size_t len, fcb_stats_sample_cb cb,
+		      void *arg)
+{
+	struct fcb_codec_dod timestamps = { 0 }, values = { 0 };
+	size_t off = 2;
+	int32_t timestamp, value;
+	int i, ret;
+
+	if ((len == STATS_SAMPLE_LEN) && (data[0] == STATS_SAMPLE)) {
+		return cb(sys_get_le32(&data[1]), sys_get_le32(&data[5]), arg);
+	}
+
+	if ((len < 2) || (data[0] != STATS_RUN)) {
+		return -ENOMSG;
+	}
+
+	for (i = 0; i < data[1]; i++) {
+		ret = fcb_codec_dod_decode(&timestamps, &data[off], len - off,
+					   &timestamp);
+		if (ret < 0) {
+			return ret;
+		}
+		off += ret;
+
+		ret = fcb_codec_dod_decode(&values, &data[off], len - off,
+					   &value);
+		if (ret < 0) {
+			return ret;
+		}
+		off += ret;
+
+		ret = cb(timestamp, value, arg);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void summary_decode(const uint8_t *buf, struct stats_summary *summary)
+{
+	summary->sector_off = sys_get_le32(&buf[1]);
+	summary->id = sys_get_le16(&buf[5]);
+	summary->first = sys_get_le32(&buf[7]);
+	summary->last = sys_get_le32(&buf[11]);
+	summary->sum.count = sys_get_le32(&buf[15]);
+	summary->sum.min = sys_get_le32(&buf[19]);
+	summary->sum.max = sys_get_le32(&buf[23]);
+	summary->sum.sum = sys_get_le64(&buf[27]);
+}
+
+static void summary_add(struct stats_summary *summary, uint32_t timestamp,
+			int32_t value)
+{
+	if ((summary->sum.count == 0) || (timestamp < summary->first)) {
+		summary->first = timestamp;
+	}
+	if ((summary->sum.count == 0) || (timestamp > summary->last)) {
+		summary->last = timestamp;
+	}
+	bucket_add(&summary->sum, value);
+}
+
+/* The sectors in use are the oldest one up to the active one */
+static int sector_pos(struct fcb *fcb, const struct flash_sector *sector)
+{
+	int n = fcb->f_sector_cnt;
+
+	return ((sector - fcb->f_sectors) - (fcb->f_oldest - fcb->f_sectors) +
+		n) % n;
+}
+
+static bool sector_in_use(struct fcb *fcb, const struct flash_sector *sector)
+{
+	return sector_pos(fcb, sector) <=
+	       sector_pos(fcb, fcb->f_active.fe_sector);
+}
+
+/* The ids of the sectors in use follow each other up to the active one */
+static uint16_t sector_id(struct fcb *fcb, const struct flash_sector *sector)
+{
+	return fcb->f_active_id - (sector_pos(fcb, fcb->f_active.fe_sector) -
+				   sector_pos(fcb, sector));
+}
+
+static struct stats_summary *index_get(struct fcb *fcb,
+				       const struct flash_sector *sector)
+{
+	size_t i = sector - fcb->f_sectors;
+
+	if (fcb != index_fcb) {
+		/* No offset matches, not even the one of a blank summary */
+		memset(stats_index, 0xff, sizeof(stats_index));
+		index_fcb = fcb;
+	}
+
+	if (i >= ARRAY_SIZE(stats_index)) {
+		return NULL;
+	}
+
+	return &stats_index[i];
+}
+
+static const struct stats_summary *index_lookup(struct fcb *fcb,
+						const struct flash_sector *sector)
+{
+	const struct stats_summary *summary = index_get(fcb, sector);
+
+	if ((summary == NULL) || (summary->sector_off != sector->fs_off) ||
+	    (summary->id != sector_id(fcb, sector))) {
+		return NULL;
+	}
+
+	return summary;
+}
+
+/* Index the summary if its sector is still the one it was made for */
+static void index_add(struct fcb *fcb, const struct stats_summary *summary)
+{
+	struct stats_summary *entry;
+	int i;
+
+	for (i = 0; i < fcb->f_sector_cnt; i++) {
+		const struct flash_sector *sector = &fcb->f_sectors[i];
+
+		if (sector->fs_off != summary->sector_off) {
+			continue;
+		}
+
+		if ((sector == fcb->f_active.fe_sector) ||
+		    !sector_in_use(fcb, sector) ||
+		    (sector_id(fcb, sector) != summary->id)) {
+			return;
+		}
+
+		entry = index_get(fcb, sector);
+		if (entry) {
+			*entry = *summary;
+		}
+
+		return;
+	}
+}
+
+static int summary_write(struct fcb_stats *stats)
+{
+	uint8_t buf[STATS_SUMMARY_LEN + STATS_ALIGN_MAX];
+	struct stats_summary summary = {
+		.sector_off = stats->sector->fs_off,
+		.id = stats->id,
+		.first = stats->first,
+		.last = stats->last,
+		.sum = stats->sum,
+	};
+	struct fcb_entry loc;
+	int ret;
+
+	buf[0] = STATS_SUMMARY;
+	sys_put_le32(summary.sector_off, &buf[1]);
+	sys_put_le16(summary.id, &buf[5]);
+	sys_put_le32(summary.first, &buf[7]);
+	sys_put_le32(summary.last, &buf[11]);
+	sys_put_le32(summary.sum.count, &buf[15]);
+	sys_put_le32(summary.sum.min, &buf[19]);
+	sys_put_le32(summary.sum.max, &buf[23]);
+	sys_put_le64(summary.sum.sum, &buf[27]);
+
+	ret = stats_write(stats->fcb, buf, STATS_SUMMARY_LEN, sizeof(buf),
+			  &loc);
+	if (ret) {
+		return ret;
+	}
+
+	index_add(stats->fcb, &summary);
+
+	return 0;
+}
+
+static void stats_add(struct fcb_stats *stats, uint32_t timestamp,
+		      int32_t value)
+{
+	if ((stats->sum.count == 0) || (timestamp < stats->first)) {
+		stats->first = timestamp;
+	}
+	if ((stats->sum.count == 0) || (timestamp > stats->last)) {
+		stats->last = timestamp;
+	}
+	bucket_add(&stats->sum, value);
+}
+
+static int stats_add_cb(uint32_t timestamp, int32_t value, void *arg)
+{
+	stats_add(arg, timestamp, value);
+
+	return 0;
+}
+
+static int init_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
+{
+	uint8_t *buf = stats_buf;
+	int ret;
+
+	ret = stats_read(entry_ctx->fap, &entry_ctx->loc, buf);
+	if ((ret == STATS_SAMPLE) || (ret == STATS_RUN)) {
+		return fcb_stats_foreach(buf, entry_ctx->loc.fe_data_len,
+					 stats_add_cb, arg);
+	} else if (ret < 0 && ret != -ENOMSG) {
+		return ret;
+	}
+
+	return 0;
+}
+
+int fcb_stats_init(struct fcb_stats *stats, struct fcb *fcb)
+{
+	int ret;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->fcb = fcb;
+	stats->sector = fcb->f_active.fe_sector;
+	stats->id = fcb->f_active_id;
+
+	ret = stats_lock(fcb);
+	if (ret) {
+		return ret;
+	}
+
+	ret = fcb_walk(fcb, stats->sector, init_cb, stats);
+	stats_unlock(fcb);
+
+	return ret;
+}
+
+static int samples_write(struct fcb_stats *stats, uint8_t *buf, uint16_t len)
+{
+	struct fcb_entry loc;
+	int ret;
+
+	/* No other writer gets in between the samples and the summary */
+	ret = k_mutex_lock(&stats->fcb->f_mtx, K_FOREVER);
+	if (ret) {
+		return ret;
+	}
+
+	ret = stats_write(stats->fcb, buf, len, STATS_BUF_LEN, &loc);
+	if (ret) {
+		k_mutex_unlock(&stats->fcb->f_mtx);
+		return ret;
+	}
+
+	/*
+	 * The log has moved on to a new sector: summarize the previous one
+	 * right after the first samples of the new one.
+	 */
+	if (loc.fe_sector != stats->sector) {
+		if (stats->sum.count) {
+			ret = summary_write(stats);
+		}
+
+		memset(&stats->sum, 0, sizeof(stats->sum));
+		stats->sector = loc.fe_sector;
+		stats->id = stats->fcb->f_active_id;
+	}
+
+	fcb_stats_foreach(buf, len, stats_add_cb, stats);
+	k_mutex_unlock(&stats->fcb->f_mtx);
+
+	return ret;
+}
+
+int fcb_stats_append(struct fcb_stats *stats, uint32_t timestamp,
+		     int32_t value)
+{
+	uint8_t *buf = stats_buf;
+	int ret;
+
+	ret = stats_lock(stats->fcb);
+	if (ret) {
+		return ret;
+	}
+
+	buf[0] = STATS_SAMPLE;
+	sys_put_le32(timestamp, &buf[1]);
+	sys_put_le32(value, &buf[5]);
+
+	ret = samples_write(stats, buf, STATS_SAMPLE_LEN);
+	stats_unlock(stats->fcb);
+
+	return ret;
+}
+
+int fcb_stats_append_run(struct fcb_stats *stats, const uint32_t *timestamps,
+			 const int32_t *values, size_t count)
+{
+	struct fcb_codec_dod ts_dod, value_dod;
+	uint8_t *buf = stats_buf;
+	size_t i, n, len;
+	int ret;
+
+	ret = stats_lock(stats->fcb);
+	if (ret) {
+		return ret;
+	}
+
+	while (count) {
+		n = MIN(count, CONFIG_FCB_STATS_RUN_MAX);
+		memset(&ts_dod, 0, sizeof(ts_dod));
+		memset(&value_dod, 0, sizeof(value_dod));
+		buf[0] = STATS_RUN;
+		buf[1] = n;
+		len = 2;
+		for (i = 0; i < n; i++) {
+			len += fcb_codec_dod_encode(&ts_dod, timestamps[i],
+						    &buf[len]);
+			len += fcb_codec_dod_encode(&value_dod, values[i],
+						    &buf[len]);
+		}
+
+		ret = samples_write(stats, buf, len);
+		if (ret) {
+			break;
+		}
+
+		timestamps += n;
+		values += n;
+		count -= n;
+	}
+
+	stats_unlock(stats->fcb);
+
+	return ret;
+}
+
+static struct flash_sector *next_sector(struct fcb *fcb,
+					struct flash_sector *sector)
+{
+	sector++;
+	if (sector >= &fcb->f_sectors[fcb->f_sector_cnt]) {
+		sector = &fcb->f_sectors[0];
+	}
+
+	return sector;
+}
+
+static int query_add_cb(uint32_t timestamp, int32_t value, void *arg)
+{
+	struct query_ctx *ctx = arg;
+
+	summary_add(&ctx->summary, timestamp, value);
+	if ((timestamp < ctx->from) || (timestamp >= ctx->to)) {
+		return 0;
+	}
+
+	bucket_add(&ctx->buckets[(timestamp - ctx->from) / ctx->width], value);
+
+	return 0;
+}
+
+/* The summaries met on the way are indexed */
+static int query_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
+{
+	struct stats_summary summary;
+	uint8_t *buf = stats_buf;
+	int ret;
+
+	ret = stats_read(entry_ctx->fap, &entry_ctx->loc, buf);
+	if ((ret == STATS_SAMPLE) || (ret == STATS_RUN)) {
+		return fcb_stats_foreach(buf, entry_ctx->loc.fe_data_len,
+					 query_add_cb, arg);
+	} else if (ret == STATS_SUMMARY) {
+		summary_decode(buf, &summary);
+		index_add(((struct query_ctx *)arg)->fcb, &summary);
+	} else if (ret < 0 && ret != -ENOMSG) {
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * The summary follows the first samples of the next sector, whatever the other
+ * entries (staging groups, shell appends...) around them; the walk stops at the
+ * first summary, as there is one at most per sector the log moves on to. Only
+ * the entries of the summary length are read.
+ */
+static int summary_cb(struct fcb_entry_ctx *entry_ctx, void *arg)
+{
+	struct stats_summary summary;
+	uint8_t *buf = stats_buf;
+	int ret;
+
+	if (entry_ctx->loc.fe_data_len != STATS_SUMMARY_LEN) {
+		return 0;
+	}
+
+	ret = stats_read(entry_ctx->fap, &entry_ctx->loc, buf);
+	if (ret == STATS_SUMMARY) {
+		summary_decode(buf, &summary);
+		index_add(arg, &summary);
+		return 1;
+	} else if (ret < 0 && ret != -ENOMSG) {
+		return ret;
+	}
+
+	return 0;
+}
+
+static int query_sector(struct fcb *fcb, struct flash_sector *sector,
+			struct query_ctx *ctx)
+{
+	const struct stats_summary *summary = NULL;
+	int ret;
+
+	if (sector != fcb->f_active.fe_sector) {
+		summary = index_lookup(fcb, sector);
+		if (summary == NULL) {
+			ret = fcb_walk(fcb, next_sector(fcb, sector),
+				       summary_cb, fcb);
+			if (ret < 0) {
+				return ret;
+			}
+
+			summary = index_lookup(fcb, sector);
+		}
+	}
+
+	if (summary) {
+		/* The sector is empty or out of range */
+		if ((summary->sum.count == 0) || (summary->last < ctx->from) ||
+		    (summary->first >= ctx->to)) {
+			return 1;
+		}
+
+		/* The sector is in range and fits in a single bucket */
+		if ((summary->first >= ctx->from) && (summary->last < ctx->to) &&
+		    ((summary->first - ctx->from) / ctx->width ==
+		     (summary->last - ctx->from) / ctx->width)) {
+			bucket_merge(&ctx->buckets[(summary->first - ctx->from) /
+						   ctx->width],
+				     &summary->sum);
+			return 1;
+		}
+	}
+
+	memset(&ctx->summary, 0, sizeof(ctx->summary));
+	ret = fcb_walk(fcb, sector, query_cb, ctx);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Index the sector read, so that the next queries do not */
+	if ((summary == NULL) && (sector != fcb->f_active.fe_sector)) {
+		ctx->summary.sector_off = sector->fs_off;
+		ctx->summary.id = sector_id(fcb, sector);
+		index_add(fcb, &ctx->summary);
+	}
+
+	return 0;
+}
+
+int fcb_stats_query(struct fcb *fcb, uint32_t from, uint32_t to,
+		    uint32_t width, struct fcb_stats_bucket *buckets,
+		    size_t count)
+{
+	struct query_ctx ctx = {
+		.fcb = fcb,
+		.from = from,
+		.to = to,
+		.width = width,
+		.buckets = buckets,
+	};
+	struct flash_sector *sector;
+	int summarized = 0;
+	int ret;
+
+	if ((width == 0) || (to <= from) || ((to - from - 1) / width >= count)) {
+		return -EINVAL;
+	}
+
+	memset(buckets, 0, ((to - from - 1) / width + 1) * sizeof(*buckets));
+
+	/* Hold the FCB so that no sector is rotated out while querying */
+	ret = stats_lock(fcb);
+	if (ret) {
+		return ret;
+	}
+
+	sector = fcb->f_oldest;
+	while (1) {
+		ret = query_sector(fcb, sector, &ctx);
+		if (ret < 0) {
+			break;
+		}
+
+		summarized += ret;
+		if (sector == fcb->f_active.fe_sector) {
+			ret = summarized;
+			break;
+		}
+
+		sector = next_sector(fcb, sector);
+	}
+
+	stats_unlock(fcb);
+
+	return ret;
+}
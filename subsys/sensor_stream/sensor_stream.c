@@ -0,0 +1,420 @@
+/* sensor_stream.c - Binary sensor streaming to the shell UART */
+
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/util.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every sample is streamed as a frame laid out as:
+ *
+ * - the sync bytes 0xa5 0x5a
+ * - the length of the fields up to the CRC (1 byte)
+ * - the sequence number (2 bytes)
+ * - the timestamp in microseconds (4 bytes)
+ * - the number of channels (1 byte)
+ * - the channel and its value in thousandths, per channel (1 + 4 bytes)
+ * - the CRC32 (IEEE) of the length and the fields (4 bytes)
+ *
+ * All fields are little-endian. A sample dropped as the buffer is full still
+ * takes a sequence number, so that the host sees the gap; the host resyncs on
+ * the sync bytes past the shell prompt and the logs.
+ *
+ * A thread samples the sensor, and puts the frames in a ring; another one, of
+ * lower priority, drains the ring to the shell UART. The UART is polled, the
+ * frames do not go through the shell, which is bypassed meanwhile.
+ */
+#define STREAM_SYNC0 0xa5
+#define STREAM_SYNC1 0x5a
+#define STREAM_HDR_LEN 3
+#define STREAM_CRC_LEN 4
+#define STREAM_CHANNELS_MAX 8
+#define STREAM_FRAME_MAX_LEN (STREAM_HDR_LEN + 7 + \
+			      STREAM_CHANNELS_MAX * 5 + STREAM_CRC_LEN)
+
+#define STREAM_RATE_MAX 10000
+
+struct stream {
+	/* Configuration */
+	const struct shell *shell;
+	const struct device *dev;
+	enum sensor_channel channels[STREAM_CHANNELS_MAX];
+	uint8_t num_channels;
+	uint32_t rate;
+
+	/* State */
+	const struct device *uart;
+	atomic_t running;
+	/* Set by the sampling thread once it stopped */
+	atomic_t stopped;
+	struct k_timer timer;
+	struct k_sem start;
+	/* Given by the sampling thread for every frame, and once stopped */
+	struct k_sem ready;
+	uint16_t seq;
+
+	/* Statistics */
+	uint32_t frames;
+	uint32_t dropped;
+	uint32_t errors;
+	uint32_t late;
+	uint64_t bytes;
+	int64_t since_ms;
+	int64_t until_ms;
+};
+
+static struct stream stream;
+
+RING_BUF_DECLARE(stream_ring, CONFIG_SENSOR_STREAM_BUF_SIZE);
+
+static K_KERNEL_STACK_DEFINE(sample_stack,
+			     CONFIG_SENSOR_STREAM_THREAD_STACK_SIZE);
+static struct k_thread sample_thread_data;
+
+static K_KERNEL_STACK_DEFINE(drain_stack,
+			     CONFIG_SENSOR_STREAM_THREAD_STACK_SIZE);
+static struct k_thread drain_thread_data;
+
+static const struct {
+	const char *name;
+	enum sensor_channel chan;
+} channel_names[] = {
+	{ "accel_x", SENSOR_CHAN_ACCEL_X },
+	{ "accel_y", SENSOR_CHAN_ACCEL_Y },
+	{ "accel_z", SENSOR_CHAN_ACCEL_Z },
+	{ "gyro_x", SENSOR_CHAN_GYRO_X },
+	{ "gyro_y", SENSOR_CHAN_GYRO_Y },
+	{ "gyro_z", SENSOR_CHAN_GYRO_Z },
+	{ "die_temp", SENSOR_CHAN_DIE_TEMP },
+	{ "ambient_temp", SENSOR_CHAN_AMBIENT_TEMP },
+	{ "press", SENSOR_CHAN_PRESS },
+	{ "humidity", SENSOR_CHAN_HUMIDITY },
+	{ "light", SENSOR_CHAN_LIGHT },
+	{ "voltage", SENSOR_CHAN_VOLTAGE },
+	{ "current", SENSOR_CHAN_CURRENT },
+};
+
+static int stream_channel_parse(const char *str, enum sensor_channel *chan)
+{
+	char *end;
+	long val;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(channel_names); i++) {
+		if (strcmp(str, channel_names[i].name) == 0) {
+			*chan = channel_names[i].chan;
+			return 0;
+		}
+	}
+
+	/* Or the channel number, as in enum sensor_channel */
+	val = strtol(str, &end, 0);
+	if ((*end != '\0') || (val < 0) || (val >= SENSOR_CHAN_ALL)) {
+		return -EINVAL;
+	}
+
+	*chan = val;
+
+	return 0;
+}
+
+static int32_t stream_value_milli(const struct sensor_value *val)
+{
+	int64_t milli = (int64_t)val->val1 * 1000 + val->val2 / 1000;
+
+	return CLAMP(milli, INT32_MIN, INT32_MAX);
+}
+
+static void stream_sample(struct stream *stream)
+{
+	uint8_t frame[STREAM_FRAME_MAX_LEN];
+	uint32_t timestamp = k_ticks_to_us_floor64(k_uptime_ticks());
+	uint16_t seq = stream->seq++;
+	struct sensor_value val;
+	size_t off, i;
+	int err;
+
+	err = sensor_sample_fetch(stream->dev);
+	if (err) {
+		stream->errors++;
+		return;
+	}
+
+	frame[0] = STREAM_SYNC0;
+	frame[1] = STREAM_SYNC1;
+	off = STREAM_HDR_LEN;
+	sys_put_le16(seq, &frame[off]);
+	off += sizeof(uint16_t);
+	sys_put_le32(timestamp, &frame[off]);
+	off += sizeof(uint32_t);
+	frame[off++] = stream->num_channels;
+
+	for (i = 0; i < stream->num_channels; i++) {
+		err = sensor_channel_get(stream->dev, stream->channels[i], &val);
+		if (err) {
+			stream->errors++;
+			return;
+		}
+
+		frame[off++] = stream->channels[i];
+		sys_put_le32(stream_value_milli(&val), &frame[off]);
+		off += sizeof(uint32_t);
+	}
+
+	frame[2] = off - STREAM_HDR_LEN;
+	sys_put_le32(crc32_ieee(&frame[2], off - 2), &frame[off]);
+	off += STREAM_CRC_LEN;
+
+	/* Never wait for the UART */
+	if (ring_buf_space_get(&stream_ring) < off) {
+		stream->dropped++;
+		return;
+	}
+
+	ring_buf_put(&stream_ring, frame, off);
+	stream->frames++;
+}
+
+/* Write the frames to the UART; returns the bytes written */
+static size_t stream_drain(struct stream *stream)
+{
+	size_t len, i;
+	uint8_t *data;
+
+	len = ring_buf_get_claim(&stream_ring, &data,
+				 CONFIG_SENSOR_STREAM_BUF_SIZE);
+	for (i = 0; i < len; i++) {
+		uart_poll_out(stream->uart, data[i]);
+	}
+
+	ring_buf_get_finish(&stream_ring, len);
+	stream->bytes += len;
+
+	return len;
+}
+
+static void stream_print(const struct shell *shell, struct stream *stream)
+{
+	int64_t until = atomic_get(&stream->running) ? k_uptime_get() :
+			stream->until_ms;
+	uint32_t ms = until - stream->since_ms;
+
+	shell_print(shell, "Frames:            %u", stream->frames);
+	shell_print(shell, "Dropped:           %u", stream->dropped);
+	shell_print(shell, "Errors:            %u", stream->errors);
+	shell_print(shell, "Late:              %u", stream->late);
+	shell_print(shell, "Bytes:             %llu", stream->bytes);
+	shell_print(shell, "Duration:          %ums", ms);
+	if (ms) {
+		shell_print(shell, "Throughput:        %llu B/s",
+			    (stream->bytes * MSEC_PER_SEC) / ms);
+	}
+}
+
+/* The producer: samples as the periods elapse, until stopped */
+static void stream_sample_thread(void *p1, void *p2, void *p3)
+{
+	struct stream *stream = p1;
+	uint32_t status;
+
+	for (;;) {
+		k_sem_take(&stream->start, K_FOREVER);
+
+		while (atomic_get(&stream->running)) {
+			/* The timer stopped returns no elapsed period */
+			status = k_timer_status_sync(&stream->timer);
+			if (status == 0) {
+				continue;
+			}
+
+			stream->late += status - 1;
+			stream_sample(stream);
+			k_sem_give(&stream->ready);
+		}
+
+		atomic_set(&stream->stopped, 1);
+		k_sem_give(&stream->ready);
+	}
+}
+
+/* The consumer: drains the frames, and reports once the producer stopped */
+static void stream_drain_thread(void *p1, void *p2, void *p3)
+{
+	struct stream *stream = p1;
+
+	for (;;) {
+		k_sem_take(&stream->ready, K_FOREVER);
+
+		/* The ring wraps around, so it takes two claims at most */
+		while (stream_drain(stream)) {
+		}
+
+		if (!atomic_cas(&stream->stopped, 1, 0)) {
+			continue;
+		}
+
+		/* The last frames may have come in meanwhile */
+		while (stream_drain(stream)) {
+		}
+
+		stream->until_ms = k_uptime_get();
+		shell_set_bypass(stream->shell, NULL);
+		shell_print(stream->shell, "");
+		stream_print(stream->shell, stream);
+	}
+}
+
+/* Any input stops the stream */
+static void stream_bypass(const struct shell *shell, uint8_t *data,
+			  size_t len)
+{
+	atomic_clear(&stream.running);
+	k_timer_stop(&stream.timer);
+}
+
+static int cmd_start(const struct shell *shell, size_t argc, char *argv[])
+{
+	const struct device *dev;
+	uint32_t period_us;
+	char *end;
+	long rate;
+	size_t i;
+	int err;
+
+	/* Nor is the previous stream drained yet */
+	if (atomic_get(&stream.running) || atomic_get(&stream.stopped)) {
+		shell_error(shell, "Already streaming");
+		return -EBUSY;
+	}
+
+	if (!device_is_ready(stream.uart)) {
+		shell_error(shell, "No shell UART");
+		return -ENODEV;
+	}
+
+	dev = device_get_binding(argv[1]);
+	if ((dev == NULL) || !device_is_ready(dev)) {
+		shell_error(shell, "No such device: %s", argv[1]);
+		return -ENODEV;
+	}
+
+	rate = strtol(argv[2], &end, 0);
+	if ((*end != '\0') || (rate <= 0) || (rate > STREAM_RATE_MAX)) {
+		shell_error(shell, "Invalid rate: %s", argv[2]);
+		return -EINVAL;
+	}
+
+	if (argc - 3 > STREAM_CHANNELS_MAX) {
+		shell_error(shell, "Too many channels");
+		return -EINVAL;
+	}
+
+	for (i = 3; i < argc; i++) {
+		err = stream_channel_parse(argv[i], &stream.channels[i - 3]);
+		if (err) {
+			shell_error(shell, "Invalid channel: %s", argv[i]);
+			return err;
+		}
+	}
+
+	stream.shell = shell;
+	stream.dev = dev;
+	stream.num_channels = argc - 3;
+	stream.rate = rate;
+	stream.seq = 0;
+	stream.frames = 0;
+	stream.dropped = 0;
+	stream.errors = 0;
+	stream.late = 0;
+	stream.bytes = 0;
+	stream.since_ms = k_uptime_get();
+	ring_buf_reset(&stream_ring);
+	atomic_clear(&stream.stopped);
+
+	shell_print(shell, "Streaming %s at %ldHz, press any key to stop",
+		    dev->name, rate);
+
+	period_us = USEC_PER_SEC / rate;
+	shell_set_bypass(shell, stream_bypass);
+	atomic_set(&stream.running, 1);
+	k_timer_start(&stream.timer, K_USEC(period_us), K_USEC(period_us));
+	k_sem_give(&stream.start);
+
+	return 0;
+}
+
+static int cmd_status(const struct shell *shell, size_t argc, char *argv[])
+{
+	if (stream.dev == NULL) {
+		shell_print(shell, "Never streamed");
+		return 0;
+	}
+
+	shell_print(shell, "Device:            %s", stream.dev->name);
+	shell_print(shell, "Rate:              %uHz", stream.rate);
+	stream_print(shell, &stream);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sensor_stream_cmds,
+	SHELL_CMD_ARG(start,  NULL, "<device> <rate> <channel>...", cmd_start,
+		      4, STREAM_CHANNELS_MAX - 1),
+	SHELL_CMD_ARG(status, NULL, NULL, cmd_status, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+static int cmd_sensor_stream(const struct shell *shell, size_t argc,
+			     char **argv)
+{
+	shell_error(shell, "%s unknown parameter: %s", argv[0], argv[1]);
+	return -EINVAL;
+}
+
+SHELL_CMD_ARG_REGISTER(sensor_stream, &sensor_stream_cmds,
+		       "Binary sensor streaming commands", cmd_sensor_stream,
+		       2, 0);
+
+static int sensor_stream_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	stream.uart = DEVICE_DT_GET(DT_CHOSEN(zephyr_shell_uart));
+	k_timer_init(&stream.timer, NULL, NULL);
+	k_sem_init(&stream.start, 0, 1);
+	k_sem_init(&stream.ready, 0, K_SEM_MAX_LIMIT);
+
+	k_thread_create(&sample_thread_data, sample_stack,
+			K_KERNEL_STACK_SIZEOF(sample_stack),
+			stream_sample_thread, &stream, NULL, NULL,
+			K_PRIO_PREEMPT(CONFIG_SENSOR_STREAM_THREAD_PRIORITY), 0,
+			K_NO_WAIT);
+	k_thread_name_set(&sample_thread_data, "sensor_stream");
+
+	k_thread_create(&drain_thread_data, drain_stack,
+			K_KERNEL_STACK_SIZEOF(drain_stack),
+			stream_drain_thread, &stream, NULL, NULL,
+			K_PRIO_PREEMPT(CONFIG_SENSOR_STREAM_DRAIN_THREAD_PRIORITY),
+			0, K_NO_WAIT);
+	k_thread_name_set(&drain_thread_data, "sensor_stream_drain");
+
+	return 0;
+}
+
+SYS_INIT(sensor_stream_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
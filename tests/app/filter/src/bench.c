@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/ztest.h>
+
+#include "filter.h"
+
+#define BENCH_SAMPLES 1024
+
+static int32_t bench_value(void)
+{
+	return 20000 + (int32_t)(sys_rand32_get() % 1001) - 500;
+}
+
+/* Cycles per update, once the window is full */
+static uint32_t bench_one(enum filter_type type, uint8_t window)
+{
+	struct filter filter = {
+		.type = type,
+		.window = window,
+		.noise = 200,
+	};
+	uint32_t i, start, cycles = 0;
+	int32_t value;
+
+	filter_init(&filter);
+	for (i = 0; i < window; i++) {
+		filter_update(&filter, bench_value());
+	}
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		value = bench_value();
+		start = k_cycle_get_32();
+		filter_update(&filter, value);
+		cycles += k_cycle_get_32() - start;
+	}
+
+	return cycles / BENCH_SAMPLES;
+}
+
+static void bench_type(enum filter_type type, uint32_t *small, uint32_t *large)
+{
+	uint32_t window, cycles;
+
+	for (window = 4; window <= CONFIG_APP_FILTER_WINDOW_MAX; window *= 2) {
+		cycles = bench_one(type, window);
+		TC_PRINT("%-8s window %3u: %5u cycles, %5lluns\n",
+			 filter_type_str(type), window, cycles,
+			 k_cyc_to_ns_ceil64(cycles));
+		if (window == 4) {
+			*small = cycles;
+		}
+		*large = cycles;
+	}
+}
+
+/* The average, EMA and Kalman updates are O(1) */
+ZTEST(filter_bench, test_constant)
+{
+	static const enum filter_type types[] = {
+		FILTER_AVERAGE, FILTER_EMA, FILTER_KALMAN,
+	};
+	uint32_t small, large;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		bench_type(types[i], &small, &large);
+		zassert_true(large <= 2 * small + 100, "%s: %u then %u cycles",
+			     filter_type_str(types[i]), small, large);
+	}
+}
+
+/* The median update is O(log n), far below the growth of the window */
+ZTEST(filter_bench, test_median)
+{
+	uint32_t small, large;
+
+	bench_type(FILTER_MEDIAN, &small, &large);
+	zassert_true(large * 4 <= small * CONFIG_APP_FILTER_WINDOW_MAX,
+		     "median: %u then %u cycles", small, large);
+}
+
+ZTEST_SUITE(filter_bench, NULL, NULL, NULL, NULL, NULL);
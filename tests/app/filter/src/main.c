@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+#define SAMPLES 2000
+
+static int32_t history[SAMPLES];
+
+static int32_t rand_value(void)
+{
+	return (int32_t)(sys_rand32_get() % 20001) - 10000;
+}
+
+static int compare(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Median of the last values, by sorting them */
+static int32_t ref_median(size_t i, size_t window)
+{
+	int32_t sorted[CONFIG_APP_FILTER_WINDOW_MAX];
+	size_t n = MIN(i + 1, window);
+
+	memcpy(sorted, &history[i + 1 - n], n * sizeof(sorted[0]));
+	qsort(sorted, n, sizeof(sorted[0]), compare);
+	if (n % 2) {
+		return sorted[n / 2];
+	}
+
+	return ((int64_t)sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+static int32_t ref_average(size_t i, size_t window)
+{
+	size_t j, n = MIN(i + 1, window);
+	int64_t sum = 0;
+
+	for (j = i + 1 - n; j <= i; j++) {
+		sum += history[j];
+	}
+
+	return sum / (int64_t)n;
+}
+
+static void check_window(enum filter_type type, uint8_t window,
+			 int32_t (*ref)(size_t i, size_t window))
+{
+	struct filter filter = {
+		.type = type,
+		.window = window,
+	};
+	int32_t value;
+	size_t i;
+
+	filter_init(&filter);
+	for (i = 0; i < SAMPLES; i++) {
+		history[i] = rand_value();
+		value = filter_update(&filter, history[i]);
+		zassert_equal(value, ref(i, window), "%s window %u sample %u",
+			      filter_type_str(type), window, i);
+	}
+}
+
+ZTEST(filter, test_median)
+{
+	uint8_t window;
+
+	for (window = 1; window <= CONFIG_APP_FILTER_WINDOW_MAX; window++) {
+		check_window(FILTER_MEDIAN, window, ref_median);
+	}
+}
+
+ZTEST(filter, test_average)
+{
+	uint8_t window;
+
+	for (window = 1; window <= CONFIG_APP_FILTER_WINDOW_MAX; window++) {
+		check_window(FILTER_AVERAGE, window, ref_average);
+	}
+}
+
+/* The median drops the spikes the average smears */
+ZTEST(filter, test_median_spike)
+{
+	struct filter filter = {
+		.type = FILTER_MEDIAN,
+		.window = 5,
+	};
+	int32_t value;
+	int i;
+
+	filter_init(&filter);
+	for (i = 0; i < 10; i++) {
+		value = filter_update(&filter, i == 6 ? 100000 : 20000);
+		zassert_equal(value, 20000);
+	}
+}
+
+ZTEST(filter, test_window_clamp)
+{
+	struct filter filter = {
+		.type = FILTER_AVERAGE,
+		.window = 0,
+	};
+
+	filter_init(&filter);
+	zassert_equal(filter.window, 1);
+
+	filter.window = 255;
+	filter_init(&filter);
+	zassert_equal(filter.window, CONFIG_APP_FILTER_WINDOW_MAX);
+}
+
+/* The first value goes through, then a step converges */
+static void check_step(enum filter_type type)
+{
+	struct filter filter = {
+		.type = type,
+		.window = 4,
+		.noise = 100,
+	};
+	int32_t value, last = 0;
+	int i;
+
+	filter_init(&filter);
+	zassert_equal(filter_update(&filter, 1000), 1000);
+	zassert_equal(filter_update(&filter, 1000), 1000);
+
+	for (i = 0; i < 200; i++) {
+		value = filter_update(&filter, 2000);
+		zassert_true((value >= last) && (value <= 2000),
+			     "%s not monotonic: %d after %d",
+			     filter_type_str(type), value, last);
+		last = value;
+	}
+
+	zassert_within(last, 2000, 1, "%s stuck at %d", filter_type_str(type),
+		       last);
+}
+
+ZTEST(filter, test_ema)
+{
+	check_step(FILTER_EMA);
+}
+
+ZTEST(filter, test_kalman)
+{
+	check_step(FILTER_KALMAN);
+}
+
+/* Filtering a noisy constant lowers the error */
+ZTEST(filter, test_noise)
+{
+	static const enum filter_type types[] = {
+		FILTER_AVERAGE, FILTER_MEDIAN, FILTER_EMA, FILTER_KALMAN,
+	};
+	struct filter filter;
+	uint64_t raw_error, error;
+	int32_t value;
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		memset(&filter, 0, sizeof(filter));
+		filter.type = types[i];
+		filter.window = 16;
+		filter.noise = 5000;
+		filter_init(&filter);
+
+		raw_error = 0;
+		error = 0;
+		for (j = 0; j < SAMPLES; j++) {
+			value = 25000 + rand_value() / 2;
+			raw_error += abs(value - 25000);
+			error += abs(filter_update(&filter, value) - 25000);
+		}
+
+		zassert_true(error * 2 < raw_error, "%s: error %llu, raw %llu",
+			     filter_type_str(types[i]), error, raw_error);
+	}
+}
+
+ZTEST(filter, test_none)
+{
+	struct filter filter = {
+		.type = FILTER_NONE,
+	};
+
+	filter_init(&filter);
+	zassert_equal(filter_update(&filter, 1234), 1234);
+	zassert_equal(filter_update(&filter, -5678), -5678);
+	zassert_equal(filter.raw, -5678);
+	zassert_equal(filter.updates, 2);
+}
+
+ZTEST_SUITE(filter, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <math.h>
+
+#include "metrics.h"
+
+/* Floating-point references */
+static double ref_saturation(double t)
+{
+	return 611.2 * exp((17.62 * t) / (243.12 + t));
+}
+
+static double ref_dew_point(double t, double rh)
+{
+	double gamma = log(rh / 100.0) + (17.62 * t) / (243.12 + t);
+
+	return (243.12 * gamma) / (17.62 - gamma);
+}
+
+static double ref_absolute_humidity(double t, double rh)
+{
+	return (ref_saturation(t) * rh / 100.0 * 2.1668) / (t + 273.15);
+}
+
+static double ref_heat_index(double t, double rh)
+{
+	double f = t * 9.0 / 5.0 + 32.0, hi;
+
+	hi = 0.5 * (f + 61.0 + (f - 68.0) * 1.2 + rh * 0.094);
+	if ((hi + f) / 2.0 >= 80.0) {
+		hi = -42.379 + 2.04901523 * f + 10.14333127 * rh -
+		     0.22475541 * f * rh - 0.00683783 * f * f -
+		     0.05481717 * rh * rh + 0.00122874 * f * f * rh +
+		     0.00085282 * f * rh * rh - 0.00000199 * f * f * rh * rh;
+		if ((rh < 13.0) && (f >= 80.0) && (f <= 112.0)) {
+			hi -= ((13.0 - rh) / 4.0) *
+			      sqrt((17.0 - fabs(f - 95.0)) / 17.0);
+		} else if ((rh > 85.0) && (f >= 80.0) && (f <= 87.0)) {
+			hi += ((rh - 85.0) / 10.0) * ((87.0 - f) / 5.0);
+		}
+	}
+
+	return (hi - 32.0) * 5.0 / 9.0;
+}
+
+static double ref_altitude(double pressure, double sea_level_pressure)
+{
+	return 44330.0 * (1.0 - pow(pressure / sea_level_pressure, 1 / 5.255));
+}
+
+static double ref_sea_level_pressure(double pressure, double altitude)
+{
+	return pressure / pow(1.0 - altitude / 44330.0, 5.255);
+}
+
+/*
+ * Largest error, in units, of a metric in thousandths over the operating
+ * range of the HTU21D: -40°C to 60°C, 1%RH to 100%RH.
+ */
+static double humidity_error(int32_t (*fixed)(int32_t, int32_t),
+			     double (*ref)(double, double))
+{
+	double error = 0.0;
+	int32_t t, rh;
+
+	for (t = -40000; t <= 60000; t += 500) {
+		for (rh = 1000; rh <= 100000; rh += 1000) {
+			error = MAX(error, fabs(fixed(t, rh) / 1000.0 -
+						ref(t / 1000.0, rh / 1000.0)));
+		}
+	}
+
+	return error;
+}
+
+ZTEST(metrics, test_dew_point)
+{
+	double error = humidity_error(metrics_dew_point, ref_dew_point);
+
+	zassert_true(error < 0.01, "Dew point off by %.3f°C", error);
+}
+
+ZTEST(metrics, test_absolute_humidity)
+{
+	double error = humidity_error(metrics_absolute_humidity,
+				      ref_absolute_humidity);
+
+	zassert_true(error < 0.01, "Absolute humidity off by %.3fg/m³", error);
+}
+
+ZTEST(metrics, test_heat_index)
+{
+	double error = humidity_error(metrics_heat_index, ref_heat_index);
+
+	zassert_true(error < 0.01, "Heat index off by %.3f°C", error);
+}
+
+/* Over the range of the BME280: 300hPa to 1100hPa */
+ZTEST(metrics, test_altitude)
+{
+	double error = 0.0;
+	int32_t p;
+
+	for (p = 30000; p <= 110000; p += 100) {
+		error = MAX(error, fabs(metrics_altitude(p, 101325) / 1000.0 -
+					ref_altitude(p, 101325)));
+	}
+
+	zassert_true(error < 0.01, "Altitude off by %.3fm", error);
+	zassert_equal(metrics_altitude(101325, 101325), 0);
+	zassert_equal(metrics_altitude(0, 101325), 0);
+	zassert_equal(metrics_altitude(101325, 0), 0);
+}
+
+ZTEST(metrics, test_sea_level_pressure)
+{
+	double error = 0.0;
+	int32_t p, h;
+
+	for (p = 30000; p <= 110000; p += 100) {
+		for (h = -400; h <= 4000; h += 400) {
+			error = MAX(error,
+				    fabs(metrics_sea_level_pressure(p, h) -
+					 ref_sea_level_pressure(p, h)));
+		}
+	}
+
+	zassert_true(error < 2.0, "Sea-level pressure off by %.3fPa", error);
+	zassert_equal(metrics_sea_level_pressure(95000, 0), 95000);
+
+	/* Out of the atmosphere, the pressure is left as is */
+	zassert_equal(metrics_sea_level_pressure(95000, 44330), 95000);
+}
+
+ZTEST(metrics, test_update)
+{
+	struct metrics m = { 0 };
+
+	metrics_htu21d_update(&m, 50000, 21000);
+	zassert_equal(m.sources, METRICS_HTU21D);
+	zassert_equal(m.compensated_humidity, 49400);
+
+	/* The BME280 temperature takes over for the compensation */
+	metrics_bme280_update(&m, 20000, 95000);
+	zassert_equal(m.sources, METRICS_BME280 | METRICS_HTU21D);
+	zassert_equal(m.compensated_humidity, 49250);
+	zassert_equal(m.dew_point, metrics_dew_point(20000, 49250));
+	zassert_equal(m.altitude, metrics_altitude(95000,
+					CONFIG_APP_METRICS_SEA_LEVEL_PA));
+	zassert_equal(m.updates, 2);
+}
+
+ZTEST_SUITE(metrics, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <string.h>
+
+#include "record.h"
+
+#define GARBAGE 10000
+
+static void sample_init(struct record_sample *sample, uint8_t channels)
+{
+	static const int32_t values[RECORD_CHANNELS] = {
+		[RECORD_TEMPERATURE] = -12345,
+		[RECORD_PRESSURE] = 101325,
+		[RECORD_LIGHT] = INT32_MAX,
+		[RECORD_HUMIDITY] = INT32_MIN,
+	};
+
+	sample->timestamp = UINT32_MAX - channels;
+	sample->channels = channels;
+	memcpy(sample->values, values, sizeof(sample->values));
+}
+
+ZTEST(record, test_round_trip)
+{
+	struct record_sample sample, decoded;
+	uint8_t buf[RECORD_MAX_LEN];
+	uint8_t channels;
+	int len, i;
+
+	for (channels = 0; channels <= RECORD_CHANNELS_MASK; channels++) {
+		sample_init(&sample, channels);
+		len = record_encode(&sample, buf, sizeof(buf));
+		zassert_equal(len, RECORD_LEN(__builtin_popcount(channels)),
+			      "channels %#x", channels);
+		zassert_equal(buf[0], RECORD_VERSION);
+		zassert_equal(buf[1], channels);
+		zassert_equal(sys_get_le32(&buf[2]), sample.timestamp);
+
+		memset(&decoded, 0xa5, sizeof(decoded));
+		zassert_ok(record_decode(buf, len, &decoded), "channels %#x",
+			   channels);
+		zassert_equal(decoded.channels, channels);
+		zassert_equal(decoded.timestamp, sample.timestamp);
+		for (i = 0; i < RECORD_CHANNELS; i++) {
+			zassert_equal(decoded.values[i],
+				      (channels & BIT(i)) ? sample.values[i] : 0,
+				      "channels %#x value %d", channels, i);
+		}
+	}
+}
+
+ZTEST(record, test_encode_errors)
+{
+	struct record_sample sample;
+	uint8_t buf[RECORD_MAX_LEN];
+
+	sample_init(&sample, BIT(RECORD_CHANNELS));
+	zassert_equal(record_encode(&sample, buf, sizeof(buf)), -EINVAL);
+
+	sample_init(&sample, RECORD_CHANNELS_MASK);
+	zassert_equal(record_encode(&sample, buf, RECORD_MAX_LEN - 1),
+		      -ENOSPC);
+	zassert_equal(record_encode(&sample, buf, 0), -ENOSPC);
+}
+
+ZTEST(record, test_truncated)
+{
+	struct record_sample sample, decoded;
+	uint8_t buf[RECORD_MAX_LEN + 1] = { 0 };
+	uint8_t channels;
+	int len, i;
+
+	for (channels = 0; channels <= RECORD_CHANNELS_MASK; channels++) {
+		sample_init(&sample, channels);
+		len = record_encode(&sample, buf, sizeof(buf));
+		zassert_true(len > 0);
+
+		for (i = 0; i < len; i++) {
+			zassert_equal(record_decode(buf, i, &decoded),
+				      -EBADMSG, "channels %#x len %d",
+				      channels, i);
+		}
+
+		/* Trailing bytes are not a record either */
+		zassert_equal(record_decode(buf, len + 1, &decoded), -EBADMSG,
+			      "channels %#x", channels);
+	}
+}
+
+ZTEST(record, test_garbage)
+{
+	struct record_sample sample, decoded;
+	uint8_t buf[RECORD_MAX_LEN], again[RECORD_MAX_LEN];
+	size_t len, j;
+	int i, ret;
+
+	sample_init(&sample, RECORD_CHANNELS_MASK);
+	zassert_equal(record_encode(&sample, buf, sizeof(buf)),
+		      RECORD_MAX_LEN);
+
+	buf[0] = RECORD_VERSION + 1;
+	zassert_equal(record_decode(buf, RECORD_MAX_LEN, &decoded), -ENOTSUP);
+	buf[0] = 0;
+	zassert_equal(record_decode(buf, RECORD_MAX_LEN, &decoded), -ENOTSUP);
+
+	buf[0] = RECORD_VERSION;
+	buf[1] = 0xff;
+	zassert_equal(record_decode(buf, RECORD_MAX_LEN, &decoded), -EBADMSG);
+
+	/* Random bytes are rejected, or decode to a record encoded alike */
+	for (i = 0; i < GARBAGE; i++) {
+		len = sys_rand32_get() % (sizeof(buf) + 1);
+		for (j = 0; j < len; j++) {
+			buf[j] = sys_rand32_get() >> 24;
+		}
+
+		/* Make the header valid every other time */
+		if ((i % 2) && (len >= RECORD_HEADER_LEN)) {
+			buf[0] = RECORD_VERSION;
+			buf[1] &= RECORD_CHANNELS_MASK;
+		}
+
+		ret = record_decode(buf, len, &decoded);
+		if (ret) {
+			zassert_true((ret == -EBADMSG) || (ret == -ENOTSUP),
+				     "ret %d", ret);
+			continue;
+		}
+
+		zassert_equal(record_encode(&decoded, again, sizeof(again)),
+			      len);
+		zassert_mem_equal(again, buf, len);
+	}
+}
+
+ZTEST(record, test_publish)
+{
+	struct record *recs[CONFIG_APP_RECORD_BUFS], *rec;
+	struct record_sample sample, decoded;
+	size_t i;
+
+	/* The latest record holds a reference too */
+	for (i = 0; i < ARRAY_SIZE(recs); i++) {
+		sample_init(&sample, BIT(i % RECORD_CHANNELS));
+		recs[i] = record_publish(&sample);
+		zassert_not_null(recs[i], "record %zu", i);
+
+		rec = record_latest();
+		zassert_equal_ptr(rec, recs[i]);
+		record_unref(rec);
+	}
+
+	zassert_is_null(record_publish(&sample));
+
+	zassert_ok(record_decode(recs[i - 1]->data, recs[i - 1]->len,
+				 &decoded));
+	zassert_equal(decoded.channels, sample.channels);
+	zassert_equal(recs[i - 1]->seq, recs[0]->seq + i - 1);
+
+	/* Once released, the records are reused */
+	for (i = 0; i < ARRAY_SIZE(recs); i++) {
+		record_unref(recs[i]);
+	}
+
+	rec = record_publish(&sample);
+	zassert_not_null(rec);
+	record_unref(rec);
+}
+
+ZTEST(record, test_time)
+{
+	/* Seconds since boot, until the RTC time is set */
+	zassert_equal(record_time(), k_uptime_get() / MSEC_PER_SEC);
+
+	record_time_set(1700000000);
+	zassert_equal(record_time(), 1700000000);
+
+	/* The RTC and the uptime ticking apart do not step the time back */
+	record_time_set(1699999999);
+	zassert_equal(record_time(), 1700000000);
+
+	record_time_set(1700003600);
+	zassert_equal(record_time(), 1700003600);
+}
+
+ZTEST_SUITE(record, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include "emul_bh1750.h"
+
+/* As the driver */
+#define MTREG_DEFAULT 69
+#define MTREG_MIN     31
+#define MTREG_MAX							\
+	MIN(254, CONFIG_ROHM_BH1750_MEASUREMENT_TIME_MAX * MTREG_DEFAULT / 120)
+
+/* Longer than the longest measurement */
+#define MEASUREMENT_MS 1000
+
+/* Enough fetches to settle from either end of the range */
+#define SETTLE_FETCHES 8
+
+static const struct device *const dev = DEVICE_DT_GET(DT_NODELABEL(light));
+static const struct emul *const emul = EMUL_DT_GET(DT_NODELABEL(light));
+
+static int fetch(int32_t *mlx)
+{
+	struct sensor_value val;
+	int ret;
+
+	k_sleep(K_MSEC(MEASUREMENT_MS));
+	ret = sensor_sample_fetch(dev);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = sensor_channel_get(dev, SENSOR_CHAN_LIGHT, &val);
+	if (ret < 0) {
+		return ret;
+	}
+
+	*mlx = val.val1 * 1000 + val.val2 / 1000;
+
+	return 0;
+}
+
+/* Set the light, and fetch until the measurement time settles */
+static int32_t settle(uint32_t mlx)
+{
+	int32_t value = 0;
+	int i;
+
+	bh1750_emul_set_light(emul, mlx);
+	for (i = 0; i < SETTLE_FETCHES; i++) {
+		zassert_ok(fetch(&value));
+	}
+
+	return value;
+}
+
+static void *bh1750_setup(void)
+{
+	zassert_true(device_is_ready(dev));
+
+	return NULL;
+}
+
+ZTEST(bh1750, test_no_data)
+{
+	const struct device *idle = DEVICE_DT_GET(DT_NODELABEL(idle));
+	struct sensor_value val;
+
+	zassert_true(device_is_ready(idle));
+	zassert_equal(sensor_channel_get(idle, SENSOR_CHAN_LIGHT, &val),
+		      -ENODATA);
+}
+
+ZTEST(bh1750, test_auto_range)
+{
+	int32_t value;
+	uint8_t mtreg;
+
+	/* The longest time resolves the darkness */
+	settle(500);
+	zassert_equal(bh1750_emul_get_mtreg(emul), MTREG_MAX);
+
+	/* In between, the count lands in range and stays there */
+	settle(50000000);
+	mtreg = bh1750_emul_get_mtreg(emul);
+	zassert_true(mtreg > MTREG_MIN && mtreg < MTREG_MAX, "mtreg %u",
+		     mtreg);
+
+	zassert_ok(fetch(&value));
+	zassert_equal(bh1750_emul_get_mtreg(emul), mtreg);
+
+	/* The shortest does not saturate in the sun */
+	settle(100000000);
+	zassert_equal(bh1750_emul_get_mtreg(emul), MTREG_MIN);
+}
+
+ZTEST(bh1750, test_lux)
+{
+	static const int32_t lights[] = {
+		0, 1000, 12345, 100000, 1000000, 54612000, 100000000,
+	};
+	int32_t value, resolution;
+	uint8_t mtreg;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(lights); i++) {
+		value = settle(lights[i]);
+		mtreg = bh1750_emul_get_mtreg(emul);
+
+		/* A count is 1/1.2lx at the default measurement time */
+		resolution = DIV_ROUND_UP(57500, mtreg) + 1;
+		zassert_within(value, lights[i], resolution,
+			       "light %d mlx, got %d mlx at mtreg %u",
+			       lights[i], value, mtreg);
+	}
+}
+
+ZTEST(bh1750, test_mtreg_write_failure)
+{
+	int32_t value;
+	uint8_t mtreg, next;
+
+	settle(1000000);
+	mtreg = bh1750_emul_get_mtreg(emul);
+
+	/* The measurement time is not changed if the write fails */
+	bh1750_emul_set_light(emul, 100000000);
+	bh1750_emul_fail_writes(emul, 1);
+	zassert_equal(fetch(&value), -EIO);
+	zassert_equal(bh1750_emul_get_mtreg(emul), mtreg);
+
+	/* And the next fetch writes it again, from the saturated count */
+	next = CLAMP(mtreg * 0x8000 / UINT16_MAX, MTREG_MIN, MTREG_MAX);
+	zassert_ok(fetch(&value));
+	zassert_equal(bh1750_emul_get_mtreg(emul), next);
+}
+
+ZTEST_SUITE(bh1750, NULL, bh1750_setup, NULL, NULL, NULL);
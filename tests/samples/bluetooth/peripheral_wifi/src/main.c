@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ap_details.h"
+
+#define SCANS        50
+#define RESULTS_MIN  100
+#define RESULTS_MAX  500
+#define SSIDS_MIN    10
+#define SSIDS_MAX    310
+#define RSSI_NONE    INT_MIN
+
+static struct ap_details aps;
+/* Best RSSI per SSID in the current scan */
+static int best[SSIDS_MAX];
+
+static void ap_init(struct ap_detail *ap, int id, int8_t rssi)
+{
+	memset(ap, 0, sizeof(*ap));
+	ap->channel = 1 + id % 13;
+	ap->rssi = rssi;
+	if (id >= 0) {
+		ap->ssid_len = snprintf((char *)ap->ssid, sizeof(ap->ssid),
+					"net%d", id);
+	}
+}
+
+static int ap_id(const struct ap_detail *ap)
+{
+	char ssid[WIFI_SSID_MAX_LEN + 1] = { 0 };
+
+	memcpy(ssid, ap->ssid, ap->ssid_len);
+
+	return atoi(&ssid[3]);
+}
+
+static bool ap_less(const struct ap_detail *a, const struct ap_detail *b)
+{
+	if (a->state != b->state) {
+		return a->state < b->state;
+	}
+
+	return a->rssi < b->rssi;
+}
+
+static void check_heap(void)
+{
+	unsigned int i;
+
+	for (i = 1; i < aps.count; i++) {
+		zassert_false(ap_less(&aps.details[aps.heap[i]],
+				      &aps.details[aps.heap[(i - 1) / 2]]),
+			      "heap broken at %u", i);
+	}
+
+	for (i = 0; i < aps.count; i++) {
+		zassert_equal(aps.heap[aps.heap_pos[i]], i,
+			      "position of %u broken", i);
+	}
+}
+
+static void before(void *fixture)
+{
+	memset(&aps, 0, sizeof(aps));
+}
+
+/*
+ * Every SSID is kept once, with its best RSSI; and, once full, none of the
+ * SSIDs missing is stronger than the weakest kept.
+ */
+static void check_scan(int ssids)
+{
+	unsigned int i, j, current = 0;
+	int id, weakest = INT_MAX;
+	char ssid[WIFI_SSID_MAX_LEN];
+	int index, len;
+
+	for (i = 0; i < aps.count; i++) {
+		const struct ap_detail *a = &aps.details[i];
+
+		if (a->state != CURRENT_DETAILS) {
+			continue;
+		}
+
+		current++;
+		weakest = MIN(weakest, a->rssi);
+		if (a->ssid_len == 0) {
+			continue;
+		}
+
+		zassert_equal(a->rssi, best[ap_id(a)], "net%d", ap_id(a));
+		for (j = i + 1; j < aps.count; j++) {
+			const struct ap_detail *b = &aps.details[j];
+
+			zassert_false((a->ssid_len == b->ssid_len) &&
+				      !memcmp(a->ssid, b->ssid, a->ssid_len),
+				      "net%d twice", ap_id(a));
+		}
+	}
+
+	if (current < AP_DETAILS_MAX_LEN) {
+		return;
+	}
+
+	for (id = 0; id < ssids; id++) {
+		if (best[id] == RSSI_NONE) {
+			continue;
+		}
+
+		len = snprintf(ssid, sizeof(ssid), "net%d", id);
+		index = ap_details_find(&aps, (uint8_t *)ssid, len);
+		zassert_true((index >= 0 &&
+			      aps.details[index].state == CURRENT_DETAILS) ||
+			     (best[id] <= weakest),
+			     "net%d missing, %d > %d", id, best[id], weakest);
+	}
+}
+
+ZTEST(ap_details, test_flood)
+{
+	struct ap_detail ap;
+	int scan, n, ssids, r, id, i;
+	int8_t rssi;
+
+	for (scan = 0; scan < SCANS; scan++) {
+		n = RESULTS_MIN + sys_rand32_get() % (RESULTS_MAX - RESULTS_MIN + 1);
+		ssids = SSIDS_MIN + sys_rand32_get() % (SSIDS_MAX - SSIDS_MIN + 1);
+		for (i = 0; i < ARRAY_SIZE(best); i++) {
+			best[i] = RSSI_NONE;
+		}
+
+		ap_details_age(&aps);
+		check_heap();
+
+		for (r = 0; r < n; r++) {
+			id = sys_rand32_get() % ssids;
+			rssi = -30 - (int)(sys_rand32_get() % 70);
+
+			/* Hidden, now and then */
+			if (sys_rand32_get() % 20 == 0) {
+				id = -1;
+			} else {
+				best[id] = MAX(best[id], rssi);
+			}
+
+			ap_init(&ap, id, rssi);
+			ap_details_update(&aps, &ap);
+			check_heap();
+		}
+
+		check_scan(ssids);
+	}
+}
+
+ZTEST(ap_details, test_same_ssid)
+{
+	struct ap_detail ap;
+	int index;
+
+	/* Another band or BSSID updates the entry only if stronger */
+	ap_init(&ap, 1, -60);
+	index = ap_details_update(&aps, &ap);
+	zassert_equal(index, 0);
+
+	ap_init(&ap, 1, -70);
+	zassert_equal(ap_details_update(&aps, &ap), -1);
+	zassert_equal(aps.details[index].rssi, -60);
+
+	ap_init(&ap, 1, -50);
+	zassert_equal(ap_details_update(&aps, &ap), index);
+	zassert_equal(aps.details[index].rssi, -50);
+	zassert_equal(aps.count, 1);
+
+	/* Hidden SSIDs are never merged */
+	ap_init(&ap, -1, -40);
+	zassert_equal(ap_details_update(&aps, &ap), 1);
+	zassert_equal(ap_details_update(&aps, &ap), 2);
+	zassert_equal(aps.count, 3);
+}
+
+ZTEST(ap_details, test_replace_weakest)
+{
+	struct ap_detail ap;
+	int i, index;
+
+	for (i = 0; i < AP_DETAILS_MAX_LEN; i++) {
+		ap_init(&ap, i, -40 - i);
+		zassert_equal(ap_details_update(&aps, &ap), i);
+	}
+
+	/* Weaker than all */
+	ap_init(&ap, 100, -90);
+	zassert_equal(ap_details_update(&aps, &ap), -1);
+
+	/* The weakest is replaced in place */
+	ap_init(&ap, 101, -45);
+	index = ap_details_update(&aps, &ap);
+	zassert_equal(index, AP_DETAILS_MAX_LEN - 1);
+	zassert_equal(ap_id(&aps.details[index]), 101);
+	check_heap();
+}
+
+ZTEST(ap_details, test_stale)
+{
+	struct ap_detail ap;
+	int i, index;
+
+	for (i = 0; i < AP_DETAILS_MAX_LEN; i++) {
+		ap_init(&ap, i, -40);
+		zassert_equal(ap_details_update(&aps, &ap), i);
+	}
+
+	/* The last scan is stale, and replaced first, even if stronger */
+	ap_details_age(&aps);
+	zassert_equal(aps.count, AP_DETAILS_MAX_LEN);
+	for (i = 0; i < AP_DETAILS_MAX_LEN; i++) {
+		zassert_equal(aps.details[i].state, STALE_DETAILS);
+	}
+
+	ap_init(&ap, 3, -80);
+	zassert_equal(ap_details_update(&aps, &ap), 3);
+	zassert_equal(aps.details[3].state, CURRENT_DETAILS);
+
+	ap_init(&ap, 100, -90);
+	index = ap_details_update(&aps, &ap);
+	zassert_true(index >= 0 && index != 3);
+	check_heap();
+
+	/* The ones missed twice are dropped, the others kept in order */
+	ap_details_age(&aps);
+	zassert_equal(aps.count, 2);
+	zassert_equal(ap_id(&aps.details[0]), index < 3 ? 100 : 3);
+	zassert_equal(ap_id(&aps.details[1]), index < 3 ? 3 : 100);
+	check_heap();
+}
+
+ZTEST_SUITE(ap_details, NULL, NULL, before, NULL, NULL);
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023 Gaël PORTAY
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/shell/shell_dummy.h>
+#include <zephyr/ztest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const struct shell *sh;
+
+static int execute(const char *cmd)
+{
+	shell_backend_dummy_clear_output(sh);
+
+	return shell_execute_cmd(sh, cmd);
+}
+
+/* Value printed after the label, e.g. "Flash writes:      123" */
+static unsigned long output_value(const char *label)
+{
+	const char *output, *line;
+	size_t size;
+
+	output = shell_backend_dummy_get_output(sh, &size);
+	line = strstr(output, label);
+	if (line == NULL) {
+		TC_PRINT("No \"%s\" in output:\n%s\n", label, output);
+		return 0;
+	}
+
+	return strtoul(line + strlen(label), NULL, 0);
+}
+
+ZTEST(fcb_bench, test_refuse_non_empty)
+{
+	zassert_ok(execute("fcb clear"));
+	zassert_ok(execute("fcb append settings"));
+
+	/* The entry is kept, unless the benchmark is forced */
+	zassert_equal(execute("fcb bench 10"), -ENOTEMPTY);
+	zassert_equal(execute("fcb is-empty"), 1);
+}
+
+ZTEST(fcb_bench, test_counts)
+{
+	unsigned long writes, erases, flash_bytes, data_bytes;
+
+	zassert_ok(execute("fcb append settings"));
+	zassert_ok(execute("fcb bench 100 force"));
+
+	writes = output_value("Flash writes:");
+	erases = output_value("Flash erases:");
+	flash_bytes = output_value("Flash bytes:");
+	data_bytes = output_value("Logical bytes:");
+
+	/* 100 entries of every size, 8 to 256 bytes */
+	zassert_equal(data_bytes, 100 * (8 + 16 + 32 + 64 + 128 + 256));
+
+	/* Every entry is a length header, its data and a CRC at least */
+	zassert_true(writes >= 3 * 600, "%lu writes", writes);
+	zassert_true(flash_bytes > data_bytes, "%lu flash bytes",
+		     flash_bytes);
+
+	/* More data than the partition holds is appended */
+	zassert_true(erases > 0, "No erases");
+
+	/* The benchmark leaves the FCB empty */
+	zassert_ok(execute("fcb is-empty"));
+}
+
+ZTEST(fcb_bench, test_invalid)
+{
+	zassert_equal(execute("fcb bench 0 force"), -EINVAL);
+	zassert_equal(execute("fcb bench 10 now"), -EINVAL);
+}
+
+static void *fcb_bench_setup(void)
+{
+	sh = shell_backend_dummy_get_ptr();
+
+	/* Let the dummy backend initialize */
+	k_msleep(20);
+
+	return NULL;
+}
+
+ZTEST_SUITE(fcb_bench, NULL, fcb_bench_setup, NULL, NULL, NULL);